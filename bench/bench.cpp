@@ -0,0 +1,491 @@
+#include "memory.h"
+#include "game.h"
+#include "render_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Benchmarks over generated square worlds. Results go to stdout as one JSON object per line so
+// runs can be diffed or loaded by a script, progress goes to stderr.
+//   bench [--sizes 64,256,...] [--seed <seed>] [--threads <count>]
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    constexpr uint32_t DEFAULT_SIZES[] = {64, 256, 1024, 4096, 16384};
+    constexpr uint64_t DEFAULT_SEED = 1;
+
+    constexpr uint64_t GET_TILE_ITERATIONS = 1 << 24;
+    constexpr uint64_t PLACE_ITERATIONS = 1 << 20;
+    constexpr uint64_t COLLISION_ITERATIONS = 1 << 18;
+    constexpr uint32_t VISIBLE_FRAMES = 200;
+    constexpr uint32_t TICKS = 600;
+    constexpr uint32_t RAY_AGENTS = 100;
+    constexpr uint32_t RAYS_PER_AGENT = 64;
+    constexpr float RAY_DISTANCE = 64; // Tiles
+    constexpr uint32_t RAY_BATCHES = 50;
+    constexpr uint32_t STREAMED_MIN_SIZE = 4096; // Smaller worlds fit in the budget and are never streamed
+    constexpr size_t STREAMED_MEMORY_BUDGET = 8 * 1024 * 1024;
+    constexpr uint32_t STREAMED_STEPS = 64;
+
+    struct Options {
+        std::vector<uint32_t> sizes = {};
+        uint64_t seed = DEFAULT_SEED;
+        uint32_t thread_count = 0;
+    };
+
+    struct Field {
+        const char* name;
+        double value;
+    };
+
+    // Results feed a checksum that is printed, so the optimizer can not drop the measured loops
+    uint64_t checksum = 0;
+
+    void PrintResult(const char* benchmark, uint32_t size, std::initializer_list<Field> fields){
+        std::printf("{\"benchmark\":\"%s\",\"width\":%u,\"height\":%u", benchmark, size, size);
+        for (const Field& field : fields){
+            std::printf(",\"%s\":%.15g", field.name, field.value);
+        }
+        std::printf("}\n");
+        std::fflush(stdout);
+    }
+
+    double ElapsedMs(Clock::time_point start){
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // xorshift64, every run with the same seed touches the same tiles
+    struct Random {
+        uint64_t state;
+
+        uint64_t Next(){
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        // Uniform in [0, range)
+        uint32_t Below(uint32_t range){
+            return (uint32_t)(((Next() >> 32) * range) >> 32);
+        }
+    };
+
+    void BenchGenerate(Game::GameState& state, uint32_t size, uint64_t seed){
+        auto start = Clock::now();
+        Game::GenerateLevel(state, seed, size, size);
+        double ms = ElapsedMs(start);
+        PrintResult("generate", size, {
+            {"ms", ms},
+            {"allocated_chunks", (double)state.grid.GetAllocatedChunkCount()}
+        });
+    }
+
+    void BenchSaveLoad(Game::GameState& state, uint32_t size){
+        std::string name = "bench_" + std::to_string(size);
+        std::string path = "levels/" + name + LevelFormat::EXTENSION;
+
+        bool peak_reset = Memory::ResetPeak();
+        uint64_t resident = Memory::GetResidentBytes();
+        auto start = Clock::now();
+        bool saved = state.grid.SaveToFile(name);
+        double ms = ElapsedMs(start);
+        if (!saved){
+            std::fprintf(stderr, "bench: could not save %s\n", path.c_str());
+            return;
+        }
+        PrintResult("save", size, {
+            {"ms", ms},
+            {"bytes", (double)std::filesystem::file_size(path)},
+            {"resident_bytes", (double)resident},
+            {"peak_bytes", (double)Memory::GetPeakBytes()},
+            {"peak_reset", (double)peak_reset}
+        });
+
+        peak_reset = Memory::ResetPeak();
+        resident = Memory::GetResidentBytes();
+        start = Clock::now();
+        {
+            auto loaded = Grid::LoadFromFile(name);
+            ms = ElapsedMs(start);
+            if (!loaded.has_value()){
+                std::fprintf(stderr, "bench: could not load %s\n", path.c_str());
+                return;
+            }
+            checksum += loaded->GetAllocatedChunkCount();
+            PrintResult("load", size, {
+                {"ms", ms},
+                {"resident_bytes", (double)resident},
+                {"peak_bytes", (double)Memory::GetPeakBytes()},
+                {"peak_reset", (double)peak_reset}
+            });
+        }
+        std::filesystem::remove(path);
+
+    }
+
+    // Walks the camera corner to corner over a streamed copy of the world, with a pager budget far
+    // below its size. Light and pyramid storage should follow the resident chunks, not the world.
+    void BenchStreamed(Game::GameState& state, uint32_t size){
+        if (size < STREAMED_MIN_SIZE){
+            return;
+        }
+        std::string name = "bench_streamed_" + std::to_string(size);
+        std::string path = "levels/" + name + LevelFormat::EXTENSION;
+        if (!state.grid.SaveToFile(name)){
+            std::fprintf(stderr, "bench: could not save %s\n", path.c_str());
+            return;
+        }
+        {
+            auto pager = WorldPager::Open(name, PagerConfig{.memory_budget = STREAMED_MEMORY_BUDGET});
+            if (pager == nullptr){
+                std::fprintf(stderr, "bench: could not stream %s\n", path.c_str());
+                std::filesystem::remove(path);
+                return;
+            }
+            bool peak_reset = Memory::ResetPeak();
+            uint64_t resident = Memory::GetResidentBytes();
+            Grid grid = pager->NewGrid();
+            LightMap light;
+            TilePyramid pyramid;
+            CenteredCamera camera = state.camera;
+            float world_pixels = (float)size * Game::Config::TILE_RESOLUTION;
+            double max_sync_ms = 0;
+            uint32_t ticks = 0;
+            auto start = Clock::now();
+            for (uint32_t step = 0; step < STREAMED_STEPS; step++){
+                camera.center = {world_pixels * step / STREAMED_STEPS, world_pixels * step / STREAMED_STEPS};
+                Rectangle bounds = camera.GetBounds(Game::Config::WINDOW_SIZE);
+                // Ticks until everything the pager asked for has arrived
+                do {
+                    pager->Update(grid, bounds, camera.center, {0, 0}, Game::Config::TILE_RESOLUTION);
+                    auto sync_start = Clock::now();
+                    light.Sync(grid, Game::Config::LIGHT_CHUNKS_PER_TICK);
+                    pyramid.Sync(grid, Game::Config::PYRAMID_CHUNKS_PER_TICK);
+                    max_sync_ms = std::max(max_sync_ms, ElapsedMs(sync_start));
+                    ticks++;
+                    std::this_thread::yield();
+                } while (pager->in_flight > 0);
+            }
+            double ms = ElapsedMs(start);
+
+            size_t resident_chunks = pager->resident_chunks.size();
+            size_t light_slots = light.chunk_light.size() / Grid::CHUNK_AREA - light.free_slots.size();
+            size_t pyramid_slots = pyramid.chunk_cells.size() / TilePyramid::CHUNK_CELLS - pyramid.free_slots.size();
+            size_t pyramid_bytes = pyramid.chunk_cells.size();
+            for (const TilePyramid::Level& level : pyramid.levels){
+                pyramid_bytes += level.cells.size();
+            }
+            // Both pools hold one shared slot on top of a slot per resident chunk at most
+            bool bounded = light_slots <= resident_chunks + 1 && pyramid_slots <= resident_chunks + 1;
+            if (!bounded){
+                std::fprintf(stderr, "bench: streamed %u holds light or pyramid cells for chunks that are not resident\n", size);
+            }
+            checksum += light_slots + pyramid_slots;
+            PrintResult("streamed", size, {
+                {"ms", ms},
+                {"ticks", (double)ticks},
+                {"max_sync_ms", max_sync_ms},
+                {"resident_chunks", (double)resident_chunks},
+                {"tile_bytes", (double)(grid.chunk_tiles.size() * sizeof(Tile))},
+                {"light_bytes", (double)light.chunk_light.size()},
+                {"pyramid_bytes", (double)pyramid_bytes},
+                {"bounded", (double)bounded},
+                {"resident_bytes", (double)resident},
+                {"peak_bytes", (double)Memory::GetPeakBytes()},
+                {"peak_reset", (double)peak_reset}
+            });
+        }
+        std::filesystem::remove(path);
+
+    }
+
+    void BenchGetTile(const Grid& grid, uint32_t size){
+        Random random{0x9E3779B97F4A7C15ull};
+        uint64_t sum = 0;
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < GET_TILE_ITERATIONS; i++){
+            sum += grid.GetTile(random.Below(size), random.Below(size)).type;
+        }
+        double ms = ElapsedMs(start);
+        PrintResult("get_tile_random", size, {
+            {"iterations", (double)GET_TILE_ITERATIONS},
+            {"ms", ms},
+            {"ns_per_op", ms * 1e6 / GET_TILE_ITERATIONS}
+        });
+
+        // Row-major scan, wrapping around small worlds until as many tiles were read
+        uint64_t count = 0;
+        start = Clock::now();
+        while (count < GET_TILE_ITERATIONS){
+            for (uint32_t y = 0; y < size && count < GET_TILE_ITERATIONS; y++){
+                for (uint32_t x = 0; x < size; x++){
+                    sum += grid.GetTile(x, y).type;
+                }
+                count += size;
+            }
+        }
+        ms = ElapsedMs(start);
+        PrintResult("get_tile_sequential", size, {
+            {"iterations", (double)count},
+            {"ms", ms},
+            {"ns_per_op", ms * 1e6 / count}
+        });
+        checksum += sum;
+
+    }
+
+    void BenchPlace(Grid& grid, uint32_t size){
+        Random random{0xD1B54A32D192ED03ull};
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < PLACE_ITERATIONS; i++){
+            uint32_t x = random.Below(size);
+            uint32_t y = random.Below(size);
+            grid.Place(x, y, random.Below(Game::Config::TILE_COUNT - 1));
+        }
+        double ms = ElapsedMs(start);
+        PrintResult("place", size, {
+            {"iterations", (double)PLACE_ITERATIONS},
+            {"ms", ms},
+            {"ns_per_op", ms * 1e6 / PLACE_ITERATIONS}
+        });
+
+    }
+
+    void BenchCollision(Player& player, const Grid& grid, uint32_t size){
+        Rectangle spawn = player.sprite.dest_rect;
+        Random random{0x2545F4914F6CDD1Dull};
+        float world_pixels = (float)size * Game::Config::TILE_RESOLUTION;
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < COLLISION_ITERATIONS; i++){
+            player.sprite.dest_rect.x = random.Below(1 << 16) / 65536.f * world_pixels;
+            player.sprite.dest_rect.y = random.Below(1 << 16) / 65536.f * world_pixels;
+            player.CheckCollision(grid, Game::Config::TILE_RESOLUTION);
+            checksum += (uint64_t)player.sprite.dest_rect.x;
+        }
+        double ms = ElapsedMs(start);
+        player.sprite.dest_rect = spawn;
+        PrintResult("player_collision", size, {
+            {"iterations", (double)COLLISION_ITERATIONS},
+            {"ms", ms},
+            {"ns_per_op", ms * 1e6 / COLLISION_ITERATIONS}
+        });
+
+    }
+
+    // What drawing every visible chunk tile by tile reads and computes, without the draw calls
+    void BenchVisibleTiles(Game::GameState& state, uint32_t size){
+        auto start = Clock::now();
+        state.light.Sync(state.grid);
+        PrintResult("light_rebuild", size, {{"ms", ElapsedMs(start)}});
+
+        // The game's zoom, then zoomed out to four times the area in each direction
+        float game_zoom = state.camera.zoom;
+        for (float zoom : {game_zoom, game_zoom / 4}){
+            Random random{0x853C49E6748FEA9Bull};
+            CenteredCamera camera = state.camera;
+            camera.zoom = zoom;
+            float world_pixels = (float)size * Game::Config::TILE_RESOLUTION;
+            uint64_t tiles = 0;
+            uint64_t sum = 0;
+            start = Clock::now();
+            for (uint32_t frame = 0; frame < VISIBLE_FRAMES; frame++){
+                camera.center = {random.Below(1 << 16) / 65536.f * world_pixels, random.Below(1 << 16) / 65536.f * world_pixels};
+                Rectangle bounds = camera.GetBounds(Game::Config::WINDOW_SIZE);
+                ChunkRange visible = GetVisibleChunks(state.grid, bounds, Game::Config::TILE_RESOLUTION);
+                for (uint32_t chunk_y = visible.start_y; chunk_y < visible.end_y; chunk_y++){
+                    for (uint32_t chunk_x = visible.start_x; chunk_x < visible.end_x; chunk_x++){
+                        ForEachChunkTile(state.grid, state.light, chunk_x, chunk_y, [&](uint32_t, uint32_t, Tile tile, uint8_t level){
+                            Color tint = GetLightTint(std::max(level >> 4, level & 0xF));
+                            sum += tile.type + tint.r;
+                            tiles++;
+                        });
+                    }
+                }
+            }
+            double ms = ElapsedMs(start);
+            checksum += sum;
+            PrintResult("visible_tiles", size, {
+                {"zoom", zoom},
+                {"frames", (double)VISIBLE_FRAMES},
+                {"tiles_per_frame", (double)tiles / VISIBLE_FRAMES},
+                {"us_per_frame", ms * 1000 / VISIBLE_FRAMES}
+            });
+        }
+
+    }
+
+    // Vision cones of many agents cast as one batch
+    void BenchRaycast(Game::GameState& state, uint32_t size){
+        Random random{0x9FB21C651E98DF25ull};
+        std::vector<GridRay> rays;
+        for (uint32_t agent = 0; agent < RAY_AGENTS; agent++){
+            // Agents stand in open space, a few tries before settling for wherever
+            uint32_t x = random.Below(size);
+            uint32_t y = random.Below(size);
+            for (int tries = 0; tries < 64 && state.grid.IsSolid(x, y); tries++){
+                x = random.Below(size);
+                y = random.Below(size);
+            }
+            Vector2 origin = {x + 0.5f, y + 0.5f};
+            float angle = random.Below(1 << 16) / 65536.f * 2 * PI;
+            AppendConeRays(origin, {std::cos(angle), std::sin(angle)}, PI / 4, RAYS_PER_AGENT, RAY_DISTANCE, rays);
+        }
+        std::vector<RayHit> hits;
+        uint64_t hit_count = 0;
+        auto start = Clock::now();
+        for (uint32_t batch = 0; batch < RAY_BATCHES; batch++){
+            CastRays(state.grid, rays, hits, state.jobs.get());
+            for (const RayHit& hit : hits){
+                hit_count += hit.hit;
+            }
+        }
+        double ms = ElapsedMs(start);
+        checksum += hit_count;
+        PrintResult("raycast", size, {
+            {"rays_per_batch", (double)rays.size()},
+            {"max_distance", RAY_DISTANCE},
+            {"hit_ratio", (double)hit_count / (rays.size() * RAY_BATCHES)},
+            {"us_per_batch", ms * 1000 / RAY_BATCHES},
+            {"ns_per_ray", ms * 1e6 / (rays.size() * RAY_BATCHES)}
+        });
+
+    }
+
+    // Zoomed out views drawn from the tile pyramid, at the camera's minimum zoom and far below it
+    void BenchLodView(Game::GameState& state, uint32_t size){
+        auto start = Clock::now();
+        state.pyramid.Sync(state.grid);
+        PrintResult("pyramid_rebuild", size, {{"ms", ElapsedMs(start)}, {"levels", (double)state.pyramid.GetLevelCount()}});
+
+        for (float zoom : {1 / 8.f, 1 / 64.f}){
+            Random random{0x853C49E6748FEA9Bull};
+            CenteredCamera camera = state.camera;
+            camera.zoom = zoom;
+            SnapshotWriter writer;
+            float world_pixels = (float)size * Game::Config::TILE_RESOLUTION;
+            uint64_t cells = 0;
+            start = Clock::now();
+            for (uint32_t frame = 0; frame < VISIBLE_FRAMES; frame++){
+                camera.center = {random.Below(1 << 16) / 65536.f * world_pixels, random.Below(1 << 16) / 65536.f * world_pixels};
+                RenderSnapshot snapshot;
+                Rectangle bounds = camera.GetBounds(Game::Config::WINDOW_SIZE);
+                writer.CopyLodView(state.grid, state.light, state.pyramid, bounds, zoom, Game::Config::TILE_RESOLUTION, snapshot);
+                cells += snapshot.lod_view->types.size();
+                checksum += snapshot.lod_view->level;
+            }
+            double ms = ElapsedMs(start);
+            PrintResult("lod_view", size, {
+                {"zoom", zoom},
+                {"frames", (double)VISIBLE_FRAMES},
+                {"cells_per_frame", (double)cells / VISIBLE_FRAMES},
+                {"us_per_frame", ms * 1000 / VISIBLE_FRAMES}
+            });
+        }
+
+    }
+
+    void BenchTicks(Game::GameState& state, uint32_t size){
+        state.game_mode = PLAY;
+        std::vector<double> tick_us;
+        tick_us.reserve(TICKS);
+        for (uint32_t i = 0; i < TICKS; i++){
+            state.pending_input = Input{};
+            auto start = Clock::now();
+            Game::Tick(state);
+            tick_us.push_back(ElapsedMs(start) * 1000);
+        }
+        std::sort(tick_us.begin(), tick_us.end());
+        double total = 0;
+        for (double us : tick_us){
+            total += us;
+        }
+        PrintResult("tick", size, {
+            {"ticks", (double)TICKS},
+            {"avg_us", total / TICKS},
+            {"p50_us", tick_us[TICKS / 2]},
+            {"p99_us", tick_us[TICKS * 99 / 100]},
+            {"max_us", tick_us.back()}
+        });
+
+    }
+
+    void RunSize(const Options& options, uint32_t size){
+        std::fprintf(stderr, "bench: %ux%u\n", size, size);
+        auto state = std::make_unique<Game::GameState>();
+        // Nothing but the save benchmark may write files
+        state->autosave = nullptr;
+        state->player = Player::New(Texture2D{});
+        if (options.thread_count != 0){
+            state->jobs = JobSystem::New(options.thread_count);
+        }
+
+        BenchGenerate(*state, size, options.seed);
+        BenchSaveLoad(*state, size);
+        BenchStreamed(*state, size);
+        BenchGetTile(state->grid, size);
+        BenchCollision(state->player, state->grid, size);
+        BenchPlace(state->grid, size);
+        BenchVisibleTiles(*state, size);
+        BenchLodView(*state, size);
+        BenchRaycast(*state, size);
+        BenchTicks(*state, size);
+
+    }
+
+    bool ParseSizes(const std::string& text, std::vector<uint32_t>& sizes){
+        std::stringstream list(text);
+        std::string item;
+        while (std::getline(list, item, ',')){
+            uint32_t size = std::strtoul(item.c_str(), nullptr, 10);
+            if (size == 0){
+                return false;
+            }
+            sizes.push_back(size);
+        }
+        return !sizes.empty();
+    }
+
+} // namespace
+
+int main(int argc, char** argv){
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2){
+        std::string flag = argv[i];
+        if (flag == "--sizes"){
+            if (!ParseSizes(argv[i + 1], options.sizes)){
+                std::fprintf(stderr, "Invalid size list %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (flag == "--seed"){
+            options.seed = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (flag == "--threads"){
+            options.thread_count = std::strtoul(argv[i + 1], nullptr, 10);
+        } else {
+            std::fprintf(stderr, "Unknown option %s\n", flag.c_str());
+            return 1;
+        }
+    }
+    if (options.sizes.empty()){
+        options.sizes.assign(std::begin(DEFAULT_SIZES), std::end(DEFAULT_SIZES));
+    }
+
+    for (uint32_t size : options.sizes){
+        RunSize(options, size);
+    }
+    std::fprintf(stderr, "bench: checksum %llu\n", (unsigned long long)checksum);
+    return 0;
+
+}
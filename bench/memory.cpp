@@ -0,0 +1,67 @@
+#include "memory.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fstream>
+#include <string>
+#endif
+
+namespace Memory {
+
+#ifdef _WIN32
+
+uint64_t GetResidentBytes(){
+    PROCESS_MEMORY_COUNTERS counters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.WorkingSetSize;
+}
+
+uint64_t GetPeakBytes(){
+    PROCESS_MEMORY_COUNTERS counters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+}
+
+bool ResetPeak(){
+    return false;
+}
+
+#else
+
+namespace {
+
+    // "<key>: <value> kB" from /proc/self/status
+    uint64_t ReadStatusBytes(const std::string& key){
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)){
+            if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':'){
+                return std::stoull(line.substr(key.size() + 1)) * 1024;
+            }
+        }
+        return 0;
+    }
+
+} // namespace
+
+uint64_t GetResidentBytes(){
+    return ReadStatusBytes("VmRSS");
+}
+
+uint64_t GetPeakBytes(){
+    return ReadStatusBytes("VmHWM");
+}
+
+bool ResetPeak(){
+    // Linux resets VmHWM to the current resident size
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.flush();
+    return clear_refs.good();
+}
+
+#endif
+
+} // namespace Memory
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// Process memory for the benchmarks. Kept apart from the raylib headers, which clash with windows.h.
+namespace Memory {
+
+uint64_t GetResidentBytes();
+
+// Highest resident size since the last ResetPeak, or since the process started where the
+// platform cannot reset it
+uint64_t GetPeakBytes();
+
+// False if the peak could not be reset
+bool ResetPeak();
+
+} // namespace Memory
@@ -0,0 +1,192 @@
+#include "autosave.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <filesystem>
+
+std::unique_ptr<Autosave> Autosave::New(){
+    auto autosave = std::make_unique<Autosave>();
+    autosave->worker = WorkerThread::New();
+    return autosave;
+
+}
+
+Autosave::~Autosave(){
+    worker->Wait();
+
+}
+
+void Autosave::Attach(Grid& grid, std::string new_filename, bool on_disk){
+    worker->Wait();
+    if (copying){
+        copying = false;
+        full_copy.reset();
+        busy.store(false);
+    }
+    grid.TakeDirtyChunks();
+    grid_id = grid.id;
+    chunk_count = grid.chunks_x * grid.chunks_y;
+    filename = std::move(new_filename);
+    // Reopened on the next patch, the file may have been replaced since
+    chunk_file.reset();
+    // Whatever recovery file exists belongs to an older state of the level
+    needs_full_save.store(true);
+    has_unsaved_edits = !on_disk;
+
+}
+
+bool Autosave::IsAttached(const Grid& grid) const {
+    return grid.id == grid_id;
+
+}
+
+bool Autosave::Save(Grid& grid, uint32_t max_copy_chunks){
+    if (busy.load() || !IsAttached(grid)){
+        return false;
+    }
+    // The previous task has flagged itself done but may not have returned yet
+    worker->Wait();
+
+    std::vector<uint32_t> dirty = grid.TakeDirtyChunks();
+    has_unsaved_edits |= !dirty.empty();
+    if (!has_unsaved_edits){
+        return true;
+    }
+    if (needs_full_save.exchange(false)){
+        full_copy = GridCopy::New(grid);
+        copying = true;
+        busy.store(true);
+        Update(grid, max_copy_chunks);
+        return true;
+    }
+    if (dirty.empty()){
+        return true;
+    }
+
+    chunks.clear();
+    chunks.reserve(dirty.size());
+    for (uint32_t chunk : dirty){
+        LevelFormat::ChunkPayload& payload = chunks.emplace_back(LevelFormat::ChunkPayload{chunk, {}});
+        const Tile* tiles = grid.GetChunkTiles(chunk % grid.chunks_x, chunk / grid.chunks_x);
+        if (!LevelFormat::IsChunkAir(tiles)){
+            LevelFormat::EncodeChunk(tiles, payload.data);
+        }
+    }
+    PROFILE_COUNTER("autosave chunks", chunks.size());
+    busy.store(true);
+    worker->Start([this]{
+        PROFILE_THREAD("autosave");
+        WritePatch();
+        busy.store(false);
+    });
+    return true;
+
+}
+
+void Autosave::Update(const Grid& grid, uint32_t max_copy_chunks){
+    if (!copying){
+        return;
+    }
+    if (!full_copy->IsFollowing(grid)){
+        // The grid was replaced without Attach, whatever it is attached to next is written whole
+        copying = false;
+        full_copy.reset();
+        needs_full_save.store(true);
+        busy.store(false);
+        return;
+    }
+    if (!full_copy->Step(grid, max_copy_chunks)){
+        return;
+    }
+    copying = false;
+    worker->Start([this]{
+        PROFILE_THREAD("autosave");
+        WriteFull();
+        busy.store(false);
+    });
+
+}
+
+bool Autosave::IsBusy() const {
+    return busy.load();
+
+}
+
+void Autosave::Wait(){
+    worker->Wait();
+
+}
+
+const std::string& Autosave::GetFilename() const {
+    return filename;
+
+}
+
+void Autosave::DiscardRecovery(const std::string& level_name){
+    worker->Wait();
+    std::string path = "levels/" + GetRecoveryName(level_name) + LevelFormat::EXTENSION;
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    std::filesystem::remove(path + LevelFormat::JOURNAL_EXTENSION, error);
+    if (level_name == filename){
+        chunk_file.reset();
+        needs_full_save.store(true);
+    }
+
+}
+
+std::string Autosave::GetRecoveryName(const std::string& level_name){
+    return level_name + RECOVERY_SUFFIX;
+
+}
+
+bool Autosave::HasRecovery(const std::string& level_name){
+    return std::filesystem::exists("levels/" + GetRecoveryName(level_name) + LevelFormat::EXTENSION);
+
+}
+
+std::string Autosave::GetPath() const {
+    return "levels/" + GetRecoveryName(filename) + LevelFormat::EXTENSION;
+
+}
+
+void Autosave::WriteFull(){
+    PROFILE_SCOPE("autosave full");
+    // A journal left next to the old file must not be replayed onto the new one
+    std::error_code error;
+    std::filesystem::remove(GetPath() + LevelFormat::JOURNAL_EXTENSION, error);
+    chunk_file.reset();
+    if (!full_copy->grid.SaveToFile(GetRecoveryName(filename))){
+        needs_full_save.store(true);
+    }
+    full_copy.reset();
+
+}
+
+void Autosave::WritePatch(){
+    PROFILE_SCOPE("autosave patch");
+    std::string path = GetPath();
+    if (!chunk_file.has_value()){
+        chunk_file = LevelFormat::ChunkFile::Open(path);
+    }
+    // A missing file or one of another size is replaced whole
+    if (!chunk_file.has_value() || chunk_file->directory.size() != chunk_count){
+        chunk_file.reset();
+        needs_full_save.store(true);
+        return;
+    }
+
+    if (!chunk_file->Patch(chunks)){
+        // A journal left behind is finished by the next load
+        chunk_file.reset();
+        needs_full_save.store(true);
+        return;
+    }
+
+    uint64_t directory_end = sizeof(LevelFormat::Header) + chunk_file->directory.size() * sizeof(LevelFormat::ChunkEntry);
+    uint64_t garbage = chunk_file->file_end - directory_end - chunk_file->live_bytes;
+    if (garbage > std::max(chunk_file->live_bytes, COMPACT_SLACK)){
+        needs_full_save.store(true);
+    }
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "grid.h"
+#include "grid_copy.h"
+#include "jobs.h"
+#include "level_format.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Keeps unsaved edits in a recovery file next to the level, levels/<filename>.autosave.cave, so
+// the level itself only changes on an explicit save. The recovery file is written whole with
+// the first edit after a load or save, then only the chunks edited since the previous autosave
+// are patched in, so the cost follows what changed rather than the world size. Each batch is
+// journaled before the file is patched, a crash leaves either the previous autosave or the new
+// one. A level with a recovery file behind it can be restored by loading <filename>.autosave.
+struct Autosave {
+    // Garbage a patched file may hold beyond its live payload size before it is rewritten
+    static constexpr uint64_t COMPACT_SLACK = 1 << 20;
+    static constexpr const char* RECOVERY_SUFFIX = ".autosave";
+
+    static std::unique_ptr<Autosave> New();
+
+    ~Autosave();
+
+    // Follows the grid from now on. on_disk says levels/<filename>.cave already holds the grid as
+    // it is now, otherwise the next save writes the recovery file even if nothing was edited.
+    // A recovery file left from before is kept until the grid is edited.
+    void Attach(Grid& grid, std::string filename, bool on_disk);
+
+    bool IsAttached(const Grid& grid) const;
+
+    // Encodes the chunks changed since the previous save and writes them on the worker. A whole
+    // file save copies the grid up to max_copy_chunks chunks at a time, see Update. False if the
+    // previous save is still being copied or written or the grid is not attached.
+    bool Save(Grid& grid, uint32_t max_copy_chunks);
+
+    // Continues copying a whole file save and starts writing it once the copy is complete. Call
+    // every tick.
+    void Update(const Grid& grid, uint32_t max_copy_chunks);
+
+    bool IsBusy() const;
+
+    void Wait();
+
+    const std::string& GetFilename() const;
+
+    // Deletes the level's recovery file, for once an explicit save holds everything it did
+    void DiscardRecovery(const std::string& level_name);
+
+    // The level name that loads the level's recovery file
+    static std::string GetRecoveryName(const std::string& level_name);
+
+    static bool HasRecovery(const std::string& level_name);
+
+private:
+    std::unique_ptr<WorkerThread> worker = nullptr;
+    std::atomic<bool> busy = false;
+    std::atomic<bool> needs_full_save = true; // Also set by the worker after a failed patch
+    bool has_unsaved_edits = false; // The grid differs from levels/<filename>.cave
+    uint64_t grid_id = 0;
+    uint32_t chunk_count = 0;
+    std::string filename = {};
+
+    // Worker-owned while a save runs
+    std::optional<LevelFormat::ChunkFile> chunk_file = {};
+    std::vector<LevelFormat::ChunkPayload> chunks = {};
+    std::optional<GridCopy> full_copy = {};
+    bool copying = false; // Main thread only, the worker starts once the copy is complete
+
+    std::string GetPath() const;
+
+    void WriteFull();
+
+    void WritePatch();
+};
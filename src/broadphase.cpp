@@ -0,0 +1,155 @@
+#include "broadphase.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#define MAX_PUSH_SPEED 60.f
+#define MAX_PUSH_NEIGHBOURS 8 // Keeps dense piles from going quadratic
+
+namespace {
+
+    int32_t GetCell(float position, float cell_size){
+        return (int32_t)std::floor(position / cell_size);
+    }
+
+    uint64_t PackCell(int32_t cell_x, int32_t cell_y){
+        return ((uint64_t)(uint32_t)cell_y << 32) | (uint32_t)cell_x;
+    }
+
+    uint32_t HashCell(int32_t cell_x, int32_t cell_y, uint32_t mask){
+        return (((uint32_t)cell_x * 73856093u) ^ ((uint32_t)cell_y * 19349663u)) & mask;
+    }
+
+    uint32_t HashCell(uint64_t cell, uint32_t mask){
+        return HashCell((int32_t)(uint32_t)cell, (int32_t)(uint32_t)(cell >> 32), mask);
+    }
+
+} // namespace
+
+void Broadphase::Build(const EntityStore& entities, uint16_t tile_resolution){
+    uint32_t count = entities.Count();
+    uint32_t buckets = std::bit_ceil(std::max<uint32_t>(count * 2, 64));
+    cell_size = (float)CELL_SIZE * tile_resolution;
+    bucket_mask = buckets - 1;
+    max_extent = 0;
+
+    bucket_starts.assign(buckets + 1, 0);
+    entity_cells.resize(count);
+    entries.resize(count);
+    entry_cells.resize(count);
+
+    for (uint32_t i = 0; i < count; i++){
+        int32_t cell_x = GetCell(entities.position_x[i] + entities.width[i] / 2, cell_size);
+        int32_t cell_y = GetCell(entities.position_y[i] + entities.height[i] / 2, cell_size);
+        entity_cells[i] = PackCell(cell_x, cell_y);
+        bucket_starts[HashCell(cell_x, cell_y, bucket_mask) + 1]++;
+        max_extent = std::max({max_extent, entities.width[i], entities.height[i]});
+    }
+    for (uint32_t bucket = 0; bucket < buckets; bucket++){
+        bucket_starts[bucket + 1] += bucket_starts[bucket];
+    }
+
+    // Second pass places each entity at its bucket's cursor, cursors start at the bucket starts
+    std::vector<uint32_t> cursors(bucket_starts.begin(), bucket_starts.end() - 1);
+    for (uint32_t i = 0; i < count; i++){
+        uint32_t entry = cursors[HashCell(entity_cells[i], bucket_mask)]++;
+        entries[entry] = i;
+        entry_cells[entry] = entity_cells[i];
+    }
+
+}
+
+void Broadphase::Query(
+    const EntityStore& entities,
+    Rectangle area,
+    std::vector<uint32_t>& results,
+    size_t limit
+) const {
+    size_t full = limit == SIZE_MAX ? SIZE_MAX : results.size() + limit;
+    if (entries.empty()){
+        return;
+    }
+    float margin = max_extent / 2;
+    int32_t start_x = GetCell(area.x - margin, cell_size);
+    int32_t start_y = GetCell(area.y - margin, cell_size);
+    int32_t end_x = GetCell(area.x + area.width + margin, cell_size);
+    int32_t end_y = GetCell(area.y + area.height + margin, cell_size);
+
+    auto test = [&](uint32_t entity){
+        if (entity < entities.Count() && CheckCollisionRecs(entities.GetRect(entity), area)){
+            results.push_back(entity);
+        }
+    };
+
+    // An area covering more cells than there are buckets is cheaper to scan whole
+    uint64_t cell_count = (uint64_t)(end_x - start_x + 1) * (end_y - start_y + 1);
+    if (cell_count > bucket_starts.size()){
+        for (uint32_t entity : entries){
+            if (results.size() == full){
+                return;
+            }
+            test(entity);
+        }
+        return;
+    }
+
+    for (int32_t cell_y = start_y; cell_y <= end_y; cell_y++){
+        for (int32_t cell_x = start_x; cell_x <= end_x; cell_x++){
+            uint32_t bucket = HashCell(cell_x, cell_y, bucket_mask);
+            uint64_t cell = PackCell(cell_x, cell_y);
+            for (uint32_t entry = bucket_starts[bucket]; entry < bucket_starts[bucket + 1]; entry++){
+                if (results.size() == full){
+                    return;
+                }
+                if (entry_cells[entry] == cell){
+                    test(entries[entry]);
+                }
+            }
+        }
+    }
+
+}
+
+std::optional<uint32_t> Broadphase::Pick(const EntityStore& entities, Vector2 point) const {
+    std::vector<uint32_t> hits;
+    Query(entities, {point.x, point.y, 0.001f, 0.001f}, hits);
+    if (hits.empty()){
+        return std::nullopt;
+    }
+    // Later entities are drawn over earlier ones
+    return *std::max_element(hits.begin(), hits.end());
+
+}
+
+void SeparateEntities(EntityStore& entities, const Broadphase& broadphase, float delta_time, uint32_t start, uint32_t end){
+    std::vector<uint32_t> neighbours;
+    for (uint32_t i = start; i < end; i++){
+        if (!(entities.flags[i] & ENTITY_PUSHES)){
+            continue;
+        }
+        Rectangle rect = entities.GetRect(i);
+        neighbours.clear();
+        broadphase.Query(entities, rect, neighbours, MAX_PUSH_NEIGHBOURS);
+
+        for (uint32_t j : neighbours){
+            if (j == i || !(entities.flags[j] & ENTITY_PUSHES)){
+                continue;
+            }
+            Rectangle other = entities.GetRect(j);
+            Rectangle overlap = GetCollisionRec(rect, other);
+            bool horizontal = overlap.width < overlap.height;
+            float delta = horizontal
+                ? (other.x + other.width / 2) - (rect.x + rect.width / 2)
+                : (other.y + other.height / 2) - (rect.y + rect.height / 2);
+            // Bodies on the same spot split by index, both sides of a pair agree on the direction
+            float direction = delta != 0 ? (delta > 0 ? 1.f : -1.f) : (j > i ? 1.f : -1.f);
+            float push = std::min((horizontal ? overlap.width : overlap.height) / delta_time / 4, MAX_PUSH_SPEED);
+
+            std::vector<float>& velocity = horizontal ? entities.velocity_x : entities.velocity_y;
+            velocity[i] -= direction * push;
+        }
+    }
+
+}
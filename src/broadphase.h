@@ -0,0 +1,46 @@
+#pragma once
+
+#include "entities.h"
+#include "grid.h"
+
+#include <raylib.h>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// Uniform spatial hash over entity centers. Cells are CELL_SIZE x CELL_SIZE tiles, aligned with
+// Grid chunks, and hashed into a table sized to the entity count. Rebuilt with a counting sort
+// each tick, so a query only walks the buckets of the cells it covers.
+struct Broadphase {
+    static constexpr uint32_t CELL_SHIFT = 2;
+    static constexpr uint32_t CELL_SIZE = 1 << CELL_SHIFT;
+    static_assert(CELL_SHIFT <= Grid::CHUNK_SHIFT);
+
+    float cell_size = 0;     // In pixels
+    float max_extent = 0;    // Largest entity width or height, queries grow by half of it
+    uint32_t bucket_mask = 0;
+    std::vector<uint32_t> bucket_starts = {}; // Offsets into entries, one past the last bucket too
+    std::vector<uint32_t> entries = {};       // Entity indices grouped by bucket
+    std::vector<uint64_t> entry_cells = {};   // Cell of each entry, tells apart cells sharing a bucket
+    std::vector<uint64_t> entity_cells = {};
+
+    void Build(const EntityStore& entities, uint16_t tile_resolution);
+
+    // Appends entities overlapping the area, at most limit of them. Entities spawned since Build
+    // are not seen.
+    void Query(
+        const EntityStore& entities,
+        Rectangle area,
+        std::vector<uint32_t>& results,
+        size_t limit = SIZE_MAX
+    ) const;
+
+    // The topmost entity under the point
+    std::optional<uint32_t> Pick(const EntityStore& entities, Vector2 point) const;
+};
+
+// Pushes overlapping ENTITY_PUSHES bodies in [start, end) away from their neighbours through
+// their velocities, so the grid sweep that follows still has the last word on where they end up.
+// Only the range's own velocities are written, ranges can run in parallel.
+void SeparateEntities(EntityStore& entities, const Broadphase& broadphase, float delta_time, uint32_t start, uint32_t end);
@@ -0,0 +1,112 @@
+#include "collision.h"
+
+#include <cmath>
+#include <limits>
+
+namespace {
+
+    // Keeps boxes resting exactly on a tile boundary from counting the tile beyond it
+    constexpr float EDGE_EPSILON = 1e-4f;
+
+    struct TileSpan {
+        int64_t start, end; // end exclusive
+    };
+
+    TileSpan GetSpan(float low, float high, uint16_t tile_resolution){
+        return {
+            (int64_t)std::floor(low / tile_resolution + EDGE_EPSILON),
+            (int64_t)std::ceil(high / tile_resolution - EDGE_EPSILON)
+        };
+    }
+
+    // Next column (or row) the leading edge enters and when, in fractions of the motion
+    struct AxisStepper {
+        int64_t next;
+        int64_t step;
+        float time;
+        float time_per_tile;
+
+        static AxisStepper New(float low, float high, float motion, uint16_t tile_resolution){
+            if (motion > 0){
+                int64_t next = (int64_t)std::ceil(high / tile_resolution - EDGE_EPSILON);
+                return {next, 1, (next * tile_resolution - high) / motion, tile_resolution / motion};
+            }
+            if (motion < 0){
+                int64_t next = (int64_t)std::floor(low / tile_resolution + EDGE_EPSILON) - 1;
+                return {next, -1, ((next + 1) * tile_resolution - low) / motion, -tile_resolution / motion};
+            }
+            return {0, 0, std::numeric_limits<float>::infinity(), 0};
+        }
+
+        void Advance(){
+            next += step;
+            time += time_per_tile;
+        }
+    };
+
+} // namespace
+
+SweepHit SweepBox(const Grid& grid, Rectangle box, Vector2 motion, uint16_t tile_resolution){
+    SweepHit result;
+    AxisStepper stepper_x = AxisStepper::New(box.x, box.x + box.width, motion.x, tile_resolution);
+    AxisStepper stepper_y = AxisStepper::New(box.y, box.y + box.height, motion.y, tile_resolution);
+
+    while (std::min(stepper_x.time, stepper_y.time) <= 1){
+        bool cross_x = stepper_x.time <= stepper_y.time;
+        bool cross_y = stepper_y.time <= stepper_x.time;
+        float time = std::max(0.f, std::min(stepper_x.time, stepper_y.time));
+
+        float left = box.x + motion.x * time;
+        float top = box.y + motion.y * time;
+        TileSpan columns = GetSpan(left, left + box.width, tile_resolution);
+        TileSpan rows = GetSpan(top, top + box.height, tile_resolution);
+        // Crossing a corner enters the diagonal tile too
+        if (cross_x && cross_y){
+            columns = {std::min(columns.start, stepper_x.next), std::max(columns.end, stepper_x.next + 1)};
+            rows = {std::min(rows.start, stepper_y.next), std::max(rows.end, stepper_y.next + 1)};
+        }
+
+        if (cross_x){
+            auto y = grid.FindSolidInColumn(stepper_x.next, rows.start, rows.end - 1);
+            if (y.has_value()){
+                result = {true, time, {(float)-stepper_x.step, 0}, stepper_x.next, y.value(), box};
+            }
+        }
+        if (!result.hit && cross_y){
+            auto x = grid.FindSolidInRow(stepper_y.next, columns.start, columns.end - 1);
+            if (x.has_value()){
+                result = {true, time, {0, (float)-stepper_y.step}, x.value(), stepper_y.next, box};
+            }
+        }
+        if (result.hit){
+            break;
+        }
+
+        if (cross_x){
+            stepper_x.Advance();
+        }
+        if (cross_y){
+            stepper_y.Advance();
+        }
+    }
+
+    result.box = box;
+    result.box.x += motion.x * result.time;
+    result.box.y += motion.y * result.time;
+    // Snap the blocked edge onto the tile boundary so rounding never leaves the box inside the tile
+    if (result.hit && result.normal.x != 0){
+        result.box.x = result.normal.x < 0 ? result.tile_x * tile_resolution - box.width : (result.tile_x + 1) * tile_resolution;
+    }
+    if (result.hit && result.normal.y != 0){
+        result.box.y = result.normal.y < 0 ? result.tile_y * tile_resolution - box.height : (result.tile_y + 1) * tile_resolution;
+    }
+    return result;
+
+}
+
+bool OverlapsSolid(const Grid& grid, Rectangle box, uint16_t tile_resolution){
+    TileSpan columns = GetSpan(box.x, box.x + box.width, tile_resolution);
+    TileSpan rows = GetSpan(box.y, box.y + box.height, tile_resolution);
+    return grid.AnySolid(columns.start, rows.start, columns.end, rows.end);
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "grid.h"
+
+#include <raylib.h>
+#include <cstdint>
+
+struct SweepHit {
+    bool hit = false;
+    float time = 1;          // Fraction of the motion travelled before contact
+    Vector2 normal = {0, 0}; // Points out of the tile that was hit
+    int64_t tile_x = 0;
+    int64_t tile_y = 0;
+    Rectangle box = {0, 0, 0, 0}; // The box at the contact position, or moved by the full motion
+};
+
+// Moves an axis-aligned box of any size through the grid and returns the first solid tile it
+// would enter. Only the tiles along the leading edges are visited, one column or row per
+// boundary the box crosses, so the cost scales with the distance travelled and never skips a
+// tile however large the motion is. Tiles the box already overlaps are ignored.
+SweepHit SweepBox(const Grid& grid, Rectangle box, Vector2 motion, uint16_t tile_resolution);
+
+// True if any tile overlapped by the box is solid
+bool OverlapsSolid(const Grid& grid, Rectangle box, uint16_t tile_resolution);
@@ -0,0 +1,175 @@
+#include "entities.h"
+#include "collision.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+    template <typename T>
+    void AppendArray(std::vector<uint8_t>& output, const std::vector<T>& values){
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values.data());
+        output.insert(output.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    template <typename T>
+    bool ReadArray(const uint8_t*& data, const uint8_t* end, std::vector<T>& values, size_t count){
+        if ((size_t)(end - data) < count * sizeof(T)){
+            return false;
+        }
+        values.resize(count);
+        std::memcpy(values.data(), data, count * sizeof(T));
+        data += count * sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    void SwapRemove(std::vector<T>& values, uint32_t index){
+        values[index] = values.back();
+        values.pop_back();
+    }
+
+} // namespace
+
+size_t EntityStore::Count() const {
+    return position_x.size();
+
+}
+
+uint32_t EntityStore::Spawn(Vector2 position, Vector2 size, Vector2 velocity, uint16_t sprite_type, uint8_t entity_flags){
+    position_x.push_back(position.x);
+    position_y.push_back(position.y);
+    velocity_x.push_back(velocity.x);
+    velocity_y.push_back(velocity.y);
+    width.push_back(size.x);
+    height.push_back(size.y);
+    sprite.push_back(sprite_type);
+    flags.push_back(entity_flags);
+    return Count() - 1;
+
+}
+
+void EntityStore::Despawn(uint32_t index){
+    SwapRemove(position_x, index);
+    SwapRemove(position_y, index);
+    SwapRemove(velocity_x, index);
+    SwapRemove(velocity_y, index);
+    SwapRemove(width, index);
+    SwapRemove(height, index);
+    SwapRemove(sprite, index);
+    SwapRemove(flags, index);
+
+}
+
+void EntityStore::Clear(){
+    *this = EntityStore{};
+
+}
+
+void EntityStore::ApplyGravity(float gravity, float max_fall_speed, float delta_time, uint32_t start, uint32_t end){
+    float* velocity = velocity_y.data();
+    const uint8_t* entity_flags = flags.data();
+    for (size_t i = start; i < end; i++){
+        float accelerated = std::min(velocity[i] + gravity * delta_time, max_fall_speed);
+        velocity[i] = (entity_flags[i] & ENTITY_GRAVITY) ? accelerated : velocity[i];
+    }
+
+}
+
+void EntityStore::ApplyFriction(float factor, uint32_t start, uint32_t end){
+    float* velocity = velocity_x.data();
+    const uint8_t* entity_flags = flags.data();
+    for (size_t i = start; i < end; i++){
+        bool slows = (entity_flags[i] & (ENTITY_GROUNDED | ENTITY_FRICTION)) == (ENTITY_GROUNDED | ENTITY_FRICTION);
+        velocity[i] *= slows ? factor : 1.f;
+    }
+
+}
+
+void EntityStore::MoveAndCollide(const Grid& grid, uint16_t tile_resolution, float delta_time, uint32_t start, uint32_t end){
+    for (size_t i = start; i < end; i++){
+        float motion_x = velocity_x[i] * delta_time;
+        float motion_y = velocity_y[i] * delta_time;
+        if (!(flags[i] & ENTITY_COLLIDES)){
+            position_x[i] += motion_x;
+            position_y[i] += motion_y;
+            continue;
+        }
+
+        flags[i] &= ~ENTITY_GROUNDED;
+        Rectangle box = GetRect(i);
+        Rectangle swept = {
+            std::min(box.x, box.x + motion_x),
+            std::min(box.y, box.y + motion_y),
+            box.width + std::abs(motion_x),
+            box.height + std::abs(motion_y)
+        };
+        // Most bodies are in open air, one mask query settles them
+        if (!OverlapsSolid(grid, swept, tile_resolution)){
+            position_x[i] += motion_x;
+            position_y[i] += motion_y;
+            continue;
+        }
+
+        SweepHit hit = SweepBox(grid, box, {motion_x, 0}, tile_resolution);
+        if (hit.hit){
+            velocity_x[i] = 0;
+        }
+        hit = SweepBox(grid, hit.box, {0, motion_y}, tile_resolution);
+        if (hit.hit && hit.normal.y < 0){ //Hits ground
+            flags[i] |= ENTITY_GROUNDED;
+            velocity_y[i] = std::min(velocity_y[i], 0.f);
+        }
+        if (hit.hit && hit.normal.y > 0){ //Hits ceiling
+            velocity_y[i] = std::max(velocity_y[i], 0.f);
+        }
+        position_x[i] = hit.box.x;
+        position_y[i] = hit.box.y;
+    }
+
+}
+
+std::vector<uint8_t> EntityStore::ToBinary() const {
+    std::vector<uint8_t> output;
+    uint32_t count = Count();
+    output.insert(output.end(), reinterpret_cast<const uint8_t*>(&count), reinterpret_cast<const uint8_t*>(&count + 1));
+    AppendArray(output, position_x);
+    AppendArray(output, position_y);
+    AppendArray(output, velocity_x);
+    AppendArray(output, velocity_y);
+    AppendArray(output, width);
+    AppendArray(output, height);
+    AppendArray(output, sprite);
+    AppendArray(output, flags);
+    return output;
+
+}
+
+std::optional<EntityStore> EntityStore::FromBinary(const uint8_t* data, size_t size){
+    const uint8_t* end = data + size;
+    uint32_t count;
+    if (size < sizeof(count)){
+        std::cout << "Error loading entities: truncated" << std::endl;
+        return std::nullopt;
+    }
+    std::memcpy(&count, data, sizeof(count));
+    data += sizeof(count);
+
+    EntityStore store;
+    bool read = ReadArray(data, end, store.position_x, count)
+        && ReadArray(data, end, store.position_y, count)
+        && ReadArray(data, end, store.velocity_x, count)
+        && ReadArray(data, end, store.velocity_y, count)
+        && ReadArray(data, end, store.width, count)
+        && ReadArray(data, end, store.height, count)
+        && ReadArray(data, end, store.sprite, count)
+        && ReadArray(data, end, store.flags, count);
+    if (!read){
+        std::cout << "Error loading entities: truncated" << std::endl;
+        return std::nullopt;
+    }
+    return store;
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "grid.h"
+
+#include <raylib.h>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+enum EntityFlags : uint8_t {
+    ENTITY_GRAVITY = 1 << 0,
+    ENTITY_COLLIDES = 1 << 1,
+    ENTITY_GROUNDED = 1 << 2,
+    ENTITY_FRICTION = 1 << 3,
+    ENTITY_PUSHES = 1 << 4
+};
+
+// Dynamic bodies stored as parallel arrays, one entry per entity in each. Systems run over
+// ranges of the arrays so the simple ones vectorize, collision only touches the fields it needs
+// and disjoint ranges can run on different threads. Despawning swaps the last entity in, so
+// indices are not stable across despawns.
+struct EntityStore {
+    std::vector<float> position_x = {};
+    std::vector<float> position_y = {};
+    std::vector<float> velocity_x = {};
+    std::vector<float> velocity_y = {};
+    std::vector<float> width = {};
+    std::vector<float> height = {};
+    std::vector<uint16_t> sprite = {}; // Tile type drawn from the tile atlas
+    std::vector<uint8_t> flags = {};
+
+    size_t Count() const;
+
+    uint32_t Spawn(Vector2 position, Vector2 size, Vector2 velocity, uint16_t sprite_type, uint8_t entity_flags);
+
+    void Despawn(uint32_t index);
+
+    void Clear();
+
+    inline Rectangle GetRect(uint32_t index) const {
+        return {position_x[index], position_y[index], width[index], height[index]};
+    }
+
+    // Same rules as Player::ApplyGravity, for entities with ENTITY_GRAVITY
+    void ApplyGravity(float gravity, float max_fall_speed, float delta_time, uint32_t start, uint32_t end);
+
+    // Grounded entities with ENTITY_FRICTION lose horizontal speed like the player does
+    void ApplyFriction(float factor, uint32_t start, uint32_t end);
+
+    // Moves every entity by its velocity. Entities with ENTITY_COLLIDES are swept against the
+    // grid one axis at a time like Player::Update, unless their swept box is all air.
+    void MoveAndCollide(const Grid& grid, uint16_t tile_resolution, float delta_time, uint32_t start, uint32_t end);
+
+    std::vector<uint8_t> ToBinary() const;
+
+    static std::optional<EntityStore> FromBinary(const uint8_t* data, size_t size);
+};
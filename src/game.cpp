@@ -2,6 +2,9 @@
 #include "model.h"
 
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <raylib.h>
 #include <stdint.h>
 #include <iostream>
@@ -20,38 +23,21 @@ namespace Game {
     ){
         Vector2 world_position = GetScreenToWorld2D(mouse_position, camera.GetCamera2D(window_size));
         return {
-            (uint16_t)std::floor(world_position.x / tile_resolution),
-            (uint16_t)std::floor(world_position.y / tile_resolution),
+            (uint32_t)std::floor(world_position.x / tile_resolution),
+            (uint32_t)std::floor(world_position.y / tile_resolution),
         };
 
     }
 
-    Vector2u GetClampedMouseGridPosition(Vector2u mouse_grid_position, Vector2u player_grid_position){
-	    return {
-	    	std::clamp(mouse_grid_position.x, player_grid_position.x - 1, player_grid_position.x + 1),
-	    	std::clamp(mouse_grid_position.y, player_grid_position.x - 1, player_grid_position.x + 1)
-	    };
-    } //TODO: ASSERTION FAILURE. FIND IT
-
-    std::vector<Texture2D> GetTileTextures(const Image &spritesheet, uint16_t tile_resolution, uint16_t tile_type_count){
-        std::vector<Texture2D> textures(tile_type_count);
-
-        Rectangle source_rect = {0.0f, 0.0f, (float)tile_resolution, (float)tile_resolution};
-
-        size_t index = 0;
-        std::generate(textures.begin(), textures.end(), [&]() -> Texture2D {
-
-            source_rect.x = index * tile_resolution % (spritesheet.width);
-            source_rect.y = floor((float)index / ((float)spritesheet.width / tile_resolution)) * tile_resolution;
-
-            Image sub_image = ImageFromImage(spritesheet, source_rect);
-            Texture2D texture = LoadTextureFromImage(sub_image);
-            UnloadImage(sub_image);
-            index++;
-            return texture;
-        });
-
-        return textures;
+    std::optional<Vector2u> GetReachedTile(const Grid& grid, Vector2 player_center, Vector2 target){
+        Vector2 origin = {player_center.x / Config::TILE_RESOLUTION, player_center.y / Config::TILE_RESOLUTION};
+        Vector2 direction = {target.x / Config::TILE_RESOLUTION - origin.x, target.y / Config::TILE_RESOLUTION - origin.y};
+        float distance = std::min(std::hypot(direction.x, direction.y), Config::PLAYER_REACH);
+        RayHit hit = CastRay(grid, {origin, direction, distance});
+        if (!hit.hit){
+            return std::nullopt;
+        }
+        return Vector2u{hit.x, hit.y};
 
     }
 
@@ -73,8 +59,9 @@ namespace Game {
         Assets assets;
 
         assets.tile_spritesheet = LoadImage("assets/tiles.png");
-        assets.tile_textures = GetTileTextures(assets.tile_spritesheet, tile_resolution, tile_type_count);
+        assets.tile_atlas = TileAtlas::Load(assets.tile_spritesheet, tile_resolution, tile_type_count);
         assets.player_texture = LoadTexture("assets/player.png");
+        assets.chunk_cache = ChunkRenderCache::New(Config::CHUNK_CACHE_SIZE, Config::CHUNK_CACHE_REDRAWS_PER_FRAME);
 
         return assets;
 
@@ -82,12 +69,34 @@ namespace Game {
 
 
 //UPDATE
+    bool PlaceTile(GameState& state, uint32_t x, uint32_t y, uint16_t type){
+        if (!state.grid.InBounds(x, y) || state.grid.GetTileUnchecked(x, y).type == type){
+            return false;
+        }
+        state.journal.Record({x, y, 1, state.grid.GetTileUnchecked(x, y).type, type});
+        state.grid.Place(x, y, type);
+        state.light.OnTilePlaced(state.grid, x, y);
+        state.pyramid.OnTilePlaced(state.grid, x, y);
+        return true;
+
+    }
+
+    void OnTilesChanged(GameState& state, TileRegion changed){
+        state.light.OnRegionChanged(state.grid, changed);
+        state.pyramid.OnRegionChanged(state.grid, changed);
+
+    }
+
     void UpdateTilePlacing(GameState& state){
         if (state.input.pressed.space && state.game_mode == EDITOR){
             state.tile_place_type++;
         }
 
-        if (state.input.mouse_wheel && !state.input.held.ctrl){
+        if (state.input.mouse_wheel && state.input.held.space){
+            // Space and the wheel size the brush
+            int64_t radius = (int64_t)state.brush_radius + (int64_t)state.input.mouse_wheel;
+            state.brush_radius = std::clamp<int64_t>(radius, 0, Config::MAX_BRUSH_RADIUS);
+        } else if (state.input.mouse_wheel && !state.input.held.ctrl){
             state.tile_place_type += state.input.mouse_wheel;
         }
 
@@ -104,132 +113,670 @@ namespace Game {
                 Config::TILE_RESOLUTION,
                 Config::WINDOW_SIZE
             );
-            state.grid.Place(mouse_grid_position.x, mouse_grid_position.y, state.tile_place_type);
+            // Area edits could reach chunks a streamed level has not paged in yet
+            bool area_editable = state.pager == nullptr;
+            if (area_editable && state.input.held.ctrl){
+                TileRegion changed = state.grid.FloodFill(
+                    mouse_grid_position.x,
+                    mouse_grid_position.y,
+                    state.tile_place_type,
+                    Config::FLOOD_FILL_LIMIT,
+                    state.journal.GetRecorder()
+                );
+                OnTilesChanged(state, changed);
+            } else if (area_editable && state.brush_radius > 0){
+                TileRegion changed = state.grid.FillCircle(
+                    mouse_grid_position.x,
+                    mouse_grid_position.y,
+                    state.brush_radius,
+                    state.tile_place_type,
+                    state.journal.GetRecorder()
+                );
+                OnTilesChanged(state, changed);
+            } else if (IsTileEditable(state, mouse_grid_position)){
+                PlaceTile(state, mouse_grid_position.x, mouse_grid_position.y, state.tile_place_type);
+            }
         }
-        if (state.input.held.rmb){
+        if (state.input.held.rmb && state.input.held.ctrl){
+            // Ctrl erases entities instead of tiles
+            auto entity = GetMouseEntity(state, state.input.mouse_position, state.camera);
+            if (entity.has_value()){
+                state.entities.Despawn(entity.value());
+            }
+        } else if (state.input.held.rmb){
             auto mouse_grid_position = GetMouseGridPosition(
                 state.input.mouse_position,
                 state.camera,
                 Config::TILE_RESOLUTION,
                 Config::WINDOW_SIZE
             );
-            state.grid.Place(mouse_grid_position.x, mouse_grid_position.y, 0);
+            if (IsTileEditable(state, mouse_grid_position)){
+                uint16_t broken_type = state.grid.GetTile(mouse_grid_position.x, mouse_grid_position.y).type;
+                if (PlaceTile(state, mouse_grid_position.x, mouse_grid_position.y, 0)){
+                    SpawnDrop(state, mouse_grid_position, broken_type);
+                }
+            }
         }
 
     }
 
+    void UpdateEditHistory(GameState& state){
+        // Streamed chunks can be evicted under the history, so it is only kept for whole levels
+        bool history_enabled = state.game_mode == EDITOR && state.pager == nullptr;
+        bool stroke_held = state.input.held.lmb || (state.input.held.rmb && !state.input.held.ctrl);
+        if (!history_enabled || !stroke_held){
+            state.journal.EndStroke();
+        }
+        if (!history_enabled){
+            return;
+        }
+
+        if (state.input.held.ctrl && state.input.pressed.z){
+            OnTilesChanged(state, state.journal.Undo(state.grid));
+        } else if (state.input.held.ctrl && state.input.pressed.y){
+            OnTilesChanged(state, state.journal.Redo(state.grid));
+        }
+        if (stroke_held && !state.journal.IsStrokeOpen()){
+            state.journal.BeginStroke(state.grid);
+        }
+
+    }
+
+    std::optional<uint32_t> GetMouseEntity(const GameState& state, Vector2 mouse_position, const CenteredCamera& camera){
+        Vector2 world_position = GetScreenToWorld2D(mouse_position, camera.GetCamera2D(Config::WINDOW_SIZE));
+        return state.broadphase.Pick(state.entities, world_position);
+
+    }
+
+    void SpawnDrop(GameState& state, Vector2u grid_position, uint16_t tile_type){
+        if (state.entities.Count() >= Config::MAX_ENTITIES){
+            return;
+        }
+        float offset = (Config::TILE_RESOLUTION - Config::DROP_SIZE) / 2;
+        // Scatter deterministically so replays match
+        float spread = (float)((grid_position.x * 7 + grid_position.y * 13) % 9) - 4;
+        state.entities.Spawn(
+            {grid_position.x * Config::TILE_RESOLUTION + offset, grid_position.y * Config::TILE_RESOLUTION + offset},
+            {Config::DROP_SIZE, Config::DROP_SIZE},
+            {spread * 10, -80},
+            tile_type,
+            ENTITY_GRAVITY | ENTITY_COLLIDES | ENTITY_FRICTION | ENTITY_PUSHES
+        );
+
+    }
+
     void UpdateTileBreakingPlay(GameState& state){
         if (state.input.held.rmb){
-            Vector2u mouse_grid_position = GetMouseGridPosition(
-                state.input.mouse_position,
-                state.camera,
-                Config::TILE_RESOLUTION,
-                Config::WINDOW_SIZE
-            );
-            //TODO: FIX THIS. LO > HI in CLAMP
-            // Vector2u player_pos = state.player.GetGridPosition(Config::TILE_RESOLUTION);
-            // Vector2u clamped_position = GetClampedMouseGridPosition(mouse_grid_position, state.player.GetGridPosition(Config::TILE_RESOLUTION));
-            // state.grid.Place(clamped_position.x, clamped_position.y, 0);
+            Vector2 mouse_world_position = GetScreenToWorld2D(state.input.mouse_position, state.camera.GetCamera2D(Config::WINDOW_SIZE));
+            auto reached = GetReachedTile(state.grid, state.player.GetCenterPosition(), mouse_world_position);
+            if (reached.has_value() && IsTileEditable(state, reached.value())){
+                uint16_t broken_type = state.grid.GetTileUnchecked(reached->x, reached->y).type;
+                if (PlaceTile(state, reached->x, reached->y, 0)){
+                    SpawnDrop(state, reached.value(), broken_type);
+                }
+            }
         }
 
     }
 
-    void UpdateLevel(const Input& input, Grid& grid){
-        if (input.pressed.f5){
-            std::cout << std::endl <<"LOADING LEVEL: Enter a level name: ";
-            std::string level_name;
-            std::cin >> level_name;
-            auto new_grid = Grid::LoadFromFile(level_name);
-            if (new_grid.has_value()){
-                grid = new_grid.value();
-            }
-        } else if (input.pressed.f6){
-            std::cout << std::endl <<"SAVING LEVEL: Enter a level name (null for none): ";
-            std::string level_name;
-            std::cin >> level_name;
+    bool IsTileEditable(const GameState& state, Vector2u grid_position){
+        // Chunks that are not paged in yet would be overwritten when their data arrives
+        return state.pager == nullptr || state.pager->IsResident(grid_position.x, grid_position.y);
+    }
+
+    bool IsPlayerAreaLoaded(const GameState& state){
+        if (state.pager == nullptr){
+            return true;
+        }
+        // Hold the player in place until the chunk under it is paged in, outside the world there is nothing to wait for
+        Vector2 center = state.player.GetCenterPosition();
+        int64_t x = std::floor(center.x / Config::TILE_RESOLUTION);
+        int64_t y = std::floor(center.y / Config::TILE_RESOLUTION);
+        return !state.grid.InBounds(x, y) || state.pager->IsResident(x, y);
+    }
+
+    void GenerateLevel(GameState& state, uint64_t seed, uint32_t width, uint32_t height){
+        if (state.pager != nullptr){
+            state.pager->Flush(state.grid);
+            state.pager = nullptr;
+        }
+        CaveGenerator generator = CaveGenerator::New(seed);
+        state.grid = generator.Generate(width, height, *state.jobs);
+        state.seed = seed;
+
+        uint32_t spawn_x = width / 2;
+        Rectangle& player_rect = state.player.sprite.dest_rect;
+        player_rect.x = spawn_x * Config::TILE_RESOLUTION;
+        player_rect.y = (float)generator.GetSurfaceHeight(spawn_x) * Config::TILE_RESOLUTION - player_rect.height;
+        state.player.velocity = {0, 0};
+        state.previous_player_position = {player_rect.x, player_rect.y};
+
+    }
+
+    void SetLevelMessage(GameState& state, std::string message){
+        std::cout << std::endl << message;
+        state.level_message = std::move(message);
+        state.level_message_tick = state.tick;
+
+    }
+
+    void SubmitLevelPrompt(GameState& state, const LevelPrompt& prompt){
+        const std::string& level_name = prompt.text;
+        if (state.autosave != nullptr){
+            // It may be writing the file about to be saved or loaded
+            state.autosave->Update(state.grid, UINT32_MAX);
+            state.autosave->Wait();
+        }
+        if (prompt.operation == LevelIO::SAVE){
             if (level_name.empty()){
-                std::cout << std::endl << "Level not saved.";
-            } else {
-                grid.SaveToFile(level_name);
+                SetLevelMessage(state, "Level not saved.");
+                return;
+            }
+            if (state.autosave != nullptr){
+                // The saved level holds everything the recovery files did, under the old name too
+                if (state.autosave->IsAttached(state.grid)){
+                    state.autosave->DiscardRecovery(state.autosave->GetFilename());
+                }
+                // Edits from here on are newer than the saved copy and go into the next autosave
+                state.autosave->Attach(state.grid, level_name, true);
+                state.autosave->DiscardRecovery(level_name);
+                state.autosave_tick = state.tick;
+            }
+            state.level_io->StartSave(state.grid, level_name);
+            return;
+        }
+        if (level_name.empty()){
+            return;
+        }
+        // "seed:<number>" generates a new cave instead of loading a file
+        if (level_name.starts_with("seed:")){
+            uint64_t seed = std::strtoull(level_name.c_str() + 5, nullptr, 10);
+            GenerateLevel(state, seed, Config::GENERATED_WIDTH, Config::GENERATED_HEIGHT);
+            return;
+        }
+        if (WorldPager::ShouldStream(level_name, Config::PAGER_MEMORY_BUDGET)){
+            auto pager = WorldPager::Open(level_name, PagerConfig{.memory_budget = Config::PAGER_MEMORY_BUDGET});
+            if (pager != nullptr){
+                if (state.pager != nullptr){
+                    state.pager->Flush(state.grid);
+                }
+                state.grid = pager->NewGrid();
+                state.pager = std::move(pager);
+            }
+            return;
+        }
+        state.level_io->StartLoad(level_name);
+
+    }
+
+    void FinishLevelIO(GameState& state){
+        LevelIO::Status status = state.level_io->GetStatus();
+        if (status != LevelIO::SUCCEEDED && status != LevelIO::FAILED){
+            return;
+        }
+        LevelIO::Operation operation = state.level_io->GetOperation();
+        std::string level_name = state.level_io->GetFilename();
+        std::optional<Grid> new_grid = state.level_io->Finish();
+        if (status == LevelIO::FAILED){
+            SetLevelMessage(state, (operation == LevelIO::SAVE ? "Could not save " : "Could not load ") + level_name);
+            if (operation == LevelIO::SAVE && state.autosave != nullptr && state.autosave->IsAttached(state.grid)){
+                state.autosave->Attach(state.grid, level_name, false);
             }
+            return;
+        }
+        if (operation == LevelIO::SAVE){
+            SetLevelMessage(state, "Saved " + level_name);
+            return;
+        }
+        if (state.pager != nullptr){
+            state.pager->Flush(state.grid);
+            state.pager = nullptr;
+        }
+        state.grid = std::move(new_grid.value());
+        // A recovery file belongs to its level, the edits in it are not in the level file yet
+        std::string recovered_name = level_name;
+        bool is_recovery = level_name.ends_with(Autosave::RECOVERY_SUFFIX);
+        if (is_recovery){
+            recovered_name.resize(level_name.size() - std::strlen(Autosave::RECOVERY_SUFFIX));
         }
+        if (state.autosave != nullptr){
+            state.autosave->Attach(state.grid, recovered_name, !is_recovery);
+            state.autosave_tick = state.tick;
+        }
+        if (is_recovery){
+            SetLevelMessage(state, "Recovered unsaved edits of " + recovered_name + ", save to keep them");
+        } else if (Autosave::HasRecovery(level_name)){
+            SetLevelMessage(state, "Loaded " + level_name + ", load " + Autosave::GetRecoveryName(level_name) + " to recover unsaved edits");
+        } else {
+            SetLevelMessage(state, "Loaded " + level_name);
+        }
+
     }
 
-    void Update(GameState& state){
-        state.delta_time = GetFrameTime();
-        state.input = Input::Capture();
+    void UpdateAutosave(GameState& state){
+        if (state.autosave == nullptr){
+            return;
+        }
+        state.autosave->Update(state.grid, Config::SAVE_COPY_CHUNKS_PER_TICK);
+        // Streamed levels write their chunks back through the pager instead
+        if (state.pager != nullptr || state.level_io->GetStatus() != LevelIO::IDLE){
+            return;
+        }
+        if (!state.autosave->IsAttached(state.grid)){
+            state.autosave->Attach(state.grid, Config::AUTOSAVE_FILENAME, false);
+            state.autosave_tick = state.tick;
+        }
+        if (state.tick - state.autosave_tick >= Config::AUTOSAVE_INTERVAL_TICKS && state.autosave->Save(state.grid, Config::SAVE_COPY_CHUNKS_PER_TICK)){
+            state.autosave_tick = state.tick;
+        }
 
-        if (WindowShouldClose() || state.input.pressed.escape) {
-            state.exit_requested = true;
+    }
+
+    void UpdateLevel(GameState& state){
+        state.level_io->Update(state.grid, Config::SAVE_COPY_CHUNKS_PER_TICK);
+        FinishLevelIO(state);
+        UpdateAutosave(state);
+
+        if (state.level_prompt.has_value()){
+            // Typing happens on the main thread in BeginFrame, the tick only acts on the result
+            if (state.level_prompt->submitted){
+                LevelPrompt prompt = std::move(state.level_prompt.value());
+                state.level_prompt.reset();
+                SubmitLevelPrompt(state, prompt);
+            }
+            return;
+        }
+        if (state.level_io->GetStatus() != LevelIO::IDLE){
+            return;
         }
 
-        if (state.exit_requested){
-            if (state.input.pressed.y){
-                state.exiting = true;
+        if (state.input.pressed.f5){
+            state.level_prompt = LevelPrompt{LevelIO::LOAD, "", false};
+        } else if (state.input.pressed.f6){
+            if (state.pager != nullptr){
+                // A streamed level is only partly in memory, so changes go back to its own file
+                std::cout << std::endl << "SAVING STREAMED LEVEL: " << state.pager->filename;
+                state.pager->Flush(state.grid);
+                return;
             }
-            if (state.input.pressed.n){
-                state.exit_requested = false;
+            state.level_prompt = LevelPrompt{LevelIO::SAVE, "", false};
+        }
+    }
+
+    bool StartRecording(GameState& state){
+        if (state.pager != nullptr){
+            std::cout << std::endl << "Streamed levels can not be recorded.";
+            return false;
+        }
+        // The first tick separates entities using the broadphase, make it match the saved entities
+        state.broadphase.Build(state.entities, Config::TILE_RESOLUTION);
+        // Playback starts without history, so undo must not reach back past the recording either
+        state.journal.Clear();
+        state.recording = Replay{
+            .tick_rate = Config::TICK_RATE,
+            .seed = state.seed,
+            .game_mode = state.game_mode,
+            .player_rect = state.player.sprite.dest_rect,
+            .player_velocity = state.player.velocity,
+            .camera_center = state.camera.center,
+            .camera_zoom = state.camera.zoom,
+            .level = state.grid.ToBinary(),
+            .entities = state.entities.ToBinary(),
+            .inputs = {}
+        };
+        return true;
+    }
+
+    void StopRecording(GameState& state, std::string filename){
+        if (state.recording.has_value()){
+            state.recording->SaveToFile(filename);
+            std::cout << std::endl << "Recorded " << state.recording->inputs.size() << " ticks to " << filename;
+            state.recording.reset();
+        }
+    }
+
+    bool StartPlayback(GameState& state, Replay replay){
+        if (replay.tick_rate != Config::TICK_RATE){
+            std::cout << std::endl << "Replay was recorded at " << replay.tick_rate << " ticks per second, not " << Config::TICK_RATE;
+            return false;
+        }
+        auto grid = Grid::FromBinary(replay.level.data(), replay.level.size());
+        auto entities = EntityStore::FromBinary(replay.entities.data(), replay.entities.size());
+        if (!grid.has_value() || !entities.has_value()){
+            return false;
+        }
+
+        if (state.pager != nullptr){
+            state.pager->Flush(state.grid);
+            state.pager = nullptr;
+        }
+        state.grid = std::move(grid.value());
+        state.entities = std::move(entities.value());
+        state.broadphase.Build(state.entities, Config::TILE_RESOLUTION);
+        state.seed = replay.seed;
+        state.game_mode = replay.game_mode;
+        state.player.sprite.dest_rect = replay.player_rect;
+        state.player.velocity = replay.player_velocity;
+        state.camera.center = replay.camera_center;
+        state.camera.zoom = replay.camera_zoom;
+        state.previous_player_position = {replay.player_rect.x, replay.player_rect.y};
+        state.previous_camera_center = replay.camera_center;
+        state.playback = std::move(replay);
+        state.playback_tick = 0;
+        return true;
+    }
+
+    void UpdateReplay(GameState& state){
+        if (state.playback.has_value()){
+            if (state.playback_tick < state.playback->inputs.size()){
+                state.input = state.playback->inputs[state.playback_tick++];
+                return;
+            }
+            std::cout << std::endl << "Replay finished after " << state.playback_tick << " ticks";
+            state.playback.reset();
+        }
+
+        bool toggle_recording = state.input.pressed.f7;
+        bool start_playback = state.input.pressed.f8;
+        state.input.pressed.f7 = false;
+        state.input.pressed.f8 = false;
+
+        if (toggle_recording){
+            if (state.recording.has_value()){
+                StopRecording(state, "latest");
+            } else {
+                StartRecording(state);
+            }
+        }
+        if (start_playback){
+            StopRecording(state, "latest");
+            auto replay = Replay::LoadFromFile("latest");
+            if (replay.has_value() && StartPlayback(state, std::move(replay.value()))){
+                state.input = state.playback->inputs.empty() ? Input{} : state.playback->inputs[state.playback_tick++];
+                return;
             }
         }
 
+        if (state.recording.has_value()){
+            state.recording->inputs.push_back(state.input);
+        }
+    }
+
+    void TickInput(GameState& state){
+        state.previous_player_position = {state.player.sprite.dest_rect.x, state.player.sprite.dest_rect.y};
+        state.previous_camera_center = state.camera.center;
+
+        state.input = state.pending_input;
+        state.pending_input.ClearEvents();
+        UpdateReplay(state);
+
         if(state.input.pressed.f4){
             state.game_mode = (state.game_mode == PLAY) ? EDITOR : PLAY;
 
         }
+
+    }
+
+    void TickEditing(GameState& state){
+        UpdateEditHistory(state);
         if(state.game_mode == EDITOR){
-            UpdateLevel(state.input, state.grid);
+            UpdateLevel(state);
             UpdateTilePlacing(state);
         }
         if (state.game_mode == PLAY){
-	        UpdateLevel(state.input, state.grid);
+	        UpdateLevel(state);
 	       	UpdateTileBreakingPlay(state);
 		};
 
-        state.player.Update(state.game_mode, state.input, state.grid, Config::GRAVITY, state.delta_time);
+    }
+
+    void TickPlayer(GameState& state){
+        if (IsPlayerAreaLoaded(state)){
+            state.player.Update(state.game_mode, state.input, state.grid, Config::GRAVITY, Config::TICK_DELTA);
+        }
+
+    }
+
+    void TickEntities(GameState& state){
+        EntityStore& entities = state.entities;
+        const Grid& grid = state.grid;
+        const Broadphase& broadphase = state.broadphase;
 
+        // Separation reads neighbour positions, so every batch finishes it before any batch moves
+        auto separated = state.jobs->ParallelForAsync(entities.Count(), Config::ENTITY_BATCH_SIZE,
+            [&entities, &broadphase](uint32_t start, uint32_t end){
+                // Positions have not moved since the last rebuild, only entities spawned since are missed
+                SeparateEntities(entities, broadphase, Config::TICK_DELTA, start, end);
+            }
+        );
+        auto moved = state.jobs->ParallelForAsync(entities.Count(), Config::ENTITY_BATCH_SIZE,
+            [&entities, &grid](uint32_t start, uint32_t end){
+                entities.ApplyGravity(Config::GRAVITY, Config::MAX_FALL_SPEED, Config::TICK_DELTA, start, end);
+                entities.ApplyFriction(Config::ENTITY_FRICTION, start, end);
+                entities.MoveAndCollide(grid, Config::TILE_RESOLUTION, Config::TICK_DELTA, start, end);
+            },
+            {separated}
+        );
+        state.jobs->Wait(moved);
+
+        // Anything that fell out of the world is gone for good
+        float floor = (float)state.grid.size_y * Config::TILE_RESOLUTION * 2;
+        for (uint32_t i = 0; i < entities.Count();){
+            if (entities.position_y[i] > floor){
+                entities.Despawn(i);
+            } else {
+                i++;
+            }
+        }
+
+        state.broadphase.Build(entities, Config::TILE_RESOLUTION);
+
+    }
+
+    void TickWorld(GameState& state){
         state.camera.Update(state.player.GetCenterPosition(), state.input, Config::WINDOW_SIZE);
 
+        if (state.pager != nullptr){
+            state.pager->Update(
+                state.grid,
+                state.camera.GetBounds(Config::WINDOW_SIZE),
+                state.player.GetCenterPosition(),
+                state.player.velocity,
+                Config::TILE_RESOLUTION
+            );
+        }
+
+        // Picks up chunks the pager streamed in and any newly loaded grid
+        state.light.Sync(state.grid, Config::LIGHT_CHUNKS_PER_TICK);
+        state.pyramid.Sync(state.grid, Config::PYRAMID_CHUNKS_PER_TICK);
+
     }
 
+    void Tick(GameState& state){
+        PROFILE_SCOPE("tick");
+        for (const TickPhase& phase : TICK_PHASES){
+            PROFILE_SCOPE(phase.name);
+            phase.run(state);
+        }
+        state.jobs->WaitAll();
+        state.tick++;
 
-//RENDER
-    void RenderGrid(const Grid& grid, const std::vector<Texture2D>& tile_textures, Rectangle bounds, uint16_t tile_resolution){
-        int start_x = bounds.x / tile_resolution;
-        int start_y = bounds.y / tile_resolution;
-        int end_x = (bounds.x + bounds.width) / tile_resolution + 1;
-        int end_y = (bounds.y + bounds.height) / tile_resolution + 1;
-
-        start_x = std::max(0, start_x);
-        start_y = std::max(0, start_y);
-        end_x = std::min((int)grid.size_x, end_x);
-        end_y = std::min((int)grid.size_y, end_y);;
-
-        for (int y = start_y; y < end_y; y++)
-        {
-            for (uint16_t x = start_x; x < end_x; x++)
-            {
-                const Texture2D& tile_texture = tile_textures.at(grid.GetTile(x, y).type);
+    }
+
+    bool UpdateLevelPrompt(LevelPrompt& prompt){
+        for (int character = GetCharPressed(); character != 0; character = GetCharPressed()){
+            // Names become paths under levels/, so separators are left out
+            bool printable = character >= 32 && character < 127 && character != '/' && character != '\\';
+            if (printable && prompt.text.size() < Config::MAX_LEVEL_NAME_LENGTH){
+                prompt.text.push_back((char)character);
+            }
+        }
+        if ((IsKeyPressed(KEY_BACKSPACE) || IsKeyPressedRepeat(KEY_BACKSPACE)) && !prompt.text.empty()){
+            prompt.text.pop_back();
+        }
+        if (IsKeyPressed(KEY_ENTER)){
+            prompt.submitted = true;
+        }
+        return !IsKeyPressed(KEY_ESCAPE);
+
+    }
 
-                DrawTexture(tile_texture, x * tile_resolution, y * tile_resolution, WHITE);
+    uint16_t BeginFrame(GameState& state){
+        PROFILE_SCOPE("begin frame");
+        state.delta_time = GetFrameTime();
+        Input frame_input = Input::Capture();
+        bool typing = state.level_prompt.has_value() && !state.level_prompt->submitted;
+        if (typing){
+            if (!UpdateLevelPrompt(state.level_prompt.value())){
+                state.level_prompt.reset();
+            }
+            // Keys typed into the prompt do not reach the game
+            frame_input = Input{frame_input.mouse_position, 0, {}, {}};
+        }
+        state.pending_input = Input::Merge(state.pending_input, frame_input);
+
+        // Window side tools, not part of the simulation's input
+        if (IsKeyPressed(KEY_F3)){
+            state.profiler_overlay = !state.profiler_overlay;
+        }
+        if (IsKeyPressed(KEY_M) && !typing){
+            state.minimap_visible = !state.minimap_visible;
+        }
+        if (IsKeyPressed(KEY_F2)){
+            if (Profiler::IsCapturing()){
+                Profiler::StopCapture(Config::TRACE_PATH);
+            } else {
+                Profiler::StartCapture();
             }
         }
 
+        if (WindowShouldClose() || frame_input.pressed.escape) {
+            state.exit_requested = true;
+        }
+
+        if (state.exit_requested){
+            if (frame_input.pressed.y){
+                state.exiting = true;
+            }
+            if (frame_input.pressed.n){
+                state.exit_requested = false;
+            }
+        }
+
+        state.tick_accumulator += state.delta_time;
+        uint16_t ticks = 0;
+        while (state.tick_accumulator >= Config::TICK_DELTA && ticks < Config::MAX_TICKS_PER_FRAME){
+            state.tick_accumulator -= Config::TICK_DELTA;
+            ticks++;
+        }
+        if (ticks == Config::MAX_TICKS_PER_FRAME){
+            // Too far behind, drop the backlog instead of spiralling
+            state.tick_accumulator = std::min(state.tick_accumulator, Config::TICK_DELTA);
+        }
+        return ticks;
+
+    }
+
+    void RunTicks(GameState& state, uint16_t ticks){
+        for (uint16_t i = 0; i < ticks; i++){
+            Tick(state);
+        }
+
+    }
+
+    RenderSnapshot CaptureSnapshot(GameState& state){
+        PROFILE_SCOPE("capture snapshot");
+        RenderSnapshot snapshot;
+        snapshot.tick = state.tick;
+        snapshot.game_mode = state.game_mode;
+        snapshot.tile_place_type = state.tile_place_type;
+        snapshot.exit_requested = state.exit_requested;
+        snapshot.profiler_overlay = state.profiler_overlay;
+        snapshot.minimap_visible = state.minimap_visible;
+        if (state.level_prompt.has_value()){
+            snapshot.level_prompt = (state.level_prompt->operation == LevelIO::SAVE ? "Save level: " : "Load level: ") + state.level_prompt->text;
+        }
+        if (state.level_io->GetStatus() == LevelIO::RUNNING){
+            const char* action = state.level_io->GetOperation() == LevelIO::SAVE ? "Saving " : "Loading ";
+            int percent = (int)(state.level_io->GetProgress() * 100);
+            snapshot.level_status = action + state.level_io->GetFilename() + "... " + std::to_string(percent) + "%";
+        } else if (!state.level_message.empty() && state.tick - state.level_message_tick < Config::LEVEL_MESSAGE_TICKS){
+            snapshot.level_status = state.level_message;
+        }
+        snapshot.camera = GetInterpolatedCamera(state);
+        snapshot.player_sprite = GetInterpolatedPlayerSprite(state);
+        if (state.game_mode == PLAY){
+            // Cast here against the full grid, the mirror has no solidity masks
+            Vector2 mouse_world_position = GetScreenToWorld2D(state.input.mouse_position, state.camera.GetCamera2D(Config::WINDOW_SIZE));
+            snapshot.reached_tile = GetReachedTile(state.grid, state.player.GetCenterPosition(), mouse_world_position);
+        }
+
+        Rectangle bounds = snapshot.camera.GetBounds(Config::WINDOW_SIZE);
+        if (SnapshotWriter::IsLodZoom(snapshot.camera.zoom, Config::TILE_RESOLUTION, Config::LOD_TILE_PIXELS)){
+            state.snapshot_writer.CopyLodView(state.grid, state.light, state.pyramid, bounds, snapshot.camera.zoom, Config::TILE_RESOLUTION, snapshot);
+        } else {
+            state.snapshot_writer.CopyChunks(state.grid, state.light, bounds, Config::TILE_RESOLUTION, snapshot);
+        }
+        if (state.minimap_visible){
+            state.snapshot_writer.CopyMinimap(state.grid, state.pyramid, Config::MINIMAP_SIZE, snapshot);
+        } else {
+            state.snapshot_writer.ResetMinimap();
+        }
+
+        std::vector<uint32_t> visible;
+        state.broadphase.Query(state.entities, bounds, visible);
+        snapshot.entities.reserve(visible.size());
+        for (uint32_t entity : visible){
+            snapshot.entities.push_back({state.entities.GetRect(entity), state.entities.sprite[entity]});
+        }
+        PROFILE_COUNTER("entities", state.entities.Count());
+        PROFILE_COUNTER("snapshot chunks", snapshot.chunks.size());
+        return snapshot;
+
+    }
+
+    float GetInterpolationAlpha(const GameState& state){
+        return std::clamp(state.tick_accumulator / Config::TICK_DELTA, 0.f, 1.f);
+    }
+
+    CenteredCamera GetInterpolatedCamera(const GameState& state){
+        float alpha = GetInterpolationAlpha(state);
+        CenteredCamera camera = state.camera;
+        camera.center = {
+            std::lerp(state.previous_camera_center.x, state.camera.center.x, alpha),
+            std::lerp(state.previous_camera_center.y, state.camera.center.y, alpha)
+        };
+        return camera;
+    }
+
+    Sprite GetInterpolatedPlayerSprite(const GameState& state){
+        float alpha = GetInterpolationAlpha(state);
+        Sprite sprite = state.player.sprite;
+        sprite.dest_rect.x = std::lerp(state.previous_player_position.x, sprite.dest_rect.x, alpha);
+        sprite.dest_rect.y = std::lerp(state.previous_player_position.y, sprite.dest_rect.y, alpha);
+        return sprite;
+    }
+
+
+//RENDER
+    void RenderGrid(const Grid& grid, const LightMap& light, const Assets& assets, Rectangle bounds, uint16_t tile_resolution){
+        PROFILE_SCOPE("render grid");
+        assets.chunk_cache.Draw(grid, light, assets.tile_atlas, bounds, tile_resolution);
+
     }
 
-    void RenderTilePreview(uint16_t tile_type, Vector2 position, const std::vector<Texture2D>& tile_textures){
-        Texture2D texture = tile_textures.at(tile_type);
-        DrawTextureEx(texture, position, 0, 6, {255, 255, 255, 100});
+    void RenderTilePreview(uint16_t tile_type, Vector2 position, const TileAtlas& tile_atlas){
+        tile_atlas.DrawTileScaled(tile_type, position, 6, {255, 255, 255, 100});
 
     }
 
     void RenderTileGhost(
         uint16_t tile_type,
         Vector2u position,
-        const std::vector<Texture2D>& tile_textures,
+        const TileAtlas& tile_atlas,
         uint16_t tile_resolution
     )
     {
-        Texture2D texture = tile_textures.at(tile_type);
 
         Rectangle rectangle{
             (float)position.x * tile_resolution,
@@ -238,67 +785,171 @@ namespace Game {
             static_cast<float>(tile_resolution)
         };
         DrawRectangleRec(rectangle, {0, 0, 0, 130});
-        DrawTextureV(texture, {rectangle.x, rectangle.y}, {255, 255, 255, 130});
+        tile_atlas.DrawTile(tile_type, {rectangle.x, rectangle.y}, {255, 255, 255, 130});
         DrawRectangleLinesEx(rectangle, 1, {255, 255, 255, 130});
 
     }
 
-    void RenderPlayer(const Player& player, const Texture2D& texture){
-        player.sprite.Draw();
+    void RenderPlayer(const Sprite& sprite, const Texture2D& texture){
+        sprite.Draw();
         // DrawTextureV(texture, player.position, WHITE);
 
     }
 
-    void RenderExitScreen(const GameState& state, const Assets& assets){
+    void RenderEntities(
+        const std::vector<RenderSnapshot::EntitySprite>& entities,
+        const TileAtlas& tile_atlas,
+        uint16_t tile_resolution
+    ){
+        for (const RenderSnapshot::EntitySprite& entity : entities){
+            tile_atlas.DrawTileScaled(entity.sprite, {entity.rect.x, entity.rect.y}, entity.rect.width / tile_resolution, WHITE);
+        }
+
+    }
+
+    std::optional<Rectangle> GetHoveredEntityRect(const RenderSnapshot& snapshot, Vector2 world_position){
+        // Later entities are drawn over earlier ones
+        for (auto entity = snapshot.entities.rbegin(); entity != snapshot.entities.rend(); entity++){
+            if (CheckCollisionPointRec(world_position, entity->rect)){
+                return entity->rect;
+            }
+        }
+        return std::nullopt;
+
+    }
+
+    void RenderExitScreen(const Assets& assets){
         DrawRectangle(0 , 0, Config::WINDOW_WIDTH, Config::WINDOW_HEIGHT, {0, 0, 0, 130});
         DrawText("Exit game? [y/n]", 0.5 * (Config::WINDOW_WIDTH - MeasureText("Exit game? [y/n]", 32)), 32, 32, WHITE);
 
     }
 
-    void Render(const GameState& state, const Assets& assets){
+    void RenderLevelPrompt(const std::string& text){
+        std::string line = text + "_";
+        DrawRectangle(0 , 0, Config::WINDOW_WIDTH, Config::WINDOW_HEIGHT, {0, 0, 0, 130});
+        DrawText(line.c_str(), 0.5 * (Config::WINDOW_WIDTH - MeasureText(line.c_str(), 24)), 0.5 * Config::WINDOW_HEIGHT - 12, 24, WHITE);
+        const char* hint = "[enter] confirm  [esc] cancel";
+        DrawText(hint, 0.5 * (Config::WINDOW_WIDTH - MeasureText(hint, 16)), 0.5 * Config::WINDOW_HEIGHT + 20, 16, LIGHTGRAY);
+
+    }
+
+    void RenderProfilerOverlay(){
+        const std::vector<Profiler::Stat>& stats = Profiler::GetStats();
+        int line_height = 14;
+        int width = 260;
+        int x = Config::WINDOW_WIDTH - width - 8;
+        int y = 70;
+        DrawRectangle(x - 6, y - 6, width + 12, (stats.size() + 2) * line_height + 12, {0, 0, 0, 170});
+
+        char line[96];
+        std::snprintf(line, sizeof(line), "%-20s %8s %7s", "per frame", "ms", "calls");
+        DrawText(line, x, y, 10, LIGHTGRAY);
+        for (const Profiler::Stat& stat : stats){
+            y += line_height;
+            if (stat.kind == Profiler::SCOPE){
+                std::snprintf(line, sizeof(line), "%-20s %8.3f %7.1f", stat.name, stat.milliseconds, stat.calls);
+            } else {
+                std::snprintf(line, sizeof(line), "%-20s %16llu", stat.name, (unsigned long long)stat.value);
+            }
+            DrawText(line, x, y, 10, WHITE);
+        }
+        y += line_height;
+        std::snprintf(line, sizeof(line), "%s  dropped %llu", Profiler::IsCapturing() ? "capturing [F2]" : "capture [F2]", (unsigned long long)Profiler::GetDroppedEvents());
+        DrawText(line, x, y, 10, Profiler::IsCapturing() ? RED : LIGHTGRAY);
+
+    }
+
+    void RenderMinimap(const RenderSnapshot& snapshot, const LodRenderer& lod_renderer){
+        constexpr float MARGIN = 16;
+        Rectangle area = {
+            Config::WINDOW_WIDTH - Config::MINIMAP_SIZE - MARGIN,
+            Config::WINDOW_HEIGHT - Config::MINIMAP_SIZE - MARGIN,
+            Config::MINIMAP_SIZE,
+            Config::MINIMAP_SIZE
+        };
+        Rectangle bounds = snapshot.camera.GetBounds(Config::WINDOW_SIZE);
+        Rectangle player = snapshot.player_sprite.dest_rect;
+        Vector2 player_center = {player.x + player.width / 2, player.y + player.height / 2};
+        lod_renderer.DrawMinimap(area, bounds, player_center, Config::TILE_RESOLUTION);
+
+    }
+
+    void Render(const RenderSnapshot& snapshot, const GridMirror& mirror, Vector2 mouse_position, Assets& assets){
+        PROFILE_SCOPE("render");
+        const CenteredCamera& camera = snapshot.camera;
+        Rectangle bounds = camera.GetBounds(Config::WINDOW_SIZE);
+
+        // Render textures have to be drawn into before the frame starts
+        if (snapshot.lod_view.has_value()){
+            assets.lod_renderer.view.Upload(snapshot.lod_view.value(), assets.tile_atlas);
+        } else {
+            assets.chunk_cache.Update(mirror.grid, mirror.light, assets.tile_atlas, bounds, Config::TILE_RESOLUTION);
+        }
+        if (snapshot.minimap.has_value()){
+            assets.lod_renderer.minimap.Upload(snapshot.minimap.value(), assets.tile_atlas);
+        }
+
         BeginDrawing();
         ClearBackground(BLACK);
 
         //START DRAWING
-        BeginMode2D(state.camera.GetCamera2D(Config::WINDOW_SIZE));
-
-        auto mouse_grid_position = GetMouseGridPosition(state.input.mouse_position, state.camera, Config::TILE_RESOLUTION, Config::WINDOW_SIZE);
-        //TODO: FIX
-        // Vector2u clamped_position = GetClampedMouseGridPosition(mouse_grid_position, state.player.GetGridPosition(Config::TILE_RESOLUTION));
-        switch (state.game_mode){
-            case PLAY:
-            RenderPlayer(state.player , assets.player_texture);
-            RenderGrid(state.grid,  assets.tile_textures, state.camera.GetBounds(Config::WINDOW_SIZE), Config::TILE_RESOLUTION);
-            RenderTileGhost(
-                state.tile_place_type,
-                mouse_grid_position,
-                assets.tile_textures,
-                Config::TILE_RESOLUTION
-            );
-            break;
+        BeginMode2D(camera.GetCamera2D(Config::WINDOW_SIZE));
 
-            case EDITOR:
-            RenderGrid(state.grid,  assets.tile_textures, state.camera.GetBounds(Config::WINDOW_SIZE), Config::TILE_RESOLUTION);
+        auto mouse_grid_position = GetMouseGridPosition(mouse_position, camera, Config::TILE_RESOLUTION, Config::WINDOW_SIZE);
+        Vector2 mouse_world_position = GetScreenToWorld2D(mouse_position, camera.GetCamera2D(Config::WINDOW_SIZE));
+        auto hovered_entity = GetHoveredEntityRect(snapshot, mouse_world_position);
+        if (snapshot.game_mode == PLAY){
+            RenderPlayer(snapshot.player_sprite, assets.player_texture);
+        }
+        if (snapshot.lod_view.has_value()){
+            PROFILE_SCOPE("render grid");
+            assets.lod_renderer.DrawView(Config::TILE_RESOLUTION);
+        } else {
+            RenderGrid(mirror.grid, mirror.light, assets, bounds, Config::TILE_RESOLUTION);
+        }
+        RenderEntities(snapshot.entities, assets.tile_atlas, Config::TILE_RESOLUTION);
+        if (hovered_entity.has_value()){
+            DrawRectangleLinesEx(hovered_entity.value(), 0.5f, WHITE);
+        } else if (snapshot.game_mode == PLAY){
+            // Outlines the tile breaking would take
+            if (snapshot.reached_tile.has_value()){
+                const Vector2u& reached = snapshot.reached_tile.value();
+                float size = Config::TILE_RESOLUTION;
+                DrawRectangleLinesEx({reached.x * size, reached.y * size, size, size}, 0.5f, WHITE);
+            }
+        } else {
             RenderTileGhost(
-                state.tile_place_type,
-                GetMouseGridPosition(state.input.mouse_position, state.camera, Config::TILE_RESOLUTION, Config::WINDOW_SIZE),
-                assets.tile_textures,
+                snapshot.tile_place_type,
+                mouse_grid_position,
+                assets.tile_atlas,
                 Config::TILE_RESOLUTION
             );
-            break;
         }
 
         EndMode2D();
 
         //Draw UI
-        if (state.game_mode == EDITOR){
-            RenderTilePreview(state.tile_place_type, {Config::WINDOW_WIDTH - 80, 30}, assets.tile_textures);
+        if (snapshot.game_mode == EDITOR){
+            RenderTilePreview(snapshot.tile_place_type, {Config::WINDOW_WIDTH - 80, 30}, assets.tile_atlas);
         }
         DrawText("CaveSlave", 32, 32, 32, WHITE);
         DrawFPS(60, 60);
+        if (snapshot.minimap_visible){
+            RenderMinimap(snapshot, assets.lod_renderer);
+        }
+        if (snapshot.profiler_overlay){
+            RenderProfilerOverlay();
+        }
 
-        if (state.exit_requested){
-            RenderExitScreen(state, assets);
+        if (!snapshot.level_status.empty()){
+            DrawText(snapshot.level_status.c_str(), 32, Config::WINDOW_HEIGHT - 40, 16, WHITE);
+        }
+
+        if (!snapshot.level_prompt.empty()){
+            RenderLevelPrompt(snapshot.level_prompt);
+        }
+        if (snapshot.exit_requested){
+            RenderExitScreen(assets);
         }
 
         EndDrawing();
@@ -311,16 +962,52 @@ void Run(){
     auto assets = InitAssets();
     GameState state{};
     state.player = Player::New(assets.player_texture) ;
+    PROFILE_THREAD("main");
     if (IsWindowReady()){
+        // The simulation of a frame's ticks overlaps drawing the snapshot from the frame before
+        auto simulation = WorkerThread::New();
+        GridMirror mirror;
+        RenderSnapshot snapshot = CaptureSnapshot(state);
+        RenderSnapshot next_snapshot;
         while (true){
-            Update(state);
-            Render(state, assets);
+            uint16_t ticks = BeginFrame(state);
             if (state.exiting){
                 break;
             }
+            simulation->Start([&state, &next_snapshot, ticks]{
+                PROFILE_THREAD("simulation");
+                RunTicks(state, ticks);
+                next_snapshot = CaptureSnapshot(state);
+            });
+
+            mirror.Apply(snapshot);
+            Render(snapshot, mirror, GetMousePosition(), assets);
+
+            {
+                PROFILE_SCOPE("wait for simulation");
+                simulation->Wait();
+            }
+            snapshot = std::move(next_snapshot);
+            Profiler::Collect();
         }
     }
 
+    if (state.pager != nullptr){
+        state.pager->Flush(state.grid);
+    }
+    // A save still being copied finishes at once, the destructor waits for it to be written
+    state.level_io->Update(state.grid, UINT32_MAX);
+    if (state.autosave != nullptr && state.level_io->GetStatus() == LevelIO::IDLE){
+        // Unsaved edits go to the recovery file, the destructor waits for it
+        state.autosave->Update(state.grid, UINT32_MAX);
+        state.autosave->Wait();
+        state.autosave->Save(state.grid, UINT32_MAX);
+    }
+    StopRecording(state, "latest");
+
+    assets.chunk_cache.Unload();
+    assets.lod_renderer.Unload();
+    assets.tile_atlas.Unload();
     CloseWindow();
 
 }
@@ -1,11 +1,28 @@
 #pragma once
 
 #include "model.h"
+#include "autosave.h"
 #include "grid.h"
 #include "camera.h"
 #include "player.h"
+#include "entities.h"
+#include "generator.h"
+#include "journal.h"
+#include "broadphase.h"
+#include "jobs.h"
+#include "snapshot.h"
+#include "lighting.h"
+#include "tile_pyramid.h"
+#include "level_io.h"
+#include "pager.h"
+#include "profiler.h"
+#include "raycast.h"
+#include "replay.h"
 
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <optional>
 #include <raylib.h>
 #include <stdint.h>
 #include <string>
@@ -20,27 +37,100 @@ struct Config {
 
     static constexpr uint16_t TARGET_FRAMERATE = 0;
 
+    // Simulation runs in fixed ticks independent of the framerate
+    static constexpr uint16_t TICK_RATE = 120;
+    static constexpr float TICK_DELTA = 1.f / TICK_RATE;
+    static constexpr uint16_t MAX_TICKS_PER_FRAME = 8;
+
     static constexpr uint16_t TILE_RESOLUTION = 8;
-    static constexpr uint16_t TILE_COUNT = 8;
+    static constexpr uint16_t TILE_COUNT = 10; // Includes TORCH_TILE
 
     static constexpr uint16_t GRID_WIDTH = 64;
     static constexpr uint16_t GRID_HEIGHT = 64;
     static constexpr Vector2u GRID_SIZE = {GRID_WIDTH, GRID_HEIGHT};
 
+    static constexpr float PLAYER_REACH = 4; // Tiles from the player's center that play mode can break
+
+    static constexpr uint32_t MAX_BRUSH_RADIUS = 16;
+    static constexpr size_t FLOOD_FILL_LIMIT = 1 << 20; // Tiles per editor flood fill
+    static constexpr size_t UNDO_MEMORY_BUDGET = 16 * 1024 * 1024;
+
     static constexpr float GRAVITY = 800;
+    static constexpr float MAX_FALL_SPEED = 600;
+    static constexpr float ENTITY_FRICTION = 0.1f;
+    static constexpr size_t MAX_ENTITIES = 1 << 16;
+    static constexpr float DROP_SIZE = 4;
+    static constexpr uint32_t ENTITY_BATCH_SIZE = 1024; // Entities per physics job
+
+    // Size of worlds made by the cave generator
+    static constexpr uint32_t GENERATED_WIDTH = 2048;
+    static constexpr uint32_t GENERATED_HEIGHT = 1024;
+
+    static constexpr size_t PAGER_MEMORY_BUDGET = 64 * 1024 * 1024;
+    static constexpr uint32_t LIGHT_CHUNKS_PER_TICK = 32; // Lights a loaded 4096 x 4096 world in about a second
+    static constexpr uint32_t PYRAMID_CHUNKS_PER_TICK = 32;
+
+    static constexpr uint64_t AUTOSAVE_INTERVAL_TICKS = 30 * TICK_RATE;
+    static constexpr uint32_t SAVE_COPY_CHUNKS_PER_TICK = 128; // About a megabyte per tick, a save writes once its copy is complete
+    static constexpr const char* AUTOSAVE_FILENAME = "untitled"; // Level name recovery files of never saved levels go under
+
+    static constexpr size_t MAX_LEVEL_NAME_LENGTH = 64;
+    static constexpr uint64_t LEVEL_MESSAGE_TICKS = 3 * TICK_RATE; // How long a save or load result stays on screen
+
+    static constexpr const char* TRACE_PATH = "profiles/latest.json"; // Written when a capture (F2) ends
+
+    // Below this many screen pixels per tile the world is drawn from the tile pyramid
+    static constexpr float LOD_TILE_PIXELS = 2;
+    static constexpr uint32_t MINIMAP_SIZE = 192; // Pixels, and the most cells the minimap level has across
+
+    static constexpr size_t CHUNK_CACHE_SIZE = 256;
+    static constexpr uint32_t CHUNK_CACHE_REDRAWS_PER_FRAME = 8;
+};
+
+// Level name typed into the window after F5 (load) or F6 (save)
+struct LevelPrompt {
+    LevelIO::Operation operation;
+    std::string text;
+    bool submitted = false; // Enter was pressed, the next tick starts the operation
 };
 
 struct GameState{
     GameMode game_mode = GameMode::EDITOR;
-    float delta_time;
-    Input input;
+    float delta_time = 0; // Frame time, ticks always advance by Config::TICK_DELTA
+    float tick_accumulator = 0;
+    uint64_t tick = 0;
+    Input input = {};         // Input seen by the current tick
+    Input pending_input = {}; // Input captured since the last tick
+    Vector2 previous_player_position = {0, 0};
+    Vector2 previous_camera_center = {0, 0};
     bool exit_requested = false;
     bool exiting = false;
+    bool profiler_overlay = false; // F3
+    bool minimap_visible = true; // M
     Grid grid = Grid::NewDefault(Config::GRID_WIDTH, Config::GRID_HEIGHT);
+    LightMap light = {}; // Follows grid, rebuilt by the first TickWorld after a new grid is loaded
+    TilePyramid pyramid = {}; // Follows grid like light
+    std::unique_ptr<WorldPager> pager = nullptr; // Set when the level is streamed instead of fully loaded
+    std::unique_ptr<LevelIO> level_io = LevelIO::New();
+    std::optional<LevelPrompt> level_prompt = {};
+    std::string level_message = {};
+    uint64_t level_message_tick = 0;
+    std::unique_ptr<Autosave> autosave = Autosave::New(); // Null turns autosaving off
+    uint64_t autosave_tick = 0;
     uint16_t tile_place_type = 1;
+    uint32_t brush_radius = 0; // Editor brush, 0 paints single tiles
+    EditJournal journal = EditJournal::New(Config::UNDO_MEMORY_BUDGET);
     Player player = Player::New({0, 0});
-    Sprite player_sprite;
-    CenteredCamera camera;
+    Sprite player_sprite = {};
+    EntityStore entities = {};
+    Broadphase broadphase = {}; // Rebuilt at the end of every entities tick
+    std::unique_ptr<JobSystem> jobs = JobSystem::New();
+    SnapshotWriter snapshot_writer = {};
+    CenteredCamera camera = {};
+    uint64_t seed = 0;
+    std::optional<Replay> recording = {};
+    std::optional<Replay> playback = {};
+    size_t playback_tick = 0;
 
 };
 
@@ -52,7 +142,9 @@ Vector2u GetMouseGridPosition(
     Vector2u window_size
 );
 
-std::vector<Texture2D> GetTileTextures(const Image &spritesheet, uint16_t tile_resolution, uint16_t tile_type_count);
+// First solid tile on the line from the player's center towards target (world positions), within
+// Config::PLAYER_REACH. Walls in between are what gets hit, so tiles can not be broken through them.
+std::optional<Vector2u> GetReachedTile(const Grid& grid, Vector2 player_center, Vector2 target);
 
 void Init(
     std::string name,
@@ -65,26 +157,129 @@ Assets InitAssets(
     uint16_t tile_type_count = Config::TILE_COUNT
 );
 
+// Single tile edits go through here so derived data such as lighting stays in step. Returns
+// false if the tile already had that type.
+bool PlaceTile(GameState& state, uint32_t x, uint32_t y, uint16_t type);
+
+// Bulk Grid edits report the region they changed here, once per operation
+void OnTilesChanged(GameState& state, TileRegion changed);
+
 void UpdateTilePlacing(GameState& state);
 
-void UpdateLevel(const Input& input, Grid& grid);
+// Opens an undo step while a mouse button is held in the editor and handles ctrl+z / ctrl+y
+void UpdateEditHistory(GameState& state);
+
+// The entity under the mouse, if any
+std::optional<uint32_t> GetMouseEntity(const GameState& state, Vector2 mouse_position, const CenteredCamera& camera);
+
+// Drops a small falling copy of a broken tile
+void SpawnDrop(GameState& state, Vector2u grid_position, uint16_t tile_type);
+
+// Replaces the level with a generated cave and drops the player on the surface in the middle
+void GenerateLevel(GameState& state, uint64_t seed, uint32_t width, uint32_t height);
+
+bool IsTileEditable(const GameState& state, Vector2u grid_position);
+
+bool IsPlayerAreaLoaded(const GameState& state);
+
+// Opens the level prompt on F5 / F6, starts the submitted operation and installs finished loads
+void UpdateLevel(GameState& state);
+
+// Collects a finished background save or load
+void FinishLevelIO(GameState& state);
+
+// Writes the chunks changed since the last save every AUTOSAVE_INTERVAL_TICKS
+void UpdateAutosave(GameState& state);
+
+// Feeds typed characters into the prompt, returns false if it was cancelled. Main thread only.
+bool UpdateLevelPrompt(LevelPrompt& prompt);
 
-void Update(GameState& state);
+// Snapshots the state the next tick starts from, later ticks append their input
+bool StartRecording(GameState& state);
 
-void RenderGrid(const GameState& state, const Assets& assets, Rectangle bounds, uint16_t tile_resolution);
+void StopRecording(GameState& state, std::string filename);
 
-void RenderTilePreview(uint16_t tile_type, Vector2 position, std::vector<Texture2D>& tile_textures);
+// Restores the replay's starting state, later ticks take their input from it
+bool StartPlayback(GameState& state, Replay replay);
+
+// Handles the record (F7) and playback (F8) keys and swaps in recorded input during playback
+void UpdateReplay(GameState& state);
+
+void TickInput(GameState& state);
+
+void TickEditing(GameState& state);
+
+void TickPlayer(GameState& state);
+
+void TickEntities(GameState& state);
+
+void TickWorld(GameState& state);
+
+struct TickPhase {
+    const char* name;
+    void (*run)(GameState& state);
+};
+
+// A tick runs these in order, kept as a table so the headless runner can time each one
+inline constexpr std::array<TickPhase, 5> TICK_PHASES = {{
+    {"input", TickInput},
+    {"editing", TickEditing},
+    {"player", TickPlayer},
+    {"entities", TickEntities},
+    {"world", TickWorld}
+}};
+
+// Advances the simulation by one fixed step, does not touch the window. Ends with a barrier on
+// the job system, no job outlives its tick.
+void Tick(GameState& state);
+
+// Main thread part of a frame: captures window input, handles the profiler keys (F2 capture, F3
+// overlay) and the minimap key (M), and returns how many ticks the elapsed frame time allows. Must not run while the
+// simulation thread is ticking.
+uint16_t BeginFrame(GameState& state);
+
+void RunTicks(GameState& state, uint16_t ticks);
+
+// Copies what Render needs, called between batches of ticks
+RenderSnapshot CaptureSnapshot(GameState& state);
+
+// Blend between the previous and current tick for drawing
+float GetInterpolationAlpha(const GameState& state);
+
+CenteredCamera GetInterpolatedCamera(const GameState& state);
+
+Sprite GetInterpolatedPlayerSprite(const GameState& state);
+
+void RenderGrid(const Grid& grid, const LightMap& light, const Assets& assets, Rectangle bounds, uint16_t tile_resolution);
+
+void RenderTilePreview(uint16_t tile_type, Vector2 position, const TileAtlas& tile_atlas);
 
 void RenderTileGhost(
     uint16_t tile_type,
-    Vector2 position,
-    const std::vector<Texture2D>& tile_textures,
+    Vector2u position,
+    const TileAtlas& tile_atlas,
     const uint16_t tile_resolution
 );
 
-void RenderPlayer(const Player& player, const Texture2D& texture);
+void RenderPlayer(const Sprite& sprite, const Texture2D& texture);
+
+void RenderEntities(
+    const std::vector<RenderSnapshot::EntitySprite>& entities,
+    const TileAtlas& tile_atlas,
+    uint16_t tile_resolution
+);
+
+// The level filename being typed, centered over a dimmed window
+void RenderLevelPrompt(const std::string& text);
+
+// Per-phase milliseconds from the profiler, drawn on the main thread
+void RenderProfilerOverlay();
+
+// The whole world in a corner of the window, drawn from the last minimap a snapshot carried
+void RenderMinimap(const RenderSnapshot& snapshot, const LodRenderer& lod_renderer);
 
-void Render(const GameState& state, const Assets& assets);
+// Draws a snapshot over the render side grid mirror, never touches the GameState
+void Render(const RenderSnapshot& snapshot, const GridMirror& mirror, Vector2 mouse_position, Assets& assets);
 
 void Run();
 
@@ -0,0 +1,440 @@
+#include "generator.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    constexpr uint16_t STONE = 1;
+    constexpr uint16_t DARK_STONE = 2;
+    constexpr uint16_t BLUE_ORE = 3;
+    constexpr uint16_t DIRT = 4;
+    constexpr uint16_t GREEN_ORE = 5;
+    constexpr uint16_t BEDROCK = 6;
+    constexpr uint16_t COAL = 7;
+
+    constexpr int64_t DIRT_DEPTH = 6;
+    constexpr int32_t SIZE = Grid::CHUNK_SIZE;
+
+    // Salts keep the hashes of different features independent
+    enum Salt : uint64_t {
+        SALT_FILL = 1,
+        SALT_DENSITY,
+        SALT_SURFACE,
+        SALT_STONE,
+        SALT_ORE,
+        SALT_TORCH,
+        SALT_HUB_X,
+        SALT_HUB_Y,
+        SALT_PORTAL_X,
+        SALT_PORTAL_Y,
+        SALT_TUNNEL
+    };
+
+    inline uint64_t Mix(uint64_t value){
+        // splitmix64 finalizer
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    // Hashes of one feature share a key, so the per-position hash is a single mix
+    inline uint64_t Key(uint64_t seed, uint64_t salt){
+        return Mix(seed ^ (salt << 56));
+    }
+
+    inline uint64_t Hash(uint64_t key, int64_t x, int64_t y){
+        return Mix(key ^ ((uint64_t)x * 0x9E3779B97F4A7C15ull) ^ ((uint64_t)y * 0xC2B2AE3D27D4EB4Full));
+    }
+
+    inline uint64_t Hash(uint64_t seed, uint64_t salt, int64_t x, int64_t y){
+        return Hash(Key(seed, salt), x, y);
+    }
+
+    inline float HashToUnit(uint64_t hash){
+        return (hash >> 40) * (1.f / (1 << 24));
+    }
+
+    constexpr int32_t OCTAVES = 3;
+
+    inline float Smooth(float fraction){
+        return fraction * fraction * (3 - 2 * fraction);
+    }
+
+    inline int64_t FloorDiv(int64_t value, int64_t divisor){
+        return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+    }
+
+    // Value noise in [0, 1): OCTAVES layers of smoothly interpolated lattice hashes, each with
+    // half the spacing and weight of the one before. scale must stay a whole number for every octave.
+    float FractalNoise(uint64_t seed, uint64_t salt, int64_t x, int64_t y, int32_t scale){
+        float total = 0;
+        float amplitude = 0.5f;
+        float weight = 0;
+        for (int32_t octave = 0; octave < OCTAVES; octave++){
+            uint64_t key = Key(seed, salt * 8 + octave);
+            int64_t cell_x = FloorDiv(x, scale);
+            int64_t cell_y = FloorDiv(y, scale);
+            float fraction_x = Smooth((float)(x - cell_x * scale) / scale);
+            float fraction_y = Smooth((float)(y - cell_y * scale) / scale);
+            float top_left = HashToUnit(Hash(key, cell_x, cell_y));
+            float top_right = HashToUnit(Hash(key, cell_x + 1, cell_y));
+            float bottom_left = HashToUnit(Hash(key, cell_x, cell_y + 1));
+            float bottom_right = HashToUnit(Hash(key, cell_x + 1, cell_y + 1));
+            float top = top_left + (top_right - top_left) * fraction_x;
+            float bottom = bottom_left + (bottom_right - bottom_left) * fraction_x;
+
+            total += (top + (bottom - top) * fraction_y) * amplitude;
+            weight += amplitude;
+            amplitude *= 0.5f;
+            scale /= 2;
+        }
+        return total / weight;
+    }
+
+    // FractalNoise over a whole rectangle. Each octave hashes its lattice once and interpolates
+    // every tile from it, the values match FractalNoise exactly.
+    void SampleNoise(
+        uint64_t seed,
+        uint64_t salt,
+        int32_t scale,
+        int64_t origin_x,
+        int64_t origin_y,
+        int32_t width,
+        int32_t height,
+        std::vector<float>& out
+    ){
+        out.assign(width * height, 0);
+        std::vector<float> lattice;
+        std::vector<int32_t> cells_x(width);
+        std::vector<float> fractions_x(width);
+        float amplitude = 0.5f;
+        float weight = 0;
+        for (int32_t octave = 0; octave < OCTAVES; octave++){
+            uint64_t key = Key(seed, salt * 8 + octave);
+            int64_t lattice_x = FloorDiv(origin_x, scale);
+            int64_t lattice_y = FloorDiv(origin_y, scale);
+            int32_t lattice_width = FloorDiv(origin_x + width - 1, scale) - lattice_x + 2;
+            int32_t lattice_height = FloorDiv(origin_y + height - 1, scale) - lattice_y + 2;
+            lattice.resize(lattice_width * lattice_height);
+            for (int32_t y = 0; y < lattice_height; y++){
+                for (int32_t x = 0; x < lattice_width; x++){
+                    lattice[y * lattice_width + x] = HashToUnit(Hash(key, lattice_x + x, lattice_y + y));
+                }
+            }
+
+            for (int32_t x = 0; x < width; x++){
+                int64_t cell_x = FloorDiv(origin_x + x, scale);
+                cells_x[x] = cell_x - lattice_x;
+                fractions_x[x] = Smooth((float)(origin_x + x - cell_x * scale) / scale);
+            }
+            for (int32_t y = 0; y < height; y++){
+                int64_t cell_y = FloorDiv(origin_y + y, scale);
+                float fraction_y = Smooth((float)(origin_y + y - cell_y * scale) / scale);
+                const float* upper = &lattice[(cell_y - lattice_y) * lattice_width];
+                const float* lower = upper + lattice_width;
+                float* row = &out[y * width];
+                for (int32_t x = 0; x < width; x++){
+                    int32_t cell = cells_x[x];
+                    float top = upper[cell] + (upper[cell + 1] - upper[cell]) * fractions_x[x];
+                    float bottom = lower[cell] + (lower[cell + 1] - lower[cell]) * fractions_x[x];
+                    row[x] += (top + (bottom - top) * fraction_y) * amplitude;
+                }
+            }
+            weight += amplitude;
+            amplitude *= 0.5f;
+            scale /= 2;
+        }
+        for (float& value : out){
+            value /= weight;
+        }
+
+    }
+
+    // Deterministic stream for the carving decisions of one chunk
+    struct ChunkRandom {
+        uint64_t state;
+
+        uint32_t Next(uint32_t bound){
+            state = Mix(state);
+            return (uint32_t)((state >> 32) % bound);
+        }
+    };
+
+    struct Point {
+        int32_t x;
+        int32_t y;
+    };
+
+    // Opens a plus-shaped brush around every step of a wiggly path from start to end
+    void CarvePath(std::vector<uint8_t>& walls, Point start, Point end, ChunkRandom& random){
+        auto carve = [&](int32_t x, int32_t y){
+            const Point brush[] = {{0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+            for (Point offset : brush){
+                int32_t brush_x = x + offset.x;
+                int32_t brush_y = y + offset.y;
+                if (0 <= brush_x && brush_x < SIZE && 0 <= brush_y && brush_y < SIZE){
+                    walls[brush_y * SIZE + brush_x] = 0;
+                }
+            }
+        };
+
+        Point at = start;
+        carve(at.x, at.y);
+        while (at.x != end.x || at.y != end.y){
+            uint32_t remaining_x = std::abs(end.x - at.x);
+            uint32_t remaining_y = std::abs(end.y - at.y);
+            // Step along an axis with odds proportional to the distance left on it
+            if (random.Next(remaining_x + remaining_y) < remaining_x){
+                at.x += end.x > at.x ? 1 : -1;
+            } else {
+                at.y += end.y > at.y ? 1 : -1;
+            }
+            carve(at.x, at.y);
+        }
+
+    }
+
+} // namespace
+
+CaveGenerator CaveGenerator::New(uint64_t seed, GeneratorConfig config){
+    return {seed, config};
+
+}
+
+uint32_t CaveGenerator::GetSurfaceHeight(uint32_t x) const {
+    float noise = FractalNoise(seed, SALT_SURFACE, x, 0, 96);
+    return config.surface_height + (noise - 0.5f) * 2 * config.surface_variation;
+
+}
+
+void CaveGenerator::GenerateChunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t world_width, uint32_t world_height, Tile* tiles) const {
+    int32_t margin = config.smoothing_steps;
+    int32_t padded = SIZE + 2 * margin;
+    int64_t origin_x = (int64_t)chunk_x * SIZE;
+    int64_t origin_y = (int64_t)chunk_y * SIZE;
+
+    std::vector<int64_t> surface(padded);
+    for (int32_t i = 0; i < padded; i++){
+        int64_t x = origin_x + i - margin;
+        surface[i] = x < 0 ? 0 : GetSurfaceHeight(x);
+    }
+
+    // Initial noise over the chunk and its margin, outside the world counts as solid
+    std::vector<float> density;
+    SampleNoise(seed, SALT_DENSITY, 48, origin_x - margin, origin_y - margin, padded, padded, density);
+    uint64_t fill_key = Key(seed, SALT_FILL);
+    std::vector<uint8_t> cells(padded * padded);
+    for (int32_t y = 0; y < padded; y++){
+        int64_t world_y = origin_y + y - margin;
+        for (int32_t x = 0; x < padded; x++){
+            int64_t world_x = origin_x + x - margin;
+            uint8_t& cell = cells[y * padded + x];
+            if (world_x < 0 || world_y < 0 || world_x >= world_width || world_y >= world_height){
+                cell = world_y >= 0;
+            } else if (world_y < surface[x]){
+                cell = 0;
+            } else {
+                float fill = config.fill + (density[y * padded + x] - 0.5f) * 2 * config.density_variation;
+                cell = HashToUnit(Hash(fill_key, world_x, world_y)) < fill;
+            }
+        }
+    }
+
+    // Each pass leaves one more ring of the margin stale, the chunk itself is exact after all of them
+    // A tile becomes solid when most of its 3x3 neighbourhood is, counted as column sums first
+    std::vector<uint8_t> next(cells.size());
+    std::vector<uint8_t> column_sums(padded);
+    for (uint32_t step = 0; step < config.smoothing_steps; step++){
+        for (int32_t y = 1; y < padded - 1; y++){
+            const uint8_t* above = &cells[(y - 1) * padded];
+            const uint8_t* row = &cells[y * padded];
+            const uint8_t* below = &cells[(y + 1) * padded];
+            for (int32_t x = 0; x < padded; x++){
+                column_sums[x] = above[x] + row[x] + below[x];
+            }
+            uint8_t* out = &next[y * padded];
+            for (int32_t x = 1; x < padded - 1; x++){
+                out[x] = column_sums[x - 1] + column_sums[x] + column_sums[x + 1] >= 5;
+            }
+        }
+        std::swap(cells, next);
+    }
+
+    std::vector<uint8_t> walls(SIZE * SIZE);
+    for (int32_t y = 0; y < SIZE; y++){
+        for (int32_t x = 0; x < SIZE; x++){
+            bool above_surface = origin_y + y < surface[x + margin];
+            walls[y * SIZE + x] = !above_surface && cells[(y + margin) * padded + x + margin];
+        }
+    }
+
+    // Tunnels from the hub to a portal on every edge shared with another chunk
+    ChunkRandom random{Hash(seed, SALT_TUNNEL, chunk_x, chunk_y)};
+    Point hub = {
+        (int32_t)(SIZE / 4 + Hash(seed, SALT_HUB_X, chunk_x, chunk_y) % (SIZE / 2)),
+        (int32_t)(SIZE / 4 + Hash(seed, SALT_HUB_Y, chunk_x, chunk_y) % (SIZE / 2))
+    };
+    uint32_t chunks_x = (world_width + Grid::CHUNK_MASK) >> Grid::CHUNK_SHIFT;
+    uint32_t chunks_y = (world_height + Grid::CHUNK_MASK) >> Grid::CHUNK_SHIFT;
+    auto portal_offset = [&](Salt salt, uint32_t edge_x, uint32_t edge_y){
+        return (int32_t)(2 + Hash(seed, salt, edge_x, edge_y) % (SIZE - 4));
+    };
+    // Vertical edges are named by the chunk to their right, horizontal ones by the chunk below
+    if (chunk_x > 0){
+        CarvePath(walls, hub, {0, portal_offset(SALT_PORTAL_X, chunk_x, chunk_y)}, random);
+    }
+    if (chunk_x + 1 < chunks_x){
+        CarvePath(walls, hub, {SIZE - 1, portal_offset(SALT_PORTAL_X, chunk_x + 1, chunk_y)}, random);
+    }
+    if (chunk_y > 0){
+        CarvePath(walls, hub, {portal_offset(SALT_PORTAL_Y, chunk_x, chunk_y), 0}, random);
+    }
+    if (chunk_y + 1 < chunks_y){
+        CarvePath(walls, hub, {portal_offset(SALT_PORTAL_Y, chunk_x, chunk_y + 1), SIZE - 1}, random);
+    }
+
+    // Every region is labelled before anything is carved, so tunnels never get filled back in
+    std::vector<int32_t> regions(SIZE * SIZE, -1);
+    std::vector<int32_t> queue;
+    std::vector<Point> unconnected;
+    int32_t region_count = 0;
+    for (int32_t start = 0; start < SIZE * SIZE; start++){
+        if (walls[start] || regions[start] != -1){
+            continue;
+        }
+        int32_t region = region_count++;
+        queue.assign(1, start);
+        regions[start] = region;
+        for (size_t i = 0; i < queue.size(); i++){
+            int32_t x = queue[i] % SIZE;
+            int32_t y = queue[i] / SIZE;
+            const Point neighbours[] = {{x + 1, y}, {x - 1, y}, {x, y + 1}, {x, y - 1}};
+            for (Point neighbour : neighbours){
+                int32_t index = neighbour.y * SIZE + neighbour.x;
+                if (0 <= neighbour.x && neighbour.x < SIZE && 0 <= neighbour.y && neighbour.y < SIZE
+                    && !walls[index] && regions[index] == -1){
+                    regions[index] = region;
+                    queue.push_back(index);
+                }
+            }
+        }
+
+        if (regions[hub.y * SIZE + hub.x] == region){
+            continue;
+        }
+        // Tiny pockets are filled in instead of getting a tunnel each
+        if (queue.size() < config.min_region_size){
+            for (int32_t index : queue){
+                walls[index] = 1;
+            }
+        } else {
+            unconnected.push_back({start % SIZE, start / SIZE});
+        }
+    }
+    for (Point start : unconnected){
+        CarvePath(walls, start, hub, random);
+    }
+
+    // Tile types: dirt under the surface, stone with darker patches, ore veins and bedrock walls
+    std::vector<float> stone;
+    std::vector<float> veins;
+    SampleNoise(seed, SALT_STONE, 24, origin_x, origin_y, SIZE, SIZE, stone);
+    SampleNoise(seed, SALT_ORE, 8, origin_x, origin_y, SIZE, SIZE, veins);
+    // Each 16 tile block picks one ore kind, rarer kinds need stronger veins and more depth
+    constexpr int32_t ORE_BLOCK = 16;
+    uint32_t ore_kinds[SIZE / ORE_BLOCK][SIZE / ORE_BLOCK];
+    for (int32_t y = 0; y < SIZE / ORE_BLOCK; y++){
+        for (int32_t x = 0; x < SIZE / ORE_BLOCK; x++){
+            ore_kinds[y][x] = Hash(seed, SALT_ORE, origin_x / ORE_BLOCK + x, origin_y / ORE_BLOCK + y) % 3;
+        }
+    }
+    uint64_t torch_key = Key(seed, SALT_TORCH);
+    for (int32_t y = 0; y < SIZE; y++){
+        int64_t world_y = origin_y + y;
+        for (int32_t x = 0; x < SIZE; x++){
+            int64_t world_x = origin_x + x;
+            Tile& tile = tiles[y * SIZE + x];
+            if (world_x >= world_width || world_y >= world_height){
+                tile.type = 0;
+                continue;
+            }
+            if (world_x == 0 || world_x == world_width - 1 || world_y == world_height - 1){
+                tile.type = BEDROCK;
+                continue;
+            }
+            int64_t depth = world_y - surface[x + margin];
+            if (!walls[y * SIZE + x]){
+                bool on_floor = y + 1 < SIZE && walls[(y + 1) * SIZE + x];
+                bool has_torch = on_floor && depth > DIRT_DEPTH
+                    && HashToUnit(Hash(torch_key, world_x, world_y)) < config.torch_chance;
+                tile.type = has_torch ? TORCH_TILE : 0;
+                continue;
+            }
+
+            if (depth < DIRT_DEPTH){
+                tile.type = DIRT;
+                continue;
+            }
+            float vein = veins[y * SIZE + x];
+            uint32_t kind = ore_kinds[y / ORE_BLOCK][x / ORE_BLOCK];
+            if (kind == 0 && vein > 0.72f){
+                tile.type = COAL;
+            } else if (kind == 1 && vein > 0.75f && depth > 64){
+                tile.type = BLUE_ORE;
+            } else if (kind == 2 && vein > 0.78f && depth > 160){
+                tile.type = GREEN_ORE;
+            } else {
+                tile.type = stone[y * SIZE + x] > 0.6f ? DARK_STONE : STONE;
+            }
+        }
+    }
+
+}
+
+void CaveGenerator::GenerateChunks(Grid& grid, const std::vector<uint32_t>& chunks, JobSystem& jobs) const {
+    PROFILE_SCOPE("generate chunks");
+    // Allocating may grow the pool, so pointers are only taken once every slot exists
+    for (uint32_t chunk : chunks){
+        grid.GetChunkTilesMutable(chunk % grid.chunks_x, chunk / grid.chunks_x);
+    }
+    std::vector<Tile*> destinations(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++){
+        destinations[i] = grid.GetChunkTilesMutable(chunks[i] % grid.chunks_x, chunks[i] / grid.chunks_x);
+    }
+
+    // Jobs only write their own chunk's tiles and mask
+    jobs.ParallelFor(chunks.size(), 4, [&](uint32_t start, uint32_t end){
+        for (uint32_t i = start; i < end; i++){
+            uint32_t chunk_x = chunks[i] % grid.chunks_x;
+            uint32_t chunk_y = chunks[i] / grid.chunks_x;
+            GenerateChunk(chunk_x, chunk_y, grid.size_x, grid.size_y, destinations[i]);
+            grid.RebuildSolidMask(chunk_x, chunk_y);
+        }
+    });
+
+    for (uint32_t chunk : chunks){
+        uint32_t chunk_x = chunk % grid.chunks_x;
+        uint32_t chunk_y = chunk / grid.chunks_x;
+        const Tile* tiles = grid.GetChunkTiles(chunk_x, chunk_y);
+        // Open sky does not need a slot
+        if (std::all_of(tiles, tiles + Grid::CHUNK_AREA, [](Tile tile){ return tile.type == 0; })){
+            grid.ReleaseChunk(chunk_x, chunk_y);
+        }
+        grid.MarkChunkChanged(chunk);
+    }
+
+}
+
+Grid CaveGenerator::Generate(uint32_t width, uint32_t height, JobSystem& jobs) const {
+    Grid grid(width, height);
+    std::vector<uint32_t> chunks(grid.chunks_x * grid.chunks_y);
+    for (uint32_t chunk = 0; chunk < chunks.size(); chunk++){
+        chunks[chunk] = chunk;
+    }
+    GenerateChunks(grid, chunks, jobs);
+    return grid;
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "grid.h"
+#include "jobs.h"
+
+#include <cstdint>
+#include <vector>
+
+struct GeneratorConfig {
+    float fill = 0.53f;               // Chance a tile starts solid
+    float density_variation = 0.2f;   // How far large scale noise moves the fill chance
+    uint32_t smoothing_steps = 4;     // Cellular automaton passes
+    uint32_t surface_height = 40;     // Average number of open rows above the ground
+    uint32_t surface_variation = 12;
+    uint32_t min_region_size = 16;    // Smaller pockets are filled in instead of connected
+    float torch_chance = 0.004f;      // Per cave floor tile
+};
+
+// Seeded cave worlds: noise decides where caves start, a cellular automaton smooths them and
+// tunnels tie every open region together. Every tile is a pure function of the seed and its
+// world position, and a chunk only reads noise from a margin around itself, so any chunk can be
+// generated alone, in any order, on any thread, and always comes out the same.
+//
+// Connectivity: every chunk carves tunnels from a hub to one portal on each of its edges. A
+// portal's position is hashed from the seed and the edge, so the chunks on both sides agree on
+// it. Each open region of a chunk is then tunnelled to the hub, so the whole world is one cave.
+struct CaveGenerator {
+    uint64_t seed;
+    GeneratorConfig config;
+
+    static CaveGenerator New(uint64_t seed, GeneratorConfig config = {});
+
+    // Fills CHUNK_AREA tiles in row-major order
+    void GenerateChunk(uint32_t chunk_x, uint32_t chunk_y, uint32_t world_width, uint32_t world_height, Tile* tiles) const;
+
+    // Regenerates the given chunk indices of the grid in parallel
+    void GenerateChunks(Grid& grid, const std::vector<uint32_t>& chunks, JobSystem& jobs) const;
+
+    Grid Generate(uint32_t width, uint32_t height, JobSystem& jobs) const;
+
+    // First row below the open sky in this column
+    uint32_t GetSurfaceHeight(uint32_t x) const;
+};
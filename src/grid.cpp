@@ -1,48 +1,490 @@
 #include "grid.h"
+#include "level_format.h"
+#include "level_json.h"
+#include "mapped_file.h"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <nlohmann/json.hpp>
 #include <vector>
 
+namespace {
+    std::atomic<uint64_t> next_grid_id = 1;
+
+    // Chunks between progress updates, minus one
+    constexpr uint32_t PROGRESS_INTERVAL = 63;
+
+    // Bits first..last inclusive, both in [0, 63]
+    inline uint64_t BitRange(uint32_t first, uint32_t last){
+        return (~0ull >> (63 - last)) & (~0ull << first);
+    }
+
+    // Shared by the row and column scans, word_at(i) returns the mask word covering tile i
+    template <typename WordAt>
+    std::optional<int64_t> FindSetBit(int64_t from, int64_t to, int64_t size, WordAt word_at){
+        if (from <= to){
+            int64_t start = std::max<int64_t>(from, 0);
+            int64_t end = std::min<int64_t>(to, size - 1);
+            for (int64_t i = start; i <= end; i = (i | Grid::CHUNK_MASK) + 1){
+                uint32_t last = std::min<int64_t>(Grid::CHUNK_MASK, end - (i & ~(int64_t)Grid::CHUNK_MASK));
+                uint64_t bits = word_at(i) & BitRange(i & Grid::CHUNK_MASK, last);
+                if (bits != 0){
+                    return (i & ~(int64_t)Grid::CHUNK_MASK) + std::countr_zero(bits);
+                }
+            }
+        } else {
+            int64_t start = std::min<int64_t>(from, size - 1);
+            int64_t end = std::max<int64_t>(to, 0);
+            for (int64_t i = start; i >= end; i = (i & ~(int64_t)Grid::CHUNK_MASK) - 1){
+                uint32_t first = std::max<int64_t>(0, end - (i & ~(int64_t)Grid::CHUNK_MASK));
+                uint64_t bits = word_at(i) & BitRange(first, i & Grid::CHUNK_MASK);
+                if (bits != 0){
+                    return (i & ~(int64_t)Grid::CHUNK_MASK) + 63 - std::countl_zero(bits);
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Collects the chunks a bulk edit touched so each gets one revision bump and mask rebuild
+    struct EditBatch {
+        Grid& grid;
+        std::vector<TileEdit>* edits = nullptr;
+        std::vector<uint32_t> chunks = {};
+        TileRegion changed = {};
+
+        void Record(uint32_t x, uint32_t y, uint16_t old_type, uint16_t new_type){
+            if (!edits->empty()){
+                TileEdit& last = edits->back();
+                if (last.y == y && last.x + last.length == x && last.old_type == old_type && last.new_type == new_type){
+                    last.length++;
+                    return;
+                }
+            }
+            edits->push_back({x, y, 1, old_type, new_type});
+        }
+
+        // Writes [start_x, end_x) of row y, either all `type` or source[0..] when source is set
+        void WriteRow(uint32_t y, uint32_t start_x, uint32_t end_x, uint16_t type, const Tile* source = nullptr, bool skip_air = false){
+            uint32_t chunk_row = (y >> Grid::CHUNK_SHIFT) * grid.chunks_x;
+            uint32_t row_offset = (y & Grid::CHUNK_MASK) << Grid::CHUNK_SHIFT;
+            for (uint32_t x = start_x; x < end_x;){
+                uint32_t chunk_x = x >> Grid::CHUNK_SHIFT;
+                uint32_t segment_end = std::min(end_x, (chunk_x + 1) << Grid::CHUNK_SHIFT);
+                const Tile* segment_source = source == nullptr ? nullptr : source + (x - start_x);
+                uint32_t chunk = chunk_row + chunk_x;
+
+                // Writing only air into an air chunk changes nothing and must not allocate it
+                bool writes_solid = source == nullptr
+                    ? type != 0
+                    : std::any_of(segment_source, segment_source + (segment_end - x), [](Tile tile){ return tile.type != 0; });
+                if (grid.chunk_index[chunk] == Grid::AIR_CHUNK && !writes_solid){
+                    x = segment_end;
+                    continue;
+                }
+
+                Tile* row = grid.GetChunkTilesMutable(chunk_x, y >> Grid::CHUNK_SHIFT) + row_offset;
+                int64_t first = -1;
+                int64_t last = -1;
+                for (uint32_t i = x; i < segment_end; i++){
+                    uint16_t write = source == nullptr ? type : segment_source[i - x].type;
+                    Tile& tile = row[i & Grid::CHUNK_MASK];
+                    if (tile.type == write || (skip_air && write == 0)){
+                        continue;
+                    }
+                    if (edits != nullptr){
+                        Record(i, y, tile.type, write);
+                    }
+                    tile.type = write;
+                    first = first == -1 ? i : first;
+                    last = i;
+                }
+                if (first != -1){
+                    if (chunks.empty() || chunks.back() != chunk){
+                        chunks.push_back(chunk);
+                    }
+                    changed.Include({(uint32_t)first, y, (uint32_t)(last - first + 1), 1});
+                }
+                x = segment_end;
+            }
+        }
+
+        TileRegion Finish(){
+            std::sort(chunks.begin(), chunks.end());
+            chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+            for (uint32_t chunk : chunks){
+                grid.TouchChunk(chunk % grid.chunks_x, chunk / grid.chunks_x);
+            }
+            return changed;
+        }
+    };
+}
 
 Grid::Grid(size_t width, size_t height) :
     size_x(width),
     size_y(height),
-    tiles(height, std::vector<Tile>(width))
+    chunks_x((width + CHUNK_MASK) >> CHUNK_SHIFT),
+    chunks_y((height + CHUNK_MASK) >> CHUNK_SHIFT),
+    chunk_index(chunks_x * chunks_y, AIR_CHUNK),
+    chunk_tiles(CHUNK_AREA, Tile{0}),
+    chunk_solid_rows(CHUNK_SIZE, 0),
+    chunk_solid_columns(CHUNK_SIZE, 0),
+    free_slots(),
+    chunk_revisions(chunks_x * chunks_y, 0),
+    dirty_chunks(),
+    chunk_dirty(chunks_x * chunks_y, 0),
+    chunk_missing(),
+    id(next_grid_id++)
 {
 
 }
 
-void Grid::Place(uint16_t x, uint16_t y, uint16_t type){
-    if (0 <= x && x < size_x && 0 <= y && y < size_y){
-        tiles.at(y).at(x).type = type;
+void Grid::Place(uint32_t x, uint32_t y, uint16_t type){
+    if (!InBounds(x, y)){
+        return;
+    }
+
+    uint32_t chunk = (y >> CHUNK_SHIFT) * chunks_x + (x >> CHUNK_SHIFT);
+    if (chunk_index[chunk] == AIR_CHUNK && type == 0){
+        return;
+    }
+
+    Tile* tiles = GetChunkTilesMutable(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+    tiles[((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK)].type = type;
+    MarkChunkChanged(chunk);
+
+    uint32_t slot = chunk_index[chunk];
+    uint64_t& row = chunk_solid_rows[(size_t)slot * CHUNK_SIZE + (y & CHUNK_MASK)];
+    uint64_t& column = chunk_solid_columns[(size_t)slot * CHUNK_SIZE + (x & CHUNK_MASK)];
+    uint64_t row_bit = 1ull << (x & CHUNK_MASK);
+    uint64_t column_bit = 1ull << (y & CHUNK_MASK);
+    if (IsSolidType(type)){
+        row |= row_bit;
+        column |= column_bit;
+    } else {
+        row &= ~row_bit;
+        column &= ~column_bit;
+    }
+
+}
+
+TileRegion Grid::Fill(int64_t x, int64_t y, uint32_t width, uint32_t height, uint16_t type, std::vector<TileEdit>* edits){
+    int64_t start_x = std::max<int64_t>(x, 0);
+    int64_t start_y = std::max<int64_t>(y, 0);
+    int64_t end_x = std::min<int64_t>(x + width, size_x);
+    int64_t end_y = std::min<int64_t>(y + height, size_y);
+    if (start_x >= end_x){
+        return {};
+    }
+
+    EditBatch batch{*this, edits};
+    for (int64_t row = start_y; row < end_y; row++){
+        batch.WriteRow(row, start_x, end_x, type);
+    }
+    return batch.Finish();
+
+}
+
+TileRegion Grid::FillCircle(int64_t center_x, int64_t center_y, uint32_t radius, uint16_t type, std::vector<TileEdit>* edits){
+    EditBatch batch{*this, edits};
+    int64_t signed_radius = radius;
+    for (int64_t offset_y = -signed_radius; offset_y <= signed_radius; offset_y++){
+        int64_t row = center_y + offset_y;
+        if (row < 0 || row >= size_y){
+            continue;
+        }
+        // Widest span inside the circle, the extra radius rounds off the flat tips
+        int64_t half_width = 0;
+        while ((half_width + 1) * (half_width + 1) + offset_y * offset_y <= signed_radius * signed_radius + signed_radius){
+            half_width++;
+        }
+        int64_t start_x = std::max<int64_t>(center_x - half_width, 0);
+        int64_t end_x = std::min<int64_t>(center_x + half_width + 1, size_x);
+        if (start_x < end_x){
+            batch.WriteRow(row, start_x, end_x, type);
+        }
+    }
+    return batch.Finish();
+
+}
+
+TileRegion Grid::FloodFill(uint32_t x, uint32_t y, uint16_t type, size_t max_tiles, std::vector<TileEdit>* edits){
+    if (!InBounds(x, y)){
+        return {};
+    }
+    uint16_t target = GetTileUnchecked(x, y).type;
+    if (target == type){
+        return {};
+    }
+
+    // Scanline fill: every popped seed fills its whole run, then seeds the runs above and below
+    EditBatch batch{*this, edits};
+    std::vector<std::pair<uint32_t, uint32_t>> seeds = {{x, y}};
+    size_t filled = 0;
+    while (!seeds.empty() && filled < max_tiles){
+        auto [seed_x, seed_y] = seeds.back();
+        seeds.pop_back();
+        if (GetTileUnchecked(seed_x, seed_y).type != target){
+            continue;
+        }
+
+        uint32_t start_x = seed_x;
+        uint32_t end_x = seed_x + 1;
+        while (start_x > 0 && GetTileUnchecked(start_x - 1, seed_y).type == target){
+            start_x--;
+        }
+        while (end_x < size_x && GetTileUnchecked(end_x, seed_y).type == target){
+            end_x++;
+        }
+        batch.WriteRow(seed_y, start_x, end_x, type);
+        filled += end_x - start_x;
+
+        for (int64_t row : {(int64_t)seed_y - 1, (int64_t)seed_y + 1}){
+            if (row < 0 || row >= size_y){
+                continue;
+            }
+            bool in_run = false;
+            for (uint32_t column = start_x; column < end_x; column++){
+                bool matches = GetTileUnchecked(column, row).type == target;
+                if (matches && !in_run){
+                    seeds.push_back({column, (uint32_t)row});
+                }
+                in_run = matches;
+            }
+        }
+    }
+    return batch.Finish();
+
+}
+
+std::vector<Tile> Grid::CopyRegion(int64_t x, int64_t y, uint32_t width, uint32_t height) const {
+    std::vector<Tile> tiles(width * height, Tile{0});
+    int64_t start_x = std::max<int64_t>(x, 0);
+    int64_t end_x = std::min<int64_t>(x + width, size_x);
+    for (int64_t row = std::max<int64_t>(y, 0); row < std::min<int64_t>(y + height, size_y); row++){
+        Tile* out = &tiles[(row - y) * width];
+        // One contiguous run per chunk
+        for (int64_t column = start_x; column < end_x; column = (column | CHUNK_MASK) + 1){
+            int64_t run_end = std::min<int64_t>(end_x, (column | CHUNK_MASK) + 1);
+            const Tile* chunk_row = GetChunkTiles(column >> CHUNK_SHIFT, row >> CHUNK_SHIFT) + ((row & CHUNK_MASK) << CHUNK_SHIFT);
+            std::copy(chunk_row + (column & CHUNK_MASK), chunk_row + (column & CHUNK_MASK) + (run_end - column), out + (column - x));
+        }
+    }
+    return tiles;
+
+}
+
+TileRegion Grid::Blit(const std::vector<Tile>& tiles, uint32_t width, uint32_t height, int64_t x, int64_t y, bool skip_air, std::vector<TileEdit>* edits){
+    if (tiles.size() < (size_t)width * height){
+        std::cout << "Error blitting: expected " << width * height << " tiles, got " << tiles.size() << std::endl;
+        return {};
+    }
+    int64_t start_x = std::max<int64_t>(x, 0);
+    int64_t end_x = std::min<int64_t>(x + width, size_x);
+    if (start_x >= end_x){
+        return {};
+    }
 
+    EditBatch batch{*this, edits};
+    for (int64_t row = std::max<int64_t>(y, 0); row < std::min<int64_t>(y + height, size_y); row++){
+        batch.WriteRow(row, start_x, end_x, 0, &tiles[(row - y) * width + (start_x - x)], skip_air);
     }
+    return batch.Finish();
 
 }
 
-Tile Grid::GetTile(uint16_t x, uint16_t y) const { //TODO: Maybe make this a reference idk
-    return tiles.at(y).at(x);
+TileRegion Grid::ApplyEdits(const std::vector<TileEdit>& edits, bool revert){
+    EditBatch batch{*this};
+    for (size_t i = 0; i < edits.size(); i++){
+        const TileEdit& edit = revert ? edits[edits.size() - 1 - i] : edits[i];
+        if (InBounds(edit.x, edit.y) && edit.x + edit.length <= size_x){
+            batch.WriteRow(edit.y, edit.x, edit.x + edit.length, revert ? edit.old_type : edit.new_type);
+        }
+    }
+    return batch.Finish();
 
 }
 
+Tile Grid::GetTile(uint32_t x, uint32_t y) const {
+    if (!InBounds(x, y)){
+        return Tile{0};
+    }
+    return GetTileUnchecked(x, y);
 
-Grid Grid::NewDefault(uint16_t width, uint16_t height){
+}
+
+const Tile* Grid::GetChunkTiles(uint32_t chunk_x, uint32_t chunk_y) const {
+    return &chunk_tiles[(size_t)chunk_index[chunk_y * chunks_x + chunk_x] * CHUNK_AREA];
+
+}
+
+Tile* Grid::GetChunkTilesMutable(uint32_t chunk_x, uint32_t chunk_y){
+    uint32_t& slot = chunk_index[chunk_y * chunks_x + chunk_x];
+    if (slot == AIR_CHUNK){
+        // Allocate lazily, the first write into an air chunk gets it a slot of its own
+        if (!free_slots.empty()){
+            slot = free_slots.back();
+            free_slots.pop_back();
+            std::fill_n(&chunk_tiles[(size_t)slot * CHUNK_AREA], CHUNK_AREA, Tile{0});
+            std::fill_n(&chunk_solid_rows[(size_t)slot * CHUNK_SIZE], CHUNK_SIZE, 0);
+            std::fill_n(&chunk_solid_columns[(size_t)slot * CHUNK_SIZE], CHUNK_SIZE, 0);
+        } else {
+            slot = chunk_tiles.size() / CHUNK_AREA;
+            chunk_tiles.resize(chunk_tiles.size() + CHUNK_AREA, Tile{0});
+            chunk_solid_rows.resize(chunk_solid_rows.size() + CHUNK_SIZE, 0);
+            chunk_solid_columns.resize(chunk_solid_columns.size() + CHUNK_SIZE, 0);
+        }
+    }
+    return &chunk_tiles[(size_t)slot * CHUNK_AREA];
+
+}
+
+void Grid::TouchChunk(uint32_t chunk_x, uint32_t chunk_y){
+    MarkChunkChanged(chunk_y * chunks_x + chunk_x);
+    RebuildSolidMask(chunk_x, chunk_y);
+
+}
+
+std::vector<uint32_t> Grid::TakeDirtyChunks(){
+    std::vector<uint32_t> chunks;
+    chunks.swap(dirty_chunks);
+    for (uint32_t chunk : chunks){
+        chunk_dirty[chunk] = 0;
+    }
+    return chunks;
+
+}
+
+void Grid::RebuildSolidMask(uint32_t chunk_x, uint32_t chunk_y){
+    uint32_t slot = chunk_index[chunk_y * chunks_x + chunk_x];
+    if (slot == AIR_CHUNK){
+        return;
+    }
+
+    const Tile* tiles = &chunk_tiles[(size_t)slot * CHUNK_AREA];
+    uint64_t* rows = &chunk_solid_rows[(size_t)slot * CHUNK_SIZE];
+    uint64_t* columns = &chunk_solid_columns[(size_t)slot * CHUNK_SIZE];
+    std::fill_n(columns, CHUNK_SIZE, 0);
+    for (uint32_t y = 0; y < CHUNK_SIZE; y++){
+        uint64_t row = 0;
+        for (uint32_t x = 0; x < CHUNK_SIZE; x++){
+            row |= (uint64_t)IsSolidType(tiles[(y << CHUNK_SHIFT) + x].type) << x;
+        }
+        rows[y] = row;
+        // Transpose by walking the set bits only
+        for (uint64_t bits = row; bits != 0; bits &= bits - 1){
+            columns[std::countr_zero(bits)] |= 1ull << y;
+        }
+    }
+
+}
+
+bool Grid::IsSolid(int64_t x, int64_t y) const {
+    return InBounds(x, y) && IsSolidUnchecked(x, y);
+
+}
+
+bool Grid::AnySolid(int64_t start_x, int64_t start_y, int64_t end_x, int64_t end_y) const {
+    start_x = std::max<int64_t>(start_x, 0);
+    start_y = std::max<int64_t>(start_y, 0);
+    end_x = std::min<int64_t>(end_x, size_x);
+    end_y = std::min<int64_t>(end_y, size_y);
+    if (start_x >= end_x || start_y >= end_y){
+        return false;
+    }
+
+    for (int64_t chunk_x = start_x >> CHUNK_SHIFT; chunk_x <= (end_x - 1) >> CHUNK_SHIFT; chunk_x++){
+        uint32_t first = std::max<int64_t>(start_x - (chunk_x << CHUNK_SHIFT), 0);
+        uint32_t last = std::min<int64_t>(end_x - 1 - (chunk_x << CHUNK_SHIFT), CHUNK_MASK);
+        uint64_t range = BitRange(first, last);
+        for (int64_t y = start_y; y < end_y; y++){
+            uint32_t slot = chunk_index[(y >> CHUNK_SHIFT) * chunks_x + chunk_x];
+            if (slot == AIR_CHUNK){
+                // Skip to the next chunk row
+                y |= CHUNK_MASK;
+                continue;
+            }
+            if (chunk_solid_rows[(size_t)slot * CHUNK_SIZE + (y & CHUNK_MASK)] & range){
+                return true;
+            }
+        }
+    }
+    return false;
+
+}
+
+std::optional<int64_t> Grid::FindSolidInRow(int64_t y, int64_t from, int64_t to) const {
+    if (y < 0 || y >= size_y){
+        return std::nullopt;
+    }
+    const uint32_t* index_row = &chunk_index[(y >> CHUNK_SHIFT) * chunks_x];
+    return FindSetBit(from, to, size_x, [&](int64_t x){
+        return chunk_solid_rows[(size_t)index_row[x >> CHUNK_SHIFT] * CHUNK_SIZE + (y & CHUNK_MASK)];
+    });
+
+}
+
+std::optional<int64_t> Grid::FindSolidInColumn(int64_t x, int64_t from, int64_t to) const {
+    if (x < 0 || x >= size_x){
+        return std::nullopt;
+    }
+    return FindSetBit(from, to, size_y, [&](int64_t y){
+        return chunk_solid_columns[(size_t)chunk_index[(y >> CHUNK_SHIFT) * chunks_x + (x >> CHUNK_SHIFT)] * CHUNK_SIZE + (x & CHUNK_MASK)];
+    });
+
+}
+
+void Grid::ReleaseChunk(uint32_t chunk_x, uint32_t chunk_y){
+    uint32_t& slot = chunk_index[chunk_y * chunks_x + chunk_x];
+    if (slot != AIR_CHUNK){
+        free_slots.push_back(slot);
+        slot = AIR_CHUNK;
+    }
+
+}
+
+bool Grid::IsChunkAllocated(uint32_t chunk_x, uint32_t chunk_y) const {
+    return chunk_index[chunk_y * chunks_x + chunk_x] != AIR_CHUNK;
+
+}
+
+void Grid::MarkAllChunksMissing(){
+    chunk_missing.assign(chunks_x * chunks_y, 1);
+
+}
+
+void Grid::SetChunkLoaded(uint32_t chunk, bool loaded){
+    if (!chunk_missing.empty()){
+        chunk_missing[chunk] = !loaded;
+    }
+
+}
+
+size_t Grid::GetAllocatedChunkCount() const {
+    return chunk_tiles.size() / CHUNK_AREA - 1 - free_slots.size();
+
+}
+
+
+Grid Grid::NewDefault(uint32_t width, uint32_t height){
     Grid grid(width, height);
-    for (int y = 0; y < height; y++)
+    for (uint32_t y = 0; y < height; y++)
     {
         grid.Place(0, y, 6);
     }
-    for (int x = 0; x < width; x++)
+    for (uint32_t x = 0; x < width; x++)
     {
         grid.Place(x, 0, 6);
     }
-    for (int y = 0; y < height; y++)
+    for (uint32_t y = 0; y < height; y++)
     {
         grid.Place(width - 1, y, 6);
     }
-    for (int x = 0; x < width; x++)
+    for (uint32_t x = 0; x < width; x++)
     {
         grid.Place(x, height - 1, 6);
     }
@@ -51,55 +493,153 @@ Grid Grid::NewDefault(uint16_t width, uint16_t height){
 
 }
 
-void Grid::SaveToFile(std::string filename){
-    using Json = nlohmann::json;
+bool Grid::SaveToJsonFile(std::string filename) const {
+    std::filesystem::create_directories("levels");
+    return LevelFormat::WriteFileAtomic("levels/" + filename + ".json", [this](std::ostream& file){
+        return LevelJson::Write(*this, file);
+    });
+
+}
+
+std::optional<Grid> Grid::LoadFromJsonFile(std::string filename){
+    auto file = MappedFile::Open("levels/" + filename + ".json");
+    if (!file.has_value()){
+        std::cout << "Error loading grid from file: could not open " << filename << std::endl;
+        return std::nullopt;
+    }
+    return LevelJson::Read(file->data, file->size);
 
-    std::ofstream file("levels/" + filename + ".json");
+}
 
-    Json level_data;
-    level_data["width"] = size_x;
-    level_data["height"] = size_y;
+std::vector<uint8_t> Grid::ToBinary(std::atomic<float>* progress) const {
+    LevelFormat::Header header = LevelFormat::MakeHeader(*this);
+    std::vector<LevelFormat::ChunkEntry> directory(chunks_x * chunks_y, LevelFormat::ChunkEntry{0, 0, 0});
 
-    std::vector<std::vector<uint16_t>> tiles_data;
-    for (const auto& row : tiles){
-        std::vector<uint16_t> type_row;
-        for (const auto& tile : row){
-            type_row.push_back(tile.type);
+    // Payloads go after the directory, which is filled in last once offsets are known
+    size_t directory_end = sizeof(LevelFormat::Header) + directory.size() * sizeof(LevelFormat::ChunkEntry);
+    std::vector<uint8_t> output(directory_end);
+
+    for (uint32_t chunk = 0; chunk < directory.size(); chunk++){
+        if (progress != nullptr && (chunk & PROGRESS_INTERVAL) == 0){
+            progress->store((float)chunk / directory.size(), std::memory_order_relaxed);
+        }
+        if (chunk_index[chunk] == AIR_CHUNK){
+            continue;
         }
-        tiles_data.push_back(type_row);
+        const Tile* tiles = &chunk_tiles[(size_t)chunk_index[chunk] * CHUNK_AREA];
+        if (LevelFormat::IsChunkAir(tiles)){
+            continue;
+        }
+
+        size_t offset = output.size();
+        LevelFormat::EncodeChunk(tiles, output);
+        directory[chunk] = {
+            offset,
+            static_cast<uint32_t>(output.size() - offset),
+            LevelFormat::Crc32(output.data() + offset, output.size() - offset)
+        };
     }
-    level_data["tiles"] = tiles_data;
 
-    std::string json_string = level_data.dump(4); //TODO: make this cleaner somehow, whole file is 4000+ lines long
+    header.checksum = LevelFormat::HeaderChecksum(header, directory.data());
+    std::memcpy(output.data(), &header, sizeof(header));
+    std::memcpy(output.data() + sizeof(header), directory.data(), directory.size() * sizeof(LevelFormat::ChunkEntry));
+    return output;
 
-    if (file.is_open()){
-        file << json_string;
-        file.close();
+}
+
+std::optional<Grid> Grid::FromBinary(const uint8_t* data, size_t size, std::atomic<float>* progress){
+    if (size < sizeof(LevelFormat::Header)){
+        std::cout << "Error loading grid from file: truncated header" << std::endl;
+        return std::nullopt;
+    }
+    LevelFormat::Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (!LevelFormat::IsHeaderValid(header)){
+        std::cout << "Error loading grid from file: not a version " << LevelFormat::VERSION << " level" << std::endl;
+        return std::nullopt;
     }
 
-}
+    size_t chunk_count = (size_t)header.chunks_x * header.chunks_y;
+    if (size < sizeof(LevelFormat::Header) + chunk_count * sizeof(LevelFormat::ChunkEntry)){
+        std::cout << "Error loading grid from file: truncated chunk directory" << std::endl;
+        return std::nullopt;
+    }
+    const uint8_t* directory = data + sizeof(LevelFormat::Header);
+    if (LevelFormat::HeaderChecksum(header, directory) != header.checksum){
+        std::cout << "Error loading grid from file: header checksum mismatch" << std::endl;
+        return std::nullopt;
+    }
 
-std::optional<Grid> Grid::LoadFromFile(std::string filename){
-    try {
-    using Json = nlohmann::json;
+    Grid grid(header.width, header.height);
 
-    std::ifstream file("levels/" + filename + ".json");
+    // Entries are copied out one at a time since embedded levels need not be aligned
+    auto read_entry = [&](size_t chunk){
+        LevelFormat::ChunkEntry entry;
+        std::memcpy(&entry, directory + chunk * sizeof(LevelFormat::ChunkEntry), sizeof(entry));
+        return entry;
+    };
 
-    Json level_data;
-    file >> level_data;
+    size_t payload_count = 0;
+    for (size_t chunk = 0; chunk < chunk_count; chunk++){
+        payload_count += read_entry(chunk).size != 0;
+    }
+    grid.chunk_tiles.reserve((payload_count + 1) * CHUNK_AREA);
+
+    for (uint32_t chunk = 0; chunk < chunk_count; chunk++){
+        if (progress != nullptr && (chunk & PROGRESS_INTERVAL) == 0){
+            progress->store((float)chunk / chunk_count, std::memory_order_relaxed);
+        }
+        LevelFormat::ChunkEntry entry = read_entry(chunk);
+        if (entry.size == 0){
+            continue;
+        }
+        if (entry.offset > size || entry.size > size - entry.offset){
+            std::cout << "Error loading grid from file: chunk " << chunk << " out of range" << std::endl;
+            return std::nullopt;
+        }
 
-    Grid return_grid(level_data["width"], level_data["height"]);
+        const uint8_t* payload = data + entry.offset;
+        if (LevelFormat::Crc32(payload, entry.size) != entry.checksum){
+            std::cout << "Error loading grid from file: chunk " << chunk << " checksum mismatch" << std::endl;
+            return std::nullopt;
+        }
 
-    std::vector<std::vector<uint16_t>> tiles_data = level_data["tiles"];
-    for (int y = 0; y < return_grid.size_y; y++){
-        for (int x = 0; x < return_grid.size_x; x++){
-            return_grid.tiles[y][x].type = tiles_data[y][x];
+        // Decode straight from the source bytes into the chunk pool
+        Tile* tiles = grid.GetChunkTilesMutable(chunk % grid.chunks_x, chunk / grid.chunks_x);
+        if (!LevelFormat::DecodeChunk(payload, entry.size, tiles)){
+            std::cout << "Error loading grid from file: chunk " << chunk << " is corrupt" << std::endl;
+            return std::nullopt;
         }
+        grid.RebuildSolidMask(chunk % grid.chunks_x, chunk / grid.chunks_x);
     }
 
-    return return_grid;
-    } catch (const std::exception& e) {
-        std::cout << "Error loading grid from file: " << e.what() << std::endl;
+    return grid;
+
+}
+
+bool Grid::SaveToFile(std::string filename, std::atomic<float>* progress) const {
+    std::filesystem::create_directories("levels");
+    return LevelFormat::WriteFileAtomic("levels/" + filename + LevelFormat::EXTENSION, ToBinary(progress));
+
+}
+
+std::optional<Grid> Grid::LoadFromBinaryFile(std::string filename, std::atomic<float>* progress){
+    std::string path = "levels/" + filename + LevelFormat::EXTENSION;
+    // Finishes an incremental save that a crash interrupted
+    LevelFormat::ReplayJournal(path);
+    auto file = MappedFile::Open(path);
+    if (!file.has_value()){
+        std::cout << "Error loading grid from file: could not open " << filename << std::endl;
         return std::nullopt;
     }
+    return FromBinary(file->data, file->size, progress);
+
+}
+
+std::optional<Grid> Grid::LoadFromFile(std::string filename, std::atomic<float>* progress){
+    if (std::filesystem::exists("levels/" + filename + LevelFormat::EXTENSION)){
+        return LoadFromBinaryFile(filename, progress);
+    }
+    return LoadFromJsonFile(filename);
+
 }
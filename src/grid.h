@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <optional>
 #include <vector>
@@ -10,22 +12,201 @@ struct Tile {
     uint16_t type;
 };
 
+// Tiles [x, x + length) of row y that all went from old_type to new_type
+struct TileEdit {
+    uint32_t x;
+    uint32_t y;
+    uint32_t length;
+    uint16_t old_type;
+    uint16_t new_type;
+};
+
+// Tiles [x, x + width) x [y, y + height). Bulk edits return the area they changed as one of these.
+struct TileRegion {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    bool IsEmpty() const {
+        return width == 0 || height == 0;
+    }
+
+    // Grows to the bounding box of both
+    void Include(const TileRegion& other){
+        if (other.IsEmpty()){
+            return;
+        }
+        if (IsEmpty()){
+            *this = other;
+            return;
+        }
+        uint32_t end_x = std::max(x + width, other.x + other.width);
+        uint32_t end_y = std::max(y + height, other.y + other.height);
+        x = std::min(x, other.x);
+        y = std::min(y, other.y);
+        width = end_x - x;
+        height = end_y - y;
+    }
+};
+
+inline constexpr uint16_t TORCH_TILE = 9;
+
+// Torches are decoration, the player and light pass through them
+inline bool IsSolidType(uint16_t type){
+    return type != 0 && type != TORCH_TILE;
+}
+
+// Block light a tile type gives off, 0 to 15
+inline uint8_t GetTileEmission(uint16_t type){
+    return type == TORCH_TILE ? 14 : 0;
+}
+
+// Tiles are stored in fixed CHUNK_SIZE x CHUNK_SIZE chunks packed into one contiguous pool.
+// chunk_index maps every chunk coordinate to a pool slot. Slot 0 is a shared all-air chunk
+// that is never written, so untouched regions cost one index entry and no tile memory.
 struct Grid{
-    uint16_t size_x;
-    uint16_t size_y;
+    static constexpr uint32_t CHUNK_SHIFT = 6;
+    static constexpr uint32_t CHUNK_SIZE = 1 << CHUNK_SHIFT;
+    static constexpr uint32_t CHUNK_MASK = CHUNK_SIZE - 1;
+    static constexpr uint32_t CHUNK_AREA = CHUNK_SIZE * CHUNK_SIZE;
+    static constexpr uint32_t AIR_CHUNK = 0;
+
+    uint32_t size_x;
+    uint32_t size_y;
+    uint32_t chunks_x;
+    uint32_t chunks_y;
     //TODO: should probably be immutable, but reassignable
 
-    std::vector<std::vector<Tile>> tiles;
+    std::vector<uint32_t> chunk_index;
+    std::vector<Tile> chunk_tiles;
+    // One bit per tile, parallel to chunk_tiles. Rows hold CHUNK_SIZE words per slot with bit x
+    // set for a solid tile in that row, columns hold the transpose for vertical scans.
+    std::vector<uint64_t> chunk_solid_rows;
+    std::vector<uint64_t> chunk_solid_columns;
+    std::vector<uint32_t> free_slots;
+    // Bumped on every edit so caches and the pager can tell which chunks changed
+    std::vector<uint32_t> chunk_revisions;
+    // Chunks edited since the last TakeDirtyChunks, each listed once, for incremental saves
+    std::vector<uint32_t> dirty_chunks;
+    std::vector<uint8_t> chunk_dirty;
+    // Set for chunks whose data is not in memory, empty unless the grid is streamed. A missing
+    // chunk reads as air, so lighting and the pyramid skip it instead of treating it as open space.
+    std::vector<uint8_t> chunk_missing;
+    // Unique per constructed grid, caches keyed by revision also check this
+    uint64_t id;
 
     Grid(size_t width, size_t height);
 
-    void Place(uint16_t x, uint16_t y, uint16_t type);
+    void Place(uint32_t x, uint32_t y, uint16_t type);
+
+    // Bulk edits write runs of a row at a time and bump each touched chunk's revision once. They
+    // clip to the grid and return the bounding box of the tiles that changed. When `edits` is set
+    // every change is appended to it.
+    TileRegion Fill(int64_t x, int64_t y, uint32_t width, uint32_t height, uint16_t type, std::vector<TileEdit>* edits = nullptr);
+
+    TileRegion FillCircle(int64_t center_x, int64_t center_y, uint32_t radius, uint16_t type, std::vector<TileEdit>* edits = nullptr);
+
+    // Replaces the 4-connected area of (x, y)'s type, stopping once max_tiles have been filled
+    TileRegion FloodFill(uint32_t x, uint32_t y, uint16_t type, size_t max_tiles = SIZE_MAX, std::vector<TileEdit>* edits = nullptr);
+
+    // Row-major width x height tiles, air outside the grid
+    std::vector<Tile> CopyRegion(int64_t x, int64_t y, uint32_t width, uint32_t height) const;
+
+    // Pastes row-major tiles with their top left at (x, y). Air in the source is skipped when
+    // skip_air is set, so pasted shapes do not erase what is behind them.
+    TileRegion Blit(const std::vector<Tile>& tiles, uint32_t width, uint32_t height, int64_t x, int64_t y, bool skip_air = false, std::vector<TileEdit>* edits = nullptr);
+
+    // Replays recorded edits, or rolls them back newest first when revert is set
+    TileRegion ApplyEdits(const std::vector<TileEdit>& edits, bool revert);
+
+    // Returns air outside the grid
+    Tile GetTile(uint32_t x, uint32_t y) const;
+
+    // No bounds check, (x, y) must be inside the grid
+    inline Tile GetTileUnchecked(uint32_t x, uint32_t y) const {
+        uint32_t slot = chunk_index[(y >> CHUNK_SHIFT) * chunks_x + (x >> CHUNK_SHIFT)];
+        return chunk_tiles[(size_t)slot * CHUNK_AREA + ((y & CHUNK_MASK) << CHUNK_SHIFT) + (x & CHUNK_MASK)];
+    }
+
+    inline bool InBounds(int64_t x, int64_t y) const {
+        return 0 <= x && x < size_x && 0 <= y && y < size_y;
+    }
+
+    // No bounds check, (x, y) must be inside the grid
+    inline bool IsSolidUnchecked(uint32_t x, uint32_t y) const {
+        uint32_t slot = chunk_index[(y >> CHUNK_SHIFT) * chunks_x + (x >> CHUNK_SHIFT)];
+        return (chunk_solid_rows[(size_t)slot * CHUNK_SIZE + (y & CHUNK_MASK)] >> (x & CHUNK_MASK)) & 1;
+    }
+
+    // Solidity queries over the bitmask, 64 tiles per word. Tiles outside the grid are air.
+    bool IsSolid(int64_t x, int64_t y) const;
+
+    // Any solid tile in [start_x, end_x) x [start_y, end_y)
+    bool AnySolid(int64_t start_x, int64_t start_y, int64_t end_x, int64_t end_y) const;
+
+    // First solid tile scanning from `from` towards `to`, both inclusive, in either direction
+    std::optional<int64_t> FindSolidInRow(int64_t y, int64_t from, int64_t to) const;
+
+    std::optional<int64_t> FindSolidInColumn(int64_t x, int64_t from, int64_t to) const;
+
+    // Tiles of one chunk, CHUNK_AREA long in row-major order
+    const Tile* GetChunkTiles(uint32_t chunk_x, uint32_t chunk_y) const;
+
+    // Allocates the chunk if it is air. Callers that edit through it call TouchChunk afterwards
+    Tile* GetChunkTilesMutable(uint32_t chunk_x, uint32_t chunk_y);
+
+    // Bumps the revision and rebuilds the solidity mask of a chunk edited in place
+    void TouchChunk(uint32_t chunk_x, uint32_t chunk_y);
+
+    // Bumps the revision and queues the chunk for the next incremental save
+    inline void MarkChunkChanged(uint32_t chunk){
+        chunk_revisions[chunk]++;
+        if (!chunk_dirty[chunk]){
+            chunk_dirty[chunk] = 1;
+            dirty_chunks.push_back(chunk);
+        }
+    }
+
+    // Chunks changed since the previous call, in the order they were first changed
+    std::vector<uint32_t> TakeDirtyChunks();
+
+    void RebuildSolidMask(uint32_t chunk_x, uint32_t chunk_y);
+
+    // Returns the chunk's slot to the pool, the chunk reads as air afterwards
+    void ReleaseChunk(uint32_t chunk_x, uint32_t chunk_y);
+
+    bool IsChunkAllocated(uint32_t chunk_x, uint32_t chunk_y) const;
+
+    inline bool IsChunkLoaded(uint32_t chunk) const {
+        return chunk_missing.empty() || !chunk_missing[chunk];
+    }
+
+    // Marks every chunk missing, for a grid whose chunks are streamed in one at a time
+    void MarkAllChunksMissing();
+
+    void SetChunkLoaded(uint32_t chunk, bool loaded);
+
+    size_t GetAllocatedChunkCount() const;
+
+    // Binary .cave level, see level_format.h. When progress is set it is raised from 0 to 1 as
+    // chunks are processed, for showing on another thread.
+    std::vector<uint8_t> ToBinary(std::atomic<float>* progress = nullptr) const;
+
+    static std::optional<Grid> FromBinary(const uint8_t* data, size_t size, std::atomic<float>* progress = nullptr);
+
+    // Replaces levels/<filename>.cave atomically
+    bool SaveToFile(std::string filename, std::atomic<float>* progress = nullptr) const;
+
+    // Replaces levels/<filename>.json atomically, streamed a row at a time, see level_json.h
+    bool SaveToJsonFile(std::string filename) const;
 
-    Tile GetTile(uint16_t x, uint16_t y) const; //TODO: Maybe make this a reference idk
+    // Loads levels/<filename>.cave if present, otherwise levels/<filename>.json
+    static std::optional<Grid> LoadFromFile(std::string filename, std::atomic<float>* progress = nullptr);
 
-    void SaveToFile(std::string filename);
+    static std::optional<Grid> LoadFromBinaryFile(std::string filename, std::atomic<float>* progress = nullptr);
 
-    static std::optional<Grid> LoadFromFile(std::string filename);
+    static std::optional<Grid> LoadFromJsonFile(std::string filename);
 
-    static Grid NewDefault(uint16_t width, uint16_t height);
+    static Grid NewDefault(uint32_t width, uint32_t height);
 };
@@ -0,0 +1,59 @@
+#include "grid_copy.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+GridCopy GridCopy::New(const Grid& source){
+    GridCopy copy = {Grid(source.size_x, source.size_y)};
+    copy.source_id = source.id;
+    copy.copied_revisions.assign(source.chunks_x * source.chunks_y, 0);
+    // Growing the pools while copying would move everything copied so far in a single step
+    copy.grid.chunk_tiles.reserve(source.chunk_tiles.size());
+    copy.grid.chunk_solid_rows.reserve(source.chunk_solid_rows.size());
+    copy.grid.chunk_solid_columns.reserve(source.chunk_solid_columns.size());
+    return copy;
+
+}
+
+bool GridCopy::Step(const Grid& source, uint32_t max_chunks){
+    PROFILE_SCOPE("grid copy");
+    uint32_t chunk_count = source.chunks_x * source.chunks_y;
+    // Air chunks cost nothing to copy and do not count against the budget
+    uint32_t copied = 0;
+    while (next_chunk < chunk_count && copied < max_chunks){
+        if (source.chunk_index[next_chunk] != Grid::AIR_CHUNK){
+            copied++;
+        }
+        CopyChunk(source, next_chunk);
+        next_chunk++;
+    }
+    if (next_chunk < chunk_count){
+        return false;
+    }
+
+    // Edits made during earlier steps are caught up all at once, so the copy is of a single tick
+    for (uint32_t chunk = 0; chunk < chunk_count; chunk++){
+        if (copied_revisions[chunk] != source.chunk_revisions[chunk]){
+            CopyChunk(source, chunk);
+        }
+    }
+    return true;
+
+}
+
+bool GridCopy::IsFollowing(const Grid& source) const {
+    return source.id == source_id;
+
+}
+
+void GridCopy::CopyChunk(const Grid& source, uint32_t chunk){
+    uint32_t chunk_x = chunk % source.chunks_x;
+    uint32_t chunk_y = chunk / source.chunks_x;
+    copied_revisions[chunk] = source.chunk_revisions[chunk];
+    if (!source.IsChunkAllocated(chunk_x, chunk_y)){
+        grid.ReleaseChunk(chunk_x, chunk_y);
+        return;
+    }
+    std::copy_n(source.GetChunkTiles(chunk_x, chunk_y), Grid::CHUNK_AREA, grid.GetChunkTilesMutable(chunk_x, chunk_y));
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "grid.h"
+
+#include <cstdint>
+#include <vector>
+
+// Copies a grid for a background save a bounded number of chunks per Step, so a large world
+// never stalls a tick on one big copy. Chunks edited after they were copied are copied again by
+// the Step that completes it, so the finished copy holds the grid as it was on that tick.
+struct GridCopy {
+    Grid grid;
+    uint64_t source_id = 0;
+    // Source revision each chunk was copied at
+    std::vector<uint32_t> copied_revisions = {};
+    uint32_t next_chunk = 0;
+
+    static GridCopy New(const Grid& source);
+
+    // Copies up to max_chunks allocated chunks, true once the copy is complete
+    bool Step(const Grid& source, uint32_t max_chunks);
+
+    // False once a different grid was loaded, the copy can never complete then
+    bool IsFollowing(const Grid& source) const;
+
+private:
+    void CopyChunk(const Grid& source, uint32_t chunk);
+};
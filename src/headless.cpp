@@ -0,0 +1,245 @@
+#include "headless.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace Headless {
+
+namespace {
+
+    bool ApplyToken(const std::string& token, Input& input, Input::Pressed& pressed){
+        static const std::pair<const char*, bool Input::Held::*> HELD[] = {
+            {"ctrl", &Input::Held::ctrl},
+            {"right", &Input::Held::right},
+            {"left", &Input::Held::left},
+            {"up", &Input::Held::up},
+            {"down", &Input::Held::down},
+            {"space", &Input::Held::space},
+            {"lmb", &Input::Held::lmb},
+            {"rmb", &Input::Held::rmb}
+        };
+        static const std::pair<const char*, bool Input::Pressed::*> PRESSED[] = {
+            {"!space", &Input::Pressed::space},
+            {"!escape", &Input::Pressed::escape},
+            {"!y", &Input::Pressed::y},
+            {"!n", &Input::Pressed::n},
+            {"!z", &Input::Pressed::z},
+            {"!f4", &Input::Pressed::f4},
+            {"!f5", &Input::Pressed::f5},
+            {"!f6", &Input::Pressed::f6},
+            {"!f7", &Input::Pressed::f7},
+            {"!f8", &Input::Pressed::f8}
+        };
+
+        for (const auto& [name, member] : HELD){
+            if (token == name){
+                input.held.*member = true;
+                return true;
+            }
+        }
+        for (const auto& [name, member] : PRESSED){
+            if (token == name){
+                pressed.*member = true;
+                return true;
+            }
+        }
+        if (token.rfind("mouse=", 0) == 0){
+            return std::sscanf(token.c_str(), "mouse=%f,%f", &input.mouse_position.x, &input.mouse_position.y) == 2;
+        }
+        if (token.rfind("wheel=", 0) == 0){
+            return std::sscanf(token.c_str(), "wheel=%f", &input.mouse_wheel) == 1;
+        }
+        return false;
+    }
+
+} // namespace
+
+std::optional<std::vector<Input>> ParseScript(std::string path){
+    std::ifstream file(path);
+    if (!file.is_open()){
+        std::cout << "Error reading input script: could not open " << path << std::endl;
+        return std::nullopt;
+    }
+
+    std::vector<Input> inputs;
+    Vector2 mouse_position = {0, 0};
+    std::string line;
+    for (int line_number = 1; std::getline(file, line); line_number++){
+        line = line.substr(0, line.find('#'));
+        std::istringstream tokens(line);
+
+        uint64_t repeat;
+        if (!(tokens >> repeat)){
+            continue;
+        }
+
+        Input input{};
+        input.mouse_position = mouse_position;
+        Input::Pressed pressed{};
+        std::string token;
+        while (tokens >> token){
+            if (!ApplyToken(token, input, pressed)){
+                std::cout << "Error reading input script: unknown token '" << token << "' on line " << line_number << std::endl;
+                return std::nullopt;
+            }
+        }
+        mouse_position = input.mouse_position;
+
+        for (uint64_t i = 0; i < repeat; i++){
+            inputs.push_back(input);
+            // One-shot events only fire on the first tick of the line
+            if (i == 0){
+                inputs.back().pressed = pressed;
+            } else {
+                inputs.back().mouse_wheel = 0;
+            }
+        }
+    }
+
+    return inputs;
+
+}
+
+std::optional<Report> Run(const Options& options){
+    using Clock = std::chrono::steady_clock;
+
+    Game::GameState state{};
+    state.player = Player::New(Texture2D{});
+    // Runs must not write levels behind the caller's back
+    state.autosave = nullptr;
+    if (options.thread_count != 0){
+        state.jobs = JobSystem::New(options.thread_count);
+    }
+    if (options.start_in_play){
+        state.game_mode = PLAY;
+    }
+    if (!options.level_name.empty()){
+        auto grid = Grid::LoadFromFile(options.level_name);
+        if (!grid.has_value()){
+            return std::nullopt;
+        }
+        state.grid = grid.value();
+    }
+    double generate_ms = 0;
+    if (options.generate_seed.has_value()){
+        auto generate_start = Clock::now();
+        Game::GenerateLevel(state, options.generate_seed.value(), Game::Config::GENERATED_WIDTH, Game::Config::GENERATED_HEIGHT);
+        generate_ms = std::chrono::duration<double, std::milli>(Clock::now() - generate_start).count();
+    }
+
+    std::vector<Input> inputs;
+    if (!options.replay_name.empty()){
+        auto replay = Replay::LoadFromFile(options.replay_name);
+        if (!replay.has_value()){
+            return std::nullopt;
+        }
+        // Playback feeds the ticks itself, the pending input is ignored
+        inputs.resize(replay->inputs.size());
+        if (!Game::StartPlayback(state, std::move(replay.value()))){
+            return std::nullopt;
+        }
+    } else {
+        auto script = ParseScript(options.script_path);
+        if (!script.has_value()){
+            return std::nullopt;
+        }
+        inputs = std::move(script.value());
+    }
+    if (inputs.empty()){
+        std::cout << "Headless run has no input" << std::endl;
+        return std::nullopt;
+    }
+    for (uint32_t i = 0; i < options.entity_count; i++){
+        // Fixed lattice over the level so runs are comparable
+        uint32_t x = (i * 37) % (state.grid.size_x * Game::Config::TILE_RESOLUTION);
+        uint32_t y = (i / state.grid.size_x) % (state.grid.size_y * Game::Config::TILE_RESOLUTION);
+        state.entities.Spawn(
+            {(float)x, (float)y},
+            {Game::Config::DROP_SIZE, Game::Config::DROP_SIZE},
+            {(float)(i % 9) * 10 - 40, 0},
+            1,
+            ENTITY_GRAVITY | ENTITY_COLLIDES | ENTITY_FRICTION | ENTITY_PUSHES
+        );
+    }
+    if (!options.record_name.empty()){
+        Game::StartRecording(state);
+    }
+
+    Report report;
+    for (const Game::TickPhase& phase : Game::TICK_PHASES){
+        report.phases.push_back({phase.name});
+    }
+
+    uint64_t tick_count = options.tick_count == 0 ? inputs.size() : options.tick_count;
+    PROFILE_THREAD("main");
+    if (!options.trace_path.empty()){
+        Profiler::StartCapture();
+    }
+    auto run_start = Clock::now();
+    for (uint64_t tick = 0; tick < tick_count; tick++){
+        state.pending_input = inputs[tick % inputs.size()];
+
+        PROFILE_SCOPE("tick");
+        for (size_t i = 0; i < Game::TICK_PHASES.size(); i++){
+            PROFILE_SCOPE(Game::TICK_PHASES[i].name);
+            auto phase_start = Clock::now();
+            Game::TICK_PHASES[i].run(state);
+            double elapsed_us = std::chrono::duration<double, std::micro>(Clock::now() - phase_start).count();
+            report.phases[i].total_ms += elapsed_us / 1000;
+            report.phases[i].max_us = std::max(report.phases[i].max_us, elapsed_us);
+        }
+        state.jobs->WaitAll();
+        state.tick++;
+        if (!options.trace_path.empty()){
+            Profiler::Collect();
+        }
+    }
+    report.wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - run_start).count();
+    report.ticks = tick_count;
+    report.generate_ms = generate_ms;
+
+    if (state.pager != nullptr){
+        state.pager->Flush(state.grid);
+    }
+    Game::StopRecording(state, options.record_name);
+    if (!options.trace_path.empty()){
+        Profiler::Collect();
+        Profiler::StopCapture(options.trace_path);
+    }
+
+    report.player_position = {state.player.sprite.dest_rect.x, state.player.sprite.dest_rect.y};
+    report.player_velocity = state.player.velocity;
+    report.entity_count = state.entities.Count();
+    report.thread_count = state.jobs->GetThreadCount();
+    return report;
+
+}
+
+void PrintReport(const Report& report){
+    std::printf("ticks: %llu\n", (unsigned long long)report.ticks);
+    std::printf("threads: %u\n", report.thread_count);
+    std::printf("wall_ms: %.3f\n", report.wall_ms);
+    if (report.generate_ms > 0){
+        std::printf("generate_ms: %.3f\n", report.generate_ms);
+    }
+    std::printf("ticks_per_second: %.1f\n", report.ticks / (report.wall_ms / 1000));
+    for (const PhaseTiming& phase : report.phases){
+        std::printf(
+            "phase %-8s total_ms: %9.3f  avg_us: %8.3f  max_us: %8.3f\n",
+            phase.name,
+            phase.total_ms,
+            phase.total_ms * 1000 / report.ticks,
+            phase.max_us
+        );
+    }
+    // Hex floats so runs can be compared bit for bit
+    std::printf("player_position: %a %a\n", report.player_position.x, report.player_position.y);
+    std::printf("player_velocity: %a %a\n", report.player_velocity.x, report.player_velocity.y);
+    std::printf("entities: %zu\n", report.entity_count);
+
+}
+
+} // namespace Headless
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "game.h"
+#include "model.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Runs Game::Tick without a window or GPU context, driven by an input stream instead of raylib
+namespace Headless {
+
+struct Options {
+    std::string script_path = {};
+    std::string replay_name = {}; // Plays back replays/<name>.rpl instead of a script
+    std::string record_name = {}; // Records the run to replays/<name>.rpl
+    std::string level_name = {};  // Empty for the default grid
+    std::string trace_path = {};  // Writes the run's profiler events as Chrome trace JSON, needs CAVE_PROFILE
+    std::optional<uint64_t> generate_seed = {}; // Generates a cave of Config::GENERATED_WIDTH x HEIGHT instead
+    uint64_t tick_count = 0;      // 0 runs the whole input stream once
+    uint32_t entity_count = 0;    // Falling bodies spread over the level before the first tick
+    uint32_t thread_count = 0;    // Job system threads, 0 for one per hardware thread
+    bool start_in_play = true;
+};
+
+struct PhaseTiming {
+    const char* name;
+    double total_ms = 0;
+    double max_us = 0;
+};
+
+struct Report {
+    uint64_t ticks = 0;
+    double wall_ms = 0;
+    double generate_ms = 0;
+    std::vector<PhaseTiming> phases = {};
+    Vector2 player_position = {0, 0};
+    Vector2 player_velocity = {0, 0};
+    size_t entity_count = 0;
+    uint32_t thread_count = 0;
+};
+
+// One Input per tick. Each line is "<ticks> [token...]" where tokens are held keys
+// (ctrl right left up down space lmb rmb), presses applied on the line's first tick
+// (!space !escape !y !n !z !f4 !f5 !f6 !f7 !f8), mouse=X,Y in screen pixels and wheel=W.
+// The mouse position carries over to later lines, '#' starts a comment.
+std::optional<std::vector<Input>> ParseScript(std::string path);
+
+// Runs the script's inputs, or the replay's when options.replay_name is set
+std::optional<Report> Run(const Options& options);
+
+void PrintReport(const Report& report);
+
+} // namespace Headless
@@ -0,0 +1,261 @@
+#include "jobs.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+namespace {
+
+    thread_local const JobSystem* current_system = nullptr;
+    thread_local uint32_t current_queue = 0;
+
+} // namespace
+
+std::unique_ptr<JobSystem> JobSystem::New(uint32_t thread_count){
+    if (thread_count == 0){
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    std::unique_ptr<JobSystem> system(new JobSystem());
+    for (uint32_t i = 0; i < thread_count; i++){
+        system->queues.push_back(std::make_unique<Queue>());
+    }
+    for (uint32_t i = 0; i + 1 < thread_count; i++){
+        system->workers.emplace_back(&JobSystem::WorkerLoop, system.get(), i);
+    }
+    return system;
+
+}
+
+JobSystem::~JobSystem(){
+    WaitAll();
+    {
+        std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (std::thread& worker : workers){
+        worker.join();
+    }
+
+}
+
+JobSystem::JobHandle JobSystem::Submit(std::function<void()> task, const std::vector<JobHandle>& dependencies){
+    Job* job;
+    {
+        std::lock_guard lock(pool_mutex);
+        job = &pool.emplace_back();
+    }
+    job->task = std::move(task);
+    pending_jobs++;
+
+    for (Job* dependency : dependencies){
+        std::lock_guard lock(dependency->mutex);
+        if (!dependency->done){
+            dependency->dependents.push_back(job);
+            job->unfinished_dependencies++;
+        }
+    }
+    if (--job->unfinished_dependencies == 0){
+        Enqueue(job);
+    }
+    return job;
+
+}
+
+JobSystem::JobHandle JobSystem::ParallelForAsync(
+    uint32_t count,
+    uint32_t batch_size,
+    std::function<void(uint32_t start, uint32_t end)> body,
+    const std::vector<JobHandle>& dependencies
+){
+    auto shared_body = std::make_shared<std::function<void(uint32_t, uint32_t)>>(std::move(body));
+    batch_size = std::max(batch_size, 1u);
+
+    std::vector<JobHandle> batches;
+    for (uint32_t start = 0; start < count; start += batch_size){
+        uint32_t end = std::min(count, start + batch_size);
+        batches.push_back(Submit([shared_body, start, end]{ (*shared_body)(start, end); }, dependencies));
+    }
+    // Also covers count == 0, the join still waits for the dependencies
+    if (batches.empty()){
+        return Submit([]{}, dependencies);
+    }
+    return Submit([]{}, batches);
+
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t batch_size, std::function<void(uint32_t start, uint32_t end)> body){
+    Wait(ParallelForAsync(count, batch_size, std::move(body)));
+
+}
+
+void JobSystem::Wait(JobHandle job){
+    uint32_t queue_index = GetQueueIndex();
+    while (!job->done.load(std::memory_order_acquire)){
+        if (!RunOne(queue_index)){
+            std::this_thread::yield();
+        }
+    }
+
+}
+
+void JobSystem::WaitAll(){
+    uint32_t queue_index = GetQueueIndex();
+    while (pending_jobs.load(std::memory_order_acquire) != 0){
+        if (!RunOne(queue_index)){
+            std::this_thread::yield();
+        }
+    }
+    std::lock_guard lock(pool_mutex);
+    pool.clear();
+
+}
+
+uint32_t JobSystem::GetThreadCount() const {
+    return queues.size();
+
+}
+
+uint32_t JobSystem::GetQueueIndex() const {
+    return current_system == this ? current_queue : queues.size() - 1;
+
+}
+
+void JobSystem::Enqueue(Job* job){
+    Queue& queue = *queues[GetQueueIndex()];
+    // Counted first so it never drops below the real number of queued jobs
+    queued_jobs++;
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    // Taking the lock orders this with a worker checking queued_jobs before it sleeps
+    {
+        std::lock_guard lock(sleep_mutex);
+    }
+    work_available.notify_one();
+
+}
+
+JobSystem::Job* JobSystem::Take(uint32_t queue_index){
+    {
+        Queue& own = *queues[queue_index];
+        std::lock_guard lock(own.mutex);
+        if (!own.jobs.empty()){
+            Job* job = own.jobs.back();
+            own.jobs.pop_back();
+            queued_jobs--;
+            return job;
+        }
+    }
+    for (uint32_t offset = 1; offset < queues.size(); offset++){
+        Queue& victim = *queues[(queue_index + offset) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.jobs.empty()){
+            Job* job = victim.jobs.front();
+            victim.jobs.pop_front();
+            queued_jobs--;
+            return job;
+        }
+    }
+    return nullptr;
+
+}
+
+bool JobSystem::RunOne(uint32_t queue_index){
+    Job* job = Take(queue_index);
+    if (job == nullptr){
+        return false;
+    }
+    {
+        PROFILE_SCOPE("job");
+        job->task();
+    }
+    Finish(job);
+    return true;
+
+}
+
+void JobSystem::Finish(Job* job){
+    std::vector<Job*> dependents;
+    {
+        std::lock_guard lock(job->mutex);
+        job->done.store(true, std::memory_order_release);
+        dependents.swap(job->dependents);
+    }
+    for (Job* dependent : dependents){
+        if (--dependent->unfinished_dependencies == 0){
+            Enqueue(dependent);
+        }
+    }
+    pending_jobs.fetch_sub(1, std::memory_order_release);
+
+}
+
+void JobSystem::WorkerLoop(uint32_t queue_index){
+    current_system = this;
+    current_queue = queue_index;
+    PROFILE_THREAD("jobs");
+    while (true){
+        if (RunOne(queue_index)){
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex);
+        work_available.wait(lock, [this]{ return queued_jobs.load() > 0 || stopping; });
+        if (stopping && queued_jobs.load() == 0){
+            return;
+        }
+    }
+
+}
+
+std::unique_ptr<WorkerThread> WorkerThread::New(){
+    std::unique_ptr<WorkerThread> worker(new WorkerThread());
+    worker->thread = std::thread(&WorkerThread::Loop, worker.get());
+    return worker;
+
+}
+
+WorkerThread::~WorkerThread(){
+    Wait();
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    thread.join();
+
+}
+
+void WorkerThread::Start(std::function<void()> task){
+    {
+        std::lock_guard lock(mutex);
+        this->task = std::move(task);
+        busy = true;
+    }
+    changed.notify_all();
+
+}
+
+void WorkerThread::Wait(){
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [this]{ return !busy; });
+
+}
+
+void WorkerThread::Loop(){
+    std::unique_lock lock(mutex);
+    while (true){
+        changed.wait(lock, [this]{ return busy || stopping; });
+        if (stopping){
+            return;
+        }
+        lock.unlock();
+        task();
+        lock.lock();
+        task = nullptr;
+        busy = false;
+        changed.notify_all();
+    }
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing scheduler. Every worker owns a queue, takes its newest job first and steals the
+// oldest job of another queue when its own runs dry. Threads that are not workers share one more
+// queue and help run jobs while they wait, so a JobSystem without workers still makes progress.
+struct JobSystem {
+    struct Job {
+        std::function<void()> task = {};
+        std::atomic<uint32_t> unfinished_dependencies = 1; // Held at one while Submit links it up
+        std::atomic<bool> done = false;
+        std::mutex mutex = {};
+        std::vector<Job*> dependents = {};
+    };
+
+    // Valid until the next WaitAll
+    using JobHandle = Job*;
+
+    // thread_count includes the calling thread, 0 uses every hardware thread
+    static std::unique_ptr<JobSystem> New(uint32_t thread_count = 0);
+
+    ~JobSystem();
+
+    // Runs task once every dependency has finished
+    JobHandle Submit(std::function<void()> task, const std::vector<JobHandle>& dependencies = {});
+
+    // Splits [0, count) into batches of batch_size and runs body(start, end) for each. The
+    // returned job finishes after every batch.
+    JobHandle ParallelForAsync(
+        uint32_t count,
+        uint32_t batch_size,
+        std::function<void(uint32_t start, uint32_t end)> body,
+        const std::vector<JobHandle>& dependencies = {}
+    );
+
+    void ParallelFor(uint32_t count, uint32_t batch_size, std::function<void(uint32_t start, uint32_t end)> body);
+
+    // Runs other jobs until this one is done
+    void Wait(JobHandle job);
+
+    // Barrier: runs jobs until none are left, then frees them all
+    void WaitAll();
+
+    uint32_t GetThreadCount() const;
+
+private:
+    struct Queue {
+        std::mutex mutex = {};
+        std::deque<Job*> jobs = {};
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues = {}; // One per worker, the last is shared by other threads
+    std::vector<std::thread> workers = {};
+
+    std::mutex pool_mutex = {};
+    std::deque<Job> pool = {};
+
+    std::atomic<uint32_t> queued_jobs = 0;
+    std::atomic<uint32_t> pending_jobs = 0;
+    std::mutex sleep_mutex = {};
+    std::condition_variable work_available = {};
+    bool stopping = false;
+
+    uint32_t GetQueueIndex() const;
+
+    void Enqueue(Job* job);
+
+    Job* Take(uint32_t queue_index);
+
+    bool RunOne(uint32_t queue_index);
+
+    void Finish(Job* job);
+
+    void WorkerLoop(uint32_t queue_index);
+};
+
+// One long-lived thread that runs a single task at a time, for work that spans a whole frame
+struct WorkerThread {
+    static std::unique_ptr<WorkerThread> New();
+
+    ~WorkerThread();
+
+    // The previous task must have been waited for
+    void Start(std::function<void()> task);
+
+    void Wait();
+
+private:
+    std::mutex mutex = {};
+    std::condition_variable changed = {};
+    std::function<void()> task = {};
+    bool busy = false;
+    bool stopping = false;
+    std::thread thread = {};
+
+    void Loop();
+};
@@ -0,0 +1,188 @@
+#include "journal.h"
+#include "level_format.h"
+
+#include <iostream>
+
+namespace {
+
+    uint32_t ZigZag(int64_t value){
+        return (uint32_t)((value << 1) ^ (value >> 63));
+    }
+
+    int64_t UnZigZag(uint32_t value){
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+} // namespace
+
+EditJournal EditJournal::New(size_t memory_budget){
+    EditJournal journal;
+    journal.memory_budget = memory_budget;
+    return journal;
+
+}
+
+void EditJournal::BeginStroke(const Grid& grid){
+    if (grid.id != grid_id){
+        Clear();
+        grid_id = grid.id;
+    }
+    open_edits.clear();
+    stroke_open = true;
+
+}
+
+std::vector<TileEdit>* EditJournal::GetRecorder(){
+    return stroke_open ? &open_edits : nullptr;
+
+}
+
+void EditJournal::Record(TileEdit edit){
+    if (!stroke_open){
+        return;
+    }
+    if (!open_edits.empty()){
+        TileEdit& last = open_edits.back();
+        if (last.y == edit.y && last.x + last.length == edit.x && last.old_type == edit.old_type && last.new_type == edit.new_type){
+            last.length += edit.length;
+            return;
+        }
+    }
+    open_edits.push_back(edit);
+
+}
+
+void EditJournal::EndStroke(){
+    if (!stroke_open){
+        return;
+    }
+    stroke_open = false;
+    if (open_edits.empty()){
+        return;
+    }
+
+    Stroke stroke = Encode(open_edits);
+    open_edits.clear();
+    open_edits.shrink_to_fit();
+    if (stroke.data.size() > memory_budget){
+        std::cout << std::endl << "Edit of " << stroke.data.size() << " bytes is over the undo budget, history cleared";
+        Clear();
+        return;
+    }
+
+    for (const Stroke& redo : redo_strokes){
+        used_bytes -= redo.data.size();
+    }
+    redo_strokes.clear();
+    used_bytes += stroke.data.size();
+    undo_strokes.push_back(std::move(stroke));
+    TrimToBudget();
+
+}
+
+bool EditJournal::IsStrokeOpen() const {
+    return stroke_open;
+
+}
+
+TileRegion EditJournal::Undo(Grid& grid){
+    if (grid.id != grid_id){
+        Clear();
+        grid_id = grid.id;
+    }
+    if (stroke_open || undo_strokes.empty()){
+        return {};
+    }
+    Stroke stroke = std::move(undo_strokes.back());
+    undo_strokes.pop_back();
+    TileRegion changed = grid.ApplyEdits(Decode(stroke), true);
+    redo_strokes.push_back(std::move(stroke));
+    return changed;
+
+}
+
+TileRegion EditJournal::Redo(Grid& grid){
+    if (grid.id != grid_id){
+        Clear();
+        grid_id = grid.id;
+    }
+    if (stroke_open || redo_strokes.empty()){
+        return {};
+    }
+    Stroke stroke = std::move(redo_strokes.back());
+    redo_strokes.pop_back();
+    TileRegion changed = grid.ApplyEdits(Decode(stroke), false);
+    undo_strokes.push_back(std::move(stroke));
+    return changed;
+
+}
+
+void EditJournal::Clear(){
+    undo_strokes.clear();
+    redo_strokes.clear();
+    open_edits.clear();
+    stroke_open = false;
+    used_bytes = 0;
+
+}
+
+EditJournal::Stroke EditJournal::Encode(const std::vector<TileEdit>& edits){
+    // Runs mostly follow on from the one before, so positions are stored as small offsets
+    Stroke stroke;
+    stroke.edit_count = edits.size();
+    int64_t previous_x = 0;
+    int64_t previous_y = 0;
+    for (const TileEdit& edit : edits){
+        LevelFormat::WriteVarint(stroke.data, ZigZag((int64_t)edit.x - previous_x));
+        LevelFormat::WriteVarint(stroke.data, ZigZag((int64_t)edit.y - previous_y));
+        LevelFormat::WriteVarint(stroke.data, edit.length);
+        LevelFormat::WriteVarint(stroke.data, edit.old_type);
+        LevelFormat::WriteVarint(stroke.data, edit.new_type);
+        previous_x = edit.x + edit.length;
+        previous_y = edit.y;
+    }
+    stroke.data.shrink_to_fit();
+    return stroke;
+
+}
+
+std::vector<TileEdit> EditJournal::Decode(const Stroke& stroke){
+    std::vector<TileEdit> edits;
+    edits.reserve(stroke.edit_count);
+    const uint8_t* data = stroke.data.data();
+    const uint8_t* end = data + stroke.data.size();
+    int64_t previous_x = 0;
+    int64_t previous_y = 0;
+    for (uint32_t i = 0; i < stroke.edit_count; i++){
+        uint32_t x, y, length, old_type, new_type;
+        bool read = LevelFormat::ReadVarint(data, end, x)
+            && LevelFormat::ReadVarint(data, end, y)
+            && LevelFormat::ReadVarint(data, end, length)
+            && LevelFormat::ReadVarint(data, end, old_type)
+            && LevelFormat::ReadVarint(data, end, new_type);
+        if (!read){
+            std::cout << std::endl << "Error decoding undo step: truncated after " << i << " edits";
+            break;
+        }
+        TileEdit edit = {
+            (uint32_t)(previous_x + UnZigZag(x)),
+            (uint32_t)(previous_y + UnZigZag(y)),
+            length,
+            (uint16_t)old_type,
+            (uint16_t)new_type
+        };
+        edits.push_back(edit);
+        previous_x = edit.x + edit.length;
+        previous_y = edit.y;
+    }
+    return edits;
+
+}
+
+void EditJournal::TrimToBudget(){
+    while (used_bytes > memory_budget && !undo_strokes.empty()){
+        used_bytes -= undo_strokes.front().data.size();
+        undo_strokes.pop_front();
+    }
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "grid.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Editor undo history. Every edit made between BeginStroke and EndStroke becomes one undo step,
+// stored as its TileEdit runs varint encoded relative to the run before. Only changed tiles are
+// kept, never grid snapshots, and the oldest steps are dropped to stay inside memory_budget.
+struct EditJournal {
+    struct Stroke {
+        std::vector<uint8_t> data = {};
+        uint32_t edit_count = 0;
+    };
+
+    size_t memory_budget = 0;
+    std::deque<Stroke> undo_strokes = {};
+    std::vector<Stroke> redo_strokes = {};
+    size_t used_bytes = 0;
+    // History belongs to one grid and is dropped when a different one is loaded
+    uint64_t grid_id = 0;
+
+    static EditJournal New(size_t memory_budget);
+
+    void BeginStroke(const Grid& grid);
+
+    // Where bulk edits append their changes while a stroke is open, null otherwise
+    std::vector<TileEdit>* GetRecorder();
+
+    // For single tile edits, ignored unless a stroke is open
+    void Record(TileEdit edit);
+
+    void EndStroke();
+
+    bool IsStrokeOpen() const;
+
+    // Return the region they changed, empty if there was nothing to undo or redo
+    TileRegion Undo(Grid& grid);
+
+    TileRegion Redo(Grid& grid);
+
+    void Clear();
+
+private:
+    std::vector<TileEdit> open_edits = {};
+    bool stroke_open = false;
+
+    static Stroke Encode(const std::vector<TileEdit>& edits);
+
+    static std::vector<TileEdit> Decode(const Stroke& stroke);
+
+    void TrimToBudget();
+};
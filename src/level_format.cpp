@@ -0,0 +1,339 @@
+#include "level_format.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace LevelFormat {
+
+namespace {
+
+    constexpr std::array<uint32_t, 256> CRC_TABLE = []{
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; i++){
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++){
+                value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+            }
+            table[i] = value;
+        }
+        return table;
+    }();
+
+} // namespace
+
+void WriteVarint(std::vector<uint8_t>& output, uint32_t value){
+    while (value >= 0x80){
+        output.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<uint8_t>(value));
+}
+
+bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value){
+    value = 0;
+    for (int shift = 0; shift < 35 && data < end; shift += 7){
+        uint8_t byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc){
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++){
+        crc = CRC_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t HeaderChecksum(const Header& header, const void* directory){
+    Header copy = header;
+    copy.checksum = 0;
+    uint32_t crc = Crc32(reinterpret_cast<const uint8_t*>(&copy), sizeof(Header));
+    return Crc32(
+        static_cast<const uint8_t*>(directory),
+        sizeof(ChunkEntry) * header.chunks_x * header.chunks_y,
+        crc
+    );
+}
+
+Header MakeHeader(const Grid& grid){
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.chunk_shift = Grid::CHUNK_SHIFT;
+    header.width = grid.size_x;
+    header.height = grid.size_y;
+    header.chunks_x = grid.chunks_x;
+    header.chunks_y = grid.chunks_y;
+    return header;
+}
+
+bool IsHeaderValid(const Header& header){
+    return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+        && header.version == VERSION
+        && header.chunk_shift == Grid::CHUNK_SHIFT
+        && header.chunks_x == (header.width + Grid::CHUNK_MASK) >> Grid::CHUNK_SHIFT
+        && header.chunks_y == (header.height + Grid::CHUNK_MASK) >> Grid::CHUNK_SHIFT;
+}
+
+bool IsChunkAir(const Tile* tiles){
+    for (uint32_t i = 0; i < Grid::CHUNK_AREA; i++){
+        if (tiles[i].type != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+void EncodeChunk(const Tile* tiles, std::vector<uint8_t>& output){
+    uint32_t i = 0;
+    while (i < Grid::CHUNK_AREA){
+        uint16_t type = tiles[i].type;
+        uint32_t run = 1;
+        while (i + run < Grid::CHUNK_AREA && tiles[i + run].type == type){
+            run++;
+        }
+        WriteVarint(output, type);
+        WriteVarint(output, run);
+        i += run;
+    }
+}
+
+bool DecodeChunk(const uint8_t* data, size_t size, Tile* tiles){
+    const uint8_t* end = data + size;
+    uint32_t i = 0;
+    while (data < end){
+        uint32_t type, run;
+        if (!ReadVarint(data, end, type) || !ReadVarint(data, end, run)){
+            return false;
+        }
+        if (type > UINT16_MAX || run == 0 || run > Grid::CHUNK_AREA - i){
+            return false;
+        }
+        std::fill_n(tiles + i, run, Tile{static_cast<uint16_t>(type)});
+        i += run;
+    }
+    return i == Grid::CHUNK_AREA;
+}
+
+bool WriteFileAtomic(const std::string& path, const std::vector<uint8_t>& data){
+    return WriteFileAtomic(path, [&](std::ostream& file){
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        return true;
+    });
+}
+
+bool WriteFileAtomic(const std::string& path, const std::function<bool(std::ostream&)>& write){
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()){
+            std::cout << "Error writing " << path << ": could not open " << temp_path << std::endl;
+            return false;
+        }
+        bool written = write(file);
+        file.flush();
+        if (!written || !file.good()){
+            std::cout << "Error writing " << path << ": write to " << temp_path << " failed" << std::endl;
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error){
+        std::cout << "Error writing " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+std::optional<ChunkFile> ChunkFile::Open(const std::string& path, bool verify_checksum){
+    ChunkFile chunk_file;
+    chunk_file.path = path;
+    chunk_file.file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!chunk_file.file.is_open()){
+        std::cout << "Error opening " << path << " for update: could not open" << std::endl;
+        return std::nullopt;
+    }
+
+    Header& header = chunk_file.header;
+    chunk_file.file.read(reinterpret_cast<char*>(&header), sizeof(Header));
+    if (!chunk_file.file || !IsHeaderValid(header)){
+        std::cout << "Error opening " << path << " for update: not a version " << VERSION << " level" << std::endl;
+        return std::nullopt;
+    }
+
+    chunk_file.directory.resize((size_t)header.chunks_x * header.chunks_y);
+    chunk_file.file.read(
+        reinterpret_cast<char*>(chunk_file.directory.data()),
+        chunk_file.directory.size() * sizeof(ChunkEntry)
+    );
+    if (!chunk_file.file || (verify_checksum && HeaderChecksum(header, chunk_file.directory.data()) != header.checksum)){
+        std::cout << "Error opening " << path << " for update: corrupt chunk directory" << std::endl;
+        return std::nullopt;
+    }
+    chunk_file.file.seekg(0, std::ios::end);
+    chunk_file.file_end = chunk_file.file.tellg();
+    for (const ChunkEntry& entry : chunk_file.directory){
+        chunk_file.live_bytes += entry.size;
+    }
+    return chunk_file;
+}
+
+bool ChunkFile::Read(uint32_t chunk, std::vector<uint8_t>& payload){
+    const ChunkEntry& entry = directory[chunk];
+    payload.resize(entry.size);
+    if (entry.size == 0){
+        return true;
+    }
+    file.seekg(entry.offset);
+    file.read(reinterpret_cast<char*>(payload.data()), payload.size());
+    if (!file || Crc32(payload.data(), payload.size()) != entry.checksum){
+        file.clear();
+        return false;
+    }
+    return true;
+}
+
+void ChunkFile::Write(const ChunkPayload& payload){
+    ChunkEntry& entry = directory[payload.chunk];
+    live_bytes -= entry.size;
+    entry = {0, 0, 0};
+    if (!payload.data.empty()){
+        entry = {
+            file_end,
+            static_cast<uint32_t>(payload.data.size()),
+            Crc32(payload.data.data(), payload.data.size())
+        };
+        file.seekp(file_end);
+        file.write(reinterpret_cast<const char*>(payload.data.data()), payload.data.size());
+        file_end += payload.data.size();
+        live_bytes += entry.size;
+    }
+
+    file.seekp(sizeof(Header) + (uint64_t)payload.chunk * sizeof(ChunkEntry));
+    file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+}
+
+bool ChunkFile::Commit(){
+    header.checksum = HeaderChecksum(header, directory.data());
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.flush();
+    return file.good();
+}
+
+bool ChunkFile::Patch(const std::vector<ChunkPayload>& chunks){
+    std::string journal_path = path + JOURNAL_EXTENSION;
+    std::vector<uint8_t> journal;
+    EncodeJournal(directory.size(), chunks, journal);
+    if (!WriteFileAtomic(journal_path, journal)){
+        return false;
+    }
+    for (const ChunkPayload& payload : chunks){
+        Write(payload);
+    }
+    if (!Commit()){
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::remove(journal_path, error);
+    return true;
+}
+
+void EncodeJournal(uint32_t directory_size, const std::vector<ChunkPayload>& chunks, std::vector<uint8_t>& output){
+    size_t start = output.size();
+    output.resize(start + sizeof(JournalHeader));
+    for (const ChunkPayload& payload : chunks){
+        uint32_t fields[2] = {payload.chunk, static_cast<uint32_t>(payload.data.size())};
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(fields);
+        output.insert(output.end(), bytes, bytes + sizeof(fields));
+        output.insert(output.end(), payload.data.begin(), payload.data.end());
+    }
+
+    JournalHeader header{};
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header.chunk_count = chunks.size();
+    header.directory_size = directory_size;
+    header.size = output.size() - start - sizeof(JournalHeader);
+    header.checksum = Crc32(output.data() + start + sizeof(JournalHeader), header.size);
+    std::memcpy(output.data() + start, &header, sizeof(header));
+}
+
+bool DecodeJournal(const uint8_t* data, size_t size, uint32_t directory_size, std::vector<ChunkPayload>& chunks){
+    JournalHeader header;
+    if (size < sizeof(header)){
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0
+        || header.directory_size != directory_size
+        || header.size != size - sizeof(header)
+        || Crc32(data + sizeof(header), header.size) != header.checksum){
+        return false;
+    }
+
+    const uint8_t* cursor = data + sizeof(header);
+    const uint8_t* end = data + size;
+    for (uint32_t i = 0; i < header.chunk_count; i++){
+        uint32_t fields[2];
+        if ((size_t)(end - cursor) < sizeof(fields)){
+            return false;
+        }
+        std::memcpy(fields, cursor, sizeof(fields));
+        cursor += sizeof(fields);
+        if (fields[0] >= directory_size || fields[1] > (size_t)(end - cursor)){
+            return false;
+        }
+        chunks.push_back({fields[0], std::vector<uint8_t>(cursor, cursor + fields[1])});
+        cursor += fields[1];
+    }
+    return cursor == end;
+}
+
+bool ReplayJournal(const std::string& path){
+    std::string journal_path = path + JOURNAL_EXTENSION;
+    if (!std::filesystem::exists(journal_path)){
+        return true;
+    }
+
+    std::optional<ChunkFile> chunk_file = ChunkFile::Open(path, false);
+    if (!chunk_file.has_value()){
+        return false;
+    }
+    std::vector<ChunkPayload> chunks;
+    bool complete = false;
+    {
+        auto journal = MappedFile::Open(journal_path);
+        complete = journal.has_value() && DecodeJournal(journal->data, journal->size, chunk_file->directory.size(), chunks);
+    }
+    // An incomplete journal was cut short before the level itself was touched
+    if (complete){
+        std::cout << "Recovering " << chunks.size() << " chunks of " << path << " from its journal" << std::endl;
+        for (const ChunkPayload& payload : chunks){
+            chunk_file->Write(payload);
+        }
+        if (!chunk_file->Commit()){
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::remove(journal_path, error);
+    return true;
+}
+
+} // namespace LevelFormat
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "grid.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Binary level format (.cave), little-endian:
+//   Header
+//   ChunkEntry[chunks_x * chunks_y]   row-major chunk directory
+//   chunk payloads                    run-length encoded tiles, addressed by the directory
+// A payload is a list of (varint type, varint run length) pairs covering CHUNK_AREA tiles in
+// row-major order. All-air chunks have no payload (size 0).
+namespace LevelFormat {
+
+static_assert(std::endian::native == std::endian::little, "Level format is read in place as little-endian");
+
+constexpr char MAGIC[4] = {'C', 'A', 'V', 'E'};
+constexpr uint16_t VERSION = 1;
+constexpr const char* EXTENSION = ".cave";
+
+struct Header {
+    char magic[4];
+    uint16_t version;
+    uint16_t chunk_shift;
+    uint32_t width;
+    uint32_t height;
+    uint32_t chunks_x;
+    uint32_t chunks_y;
+    uint32_t reserved;
+    uint32_t checksum; // CRC32 of the header (with this field zeroed) followed by the directory
+};
+static_assert(sizeof(Header) == 32);
+
+struct ChunkEntry {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t checksum; // CRC32 of the payload
+};
+static_assert(sizeof(ChunkEntry) == 16);
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+uint32_t HeaderChecksum(const Header& header, const void* directory);
+
+Header MakeHeader(const Grid& grid);
+
+bool IsHeaderValid(const Header& header);
+
+bool IsChunkAir(const Tile* tiles);
+
+void WriteVarint(std::vector<uint8_t>& output, uint32_t value);
+
+bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value);
+
+void EncodeChunk(const Tile* tiles, std::vector<uint8_t>& output);
+
+// Returns false if the payload is malformed or does not cover exactly CHUNK_AREA tiles
+bool DecodeChunk(const uint8_t* data, size_t size, Tile* tiles);
+
+// Writes to path + ".tmp" and renames it over path, so a crash never leaves a half written file
+bool WriteFileAtomic(const std::string& path, const std::vector<uint8_t>& data);
+
+// Same, for output produced a piece at a time. write returns false to abandon the file.
+bool WriteFileAtomic(const std::string& path, const std::function<bool(std::ostream&)>& write);
+
+// Encoded contents of one chunk, data is empty for an all-air chunk
+struct ChunkPayload {
+    uint32_t chunk;
+    std::vector<uint8_t> data;
+};
+
+// A level file opened for reading and replacing single chunks. New payloads are appended and
+// their directory entries rewritten in place, so an update costs what it writes. The old payloads
+// stay behind as garbage until the file is saved whole again. Commit makes the directory checksum
+// match again, a crash before it leaves the file unreadable, which is what the journal below
+// covers for. Patch does all of it in the safe order.
+struct ChunkFile {
+    std::string path = {};
+    std::fstream file = {};
+    Header header = {};
+    std::vector<ChunkEntry> directory = {};
+    uint64_t file_end = 0;
+    uint64_t live_bytes = 0; // Payload bytes the directory still points at
+
+    // verify_checksum is off when recovering a file whose last update was interrupted
+    static std::optional<ChunkFile> Open(const std::string& path, bool verify_checksum = true);
+
+    // The chunk's payload checked against its directory entry, empty for an all-air chunk.
+    // Returns false if it could not be read or does not match.
+    bool Read(uint32_t chunk, std::vector<uint8_t>& payload);
+
+    void Write(const ChunkPayload& payload);
+
+    bool Commit();
+
+    // Journals the batch next to the file, writes and commits it, then removes the journal. If it
+    // returns false after the journal was written, the journal stays for ReplayJournal.
+    bool Patch(const std::vector<ChunkPayload>& chunks);
+};
+
+// Journal (<level>.cave.journal), written before a batch of chunks is patched into a level and
+// removed once the level is committed:
+//   JournalHeader
+//   per chunk: uint32 chunk, uint32 size, payload
+// A batch whose checksum does not match was cut short by a crash and is ignored.
+constexpr char JOURNAL_MAGIC[4] = {'C', 'J', 'N', 'L'};
+constexpr const char* JOURNAL_EXTENSION = ".journal";
+
+struct JournalHeader {
+    char magic[4];
+    uint32_t chunk_count;
+    uint32_t directory_size; // chunks_x * chunks_y of the level the batch belongs to
+    uint32_t checksum;       // CRC32 of everything after the header
+    uint64_t size;           // Bytes after the header
+};
+static_assert(sizeof(JournalHeader) == 24);
+
+void EncodeJournal(uint32_t directory_size, const std::vector<ChunkPayload>& chunks, std::vector<uint8_t>& output);
+
+// Returns false if the journal is cut short, corrupt or belongs to a level of another size
+bool DecodeJournal(const uint8_t* data, size_t size, uint32_t directory_size, std::vector<ChunkPayload>& chunks);
+
+// Finishes a patch that was interrupted by a crash: applies a complete journal next to the level
+// at path and removes it. Returns false only if a complete journal could not be applied.
+bool ReplayJournal(const std::string& path);
+
+} // namespace LevelFormat
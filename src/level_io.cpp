@@ -0,0 +1,108 @@
+#include "level_io.h"
+#include "profiler.h"
+
+std::unique_ptr<LevelIO> LevelIO::New(){
+    auto level_io = std::make_unique<LevelIO>();
+    level_io->worker = WorkerThread::New();
+    return level_io;
+
+}
+
+LevelIO::~LevelIO(){
+    worker->Wait();
+
+}
+
+bool LevelIO::Start(Operation new_operation, std::string new_filename){
+    if (status.load() != IDLE){
+        return false;
+    }
+    operation = new_operation;
+    filename = std::move(new_filename);
+    progress.store(0);
+    status.store(RUNNING);
+    return true;
+
+}
+
+bool LevelIO::StartSave(const Grid& source, std::string new_filename){
+    if (!Start(SAVE, std::move(new_filename))){
+        return false;
+    }
+    copy = GridCopy::New(source);
+    copying = true;
+    return true;
+
+}
+
+void LevelIO::Update(const Grid& source, uint32_t max_copy_chunks){
+    if (!copying){
+        return;
+    }
+    if (!copy->IsFollowing(source)){
+        copying = false;
+        copy.reset();
+        status.store(FAILED);
+        return;
+    }
+    if (!copy->Step(source, max_copy_chunks)){
+        return;
+    }
+    copying = false;
+    worker->Start([this]{
+        PROFILE_THREAD("level io");
+        PROFILE_SCOPE("save level");
+        bool saved = copy->grid.SaveToFile(filename, &progress);
+        copy.reset();
+        status.store(saved ? SUCCEEDED : FAILED);
+    });
+
+}
+
+bool LevelIO::StartLoad(std::string new_filename){
+    if (!Start(LOAD, std::move(new_filename))){
+        return false;
+    }
+    worker->Start([this]{
+        PROFILE_THREAD("level io");
+        PROFILE_SCOPE("load level");
+        grid = Grid::LoadFromFile(filename, &progress);
+        status.store(grid.has_value() ? SUCCEEDED : FAILED);
+    });
+    return true;
+
+}
+
+LevelIO::Status LevelIO::GetStatus() const {
+    return status.load();
+
+}
+
+LevelIO::Operation LevelIO::GetOperation() const {
+    return operation;
+
+}
+
+const std::string& LevelIO::GetFilename() const {
+    return filename;
+
+}
+
+float LevelIO::GetProgress() const {
+    return progress.load(std::memory_order_relaxed);
+
+}
+
+std::optional<Grid> LevelIO::Finish(){
+    Status finished = status.load();
+    if (finished != SUCCEEDED && finished != FAILED){
+        return std::nullopt;
+    }
+    // The task sets the status last, this only waits for it to return
+    worker->Wait();
+    std::optional<Grid> result = std::move(grid);
+    grid.reset();
+    status.store(IDLE);
+    return result;
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "grid.h"
+#include "grid_copy.h"
+#include "jobs.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+// Saves and loads whole levels on a background thread so the game loop keeps running. A save
+// works on a copy of the grid, taken a slice per Update before the write starts, so later edits
+// never tear the file. One operation runs at a time, the game polls GetStatus and collects the
+// result.
+struct LevelIO {
+    enum Operation : uint8_t {
+        NONE,
+        SAVE,
+        LOAD
+    };
+
+    enum Status : uint8_t {
+        IDLE,
+        RUNNING,
+        SUCCEEDED,
+        FAILED
+    };
+
+    static std::unique_ptr<LevelIO> New();
+
+    // Waits for a running operation, so a save started before exit still completes
+    ~LevelIO();
+
+    // False if an operation is still running or its result has not been collected
+    bool StartSave(const Grid& grid, std::string filename);
+
+    // Copies up to max_copy_chunks more chunks of a starting save and writes it once the copy is
+    // complete. Call every tick, a save fails if a different grid is loaded before then.
+    void Update(const Grid& grid, uint32_t max_copy_chunks);
+
+    bool StartLoad(std::string filename);
+
+    Status GetStatus() const;
+
+    Operation GetOperation() const;
+
+    const std::string& GetFilename() const;
+
+    // 0 to 1 while running
+    float GetProgress() const;
+
+    // Collects a finished operation and returns to IDLE. Holds the grid of a successful load.
+    std::optional<Grid> Finish();
+
+private:
+    std::unique_ptr<WorkerThread> worker = nullptr;
+    std::atomic<Status> status = IDLE;
+    std::atomic<float> progress = 0;
+    Operation operation = NONE;
+    std::string filename = {};
+    std::optional<Grid> grid = {}; // The load's result
+    std::optional<GridCopy> copy = {}; // The save's copy
+    bool copying = false;
+
+    bool Start(Operation new_operation, std::string new_filename);
+};
@@ -0,0 +1,381 @@
+#include "level_json.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace LevelJson {
+
+namespace {
+
+    constexpr uint32_t MAX_DEPTH = 256; // Nesting allowed in skipped values
+
+    // Reads the level object straight off the bytes: rows go into a band of tiles that is copied
+    // into the grid a chunk high at a time. Values under other keys are checked and skipped.
+    struct Reader {
+        std::optional<Grid> grid = {};
+        std::string error = {};
+
+        Reader(const uint8_t* data, size_t size) : start(data), position(data), end(data + size) {}
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        bool Read(){
+            if (!Expect('{')){
+                return false;
+            }
+            if (!Consume('}')){
+                do {
+                    std::string key;
+                    if (!ReadString(&key) || !Expect(':')){
+                        return false;
+                    }
+                    bool read = key == "width" ? ReadDimension(width)
+                        : key == "height" ? ReadDimension(height)
+                        : key == "tiles" ? ReadTiles()
+                        : SkipValue(0);
+                    if (!read){
+                        return false;
+                    }
+                } while (Consume(','));
+                if (!Expect('}')){
+                    return false;
+                }
+            }
+            SkipWhitespace();
+            if (position != end){
+                return Fail("unexpected data after the level");
+            }
+
+            if (!width.has_value() || !height.has_value()){
+                return Fail("missing width or height");
+            }
+            if (rows != *height){
+                return Fail(std::to_string(rows) + " rows, height is " + std::to_string(*height));
+            }
+            Flush();
+            return true;
+        }
+
+    private:
+        const uint8_t* start;
+        const uint8_t* position;
+        const uint8_t* end;
+        std::optional<uint32_t> width = {};
+        std::optional<uint32_t> height = {};
+        std::optional<uint32_t> row_width = {}; // Length of the first row, all rows must match
+        uint32_t rows = 0;                      // Rows read so far
+        uint32_t band_start = 0;                // Row the first tile of band belongs to
+        uint32_t band_y = 0;                    // First row of band not yet in the grid
+        std::vector<Tile> band = {};            // Rows not yet written into the grid
+
+        bool Fail(const std::string& message){
+            if (error.empty()){
+                error = "byte " + std::to_string(position - start) + ": " + message;
+            }
+            return false;
+        }
+
+        static bool IsWhitespace(uint8_t character){
+            return character == ' ' || character == '\n' || character == '\r' || character == '\t';
+        }
+
+        void SkipWhitespace(){
+            while (position != end && IsWhitespace(*position)){
+                position++;
+            }
+        }
+
+        bool Consume(char character){
+            SkipWhitespace();
+            if (position != end && *position == character){
+                position++;
+                return true;
+            }
+            return false;
+        }
+
+        bool Expect(char character){
+            return Consume(character) || Fail(std::string("expected '") + character + "'");
+        }
+
+        // Digits of a non-negative integer, after whitespace
+        bool ReadUnsigned(uint64_t limit, uint64_t& value){
+            SkipWhitespace();
+            if (position == end || *position < '0' || *position > '9'){
+                return Fail("expected a non-negative integer");
+            }
+            value = 0;
+            while (position != end && *position >= '0' && *position <= '9'){
+                value = value * 10 + (*position++ - '0');
+                if (value > limit){
+                    return Fail("number out of range");
+                }
+            }
+            if (position != end && (*position == '.' || *position == 'e' || *position == 'E')){
+                return Fail("expected an integer");
+            }
+            return true;
+        }
+
+        bool ReadDimension(std::optional<uint32_t>& dimension){
+            uint64_t value;
+            if (!ReadUnsigned(UINT32_MAX, value)){
+                return false;
+            }
+            dimension = value;
+            return TryCreateGrid();
+        }
+
+        bool ReadTiles(){
+            if (!Expect('[')){
+                return false;
+            }
+            if (Consume(']')){
+                return true;
+            }
+            do {
+                if (!ReadRow()){
+                    return false;
+                }
+            } while (Consume(','));
+            return Expect(']');
+        }
+
+        // The hot loop. Works on a local cursor, since stores through the member could alias
+        // the bytes being read and force reloads.
+        bool ReadRow(){
+            if (!Consume('[')){
+                return Fail("tiles must be arrays of tile types");
+            }
+            size_t row_start = band.size();
+            if (!Consume(']')){
+                const uint8_t* cursor = position;
+                while (true){
+                    while (cursor != end && IsWhitespace(*cursor)){
+                        cursor++;
+                    }
+                    uint32_t type = 0;
+                    const uint8_t* digits = cursor;
+                    while (cursor != end && *cursor >= '0' && *cursor <= '9' && type <= UINT16_MAX){
+                        type = type * 10 + (*cursor++ - '0');
+                    }
+                    if (cursor == digits || type > UINT16_MAX || (cursor != end && (*cursor == '.' || *cursor == 'e' || *cursor == 'E'))){
+                        position = digits;
+                        return Fail(cursor == digits ? "expected a tile type" : "tile type out of range");
+                    }
+                    band.push_back(Tile{(uint16_t)type});
+                    while (cursor != end && IsWhitespace(*cursor)){
+                        cursor++;
+                    }
+                    if (cursor != end && *cursor == ','){
+                        cursor++;
+                        continue;
+                    }
+                    position = cursor;
+                    break;
+                }
+                if (!Expect(']')){
+                    return false;
+                }
+            }
+            return EndRow(band.size() - row_start);
+        }
+
+        bool EndRow(uint32_t length){
+            if (!row_width.has_value()){
+                row_width = length;
+                if (!TryCreateGrid()){
+                    return false;
+                }
+            } else if (length != *row_width){
+                return Fail("row " + std::to_string(rows) + " is " + std::to_string(length) + " tiles long, expected " + std::to_string(*row_width));
+            }
+            rows++;
+            if (height.has_value() && rows > *height){
+                return Fail("more rows than height " + std::to_string(*height));
+            }
+            // Bands line up with chunks, so each chunk is written once
+            if (grid.has_value() && rows % Grid::CHUNK_SIZE == 0){
+                Flush();
+            }
+            return true;
+        }
+
+        // The grid needs both dimensions. Older files put "width" after "tiles", so the first
+        // row's length stands in for it until then. Only when "tiles" comes before "height" are
+        // all rows held until the end.
+        bool TryCreateGrid(){
+            if (width.has_value() && row_width.has_value() && *width != *row_width){
+                return Fail("rows are " + std::to_string(*row_width) + " tiles long, width is " + std::to_string(*width));
+            }
+            std::optional<uint32_t> grid_width = width.has_value() ? width : row_width;
+            if (!grid.has_value() && grid_width.has_value() && height.has_value()){
+                grid.emplace(*grid_width, *height);
+            }
+            return true;
+        }
+
+        // Copies the band straight into chunk storage like the generator does, chunks that are
+        // all air in it stay unallocated
+        void Flush(){
+            for (uint32_t chunk_y = band_y >> Grid::CHUNK_SHIFT; band_y < rows; chunk_y++){
+                uint32_t end_y = std::min(rows, (chunk_y + 1) << Grid::CHUNK_SHIFT);
+                for (uint32_t chunk_x = 0; chunk_x < grid->chunks_x; chunk_x++){
+                    uint32_t start_x = chunk_x << Grid::CHUNK_SHIFT;
+                    uint32_t span = std::min(Grid::CHUNK_SIZE, *row_width - start_x);
+                    const Tile* source = &band[(size_t)(band_y - band_start) * *row_width + start_x];
+                    bool any = false;
+                    for (uint32_t y = band_y; y < end_y && !any; y++){
+                        const Tile* row = source + (size_t)(y - band_y) * *row_width;
+                        any = std::any_of(row, row + span, [](Tile tile){ return tile.type != 0; });
+                    }
+                    if (!any){
+                        continue;
+                    }
+                    Tile* tiles = grid->GetChunkTilesMutable(chunk_x, chunk_y);
+                    for (uint32_t y = band_y; y < end_y; y++){
+                        const Tile* row = source + (size_t)(y - band_y) * *row_width;
+                        std::copy(row, row + span, tiles + ((y & Grid::CHUNK_MASK) << Grid::CHUNK_SHIFT));
+                    }
+                    grid->TouchChunk(chunk_x, chunk_y);
+                }
+                band_y = end_y;
+            }
+            band_start = rows;
+            band.clear();
+        }
+
+        bool ReadString(std::string* text){
+            if (!Consume('"')){
+                return Fail("expected a string");
+            }
+            while (position != end && *position != '"'){
+                if (*position < 0x20){
+                    return Fail("control character in string");
+                }
+                if (*position == '\\'){
+                    // Escapes are kept as written, keys that need them are not ones we look for
+                    if (text != nullptr){
+                        text->push_back('\\');
+                    }
+                    if (++position == end){
+                        break;
+                    }
+                }
+                if (text != nullptr){
+                    text->push_back(*position);
+                }
+                position++;
+            }
+            return Expect('"');
+        }
+
+        bool SkipNumber(){
+            Consume('-');
+            const uint8_t* digits = position;
+            while (position != end && ((*position >= '0' && *position <= '9') || *position == '.' || *position == 'e' || *position == 'E' || *position == '+' || *position == '-')){
+                position++;
+            }
+            return position != digits || Fail("expected a value");
+        }
+
+        bool SkipLiteral(const char* literal){
+            for (; *literal != 0; literal++, position++){
+                if (position == end || *position != (uint8_t)*literal){
+                    return Fail("expected a value");
+                }
+            }
+            return true;
+        }
+
+        bool SkipValue(uint32_t depth){
+            if (depth > MAX_DEPTH){
+                return Fail("nested too deeply");
+            }
+            SkipWhitespace();
+            if (position == end){
+                return Fail("unexpected end of file");
+            }
+            switch (*position){
+                case '{':
+                    position++;
+                    if (Consume('}')){
+                        return true;
+                    }
+                    do {
+                        if (!ReadString(nullptr) || !Expect(':') || !SkipValue(depth + 1)){
+                            return false;
+                        }
+                    } while (Consume(','));
+                    return Expect('}');
+                case '[':
+                    position++;
+                    if (Consume(']')){
+                        return true;
+                    }
+                    do {
+                        if (!SkipValue(depth + 1)){
+                            return false;
+                        }
+                    } while (Consume(','));
+                    return Expect(']');
+                case '"':
+                    return ReadString(nullptr);
+                case 't':
+                    return SkipLiteral("true");
+                case 'f':
+                    return SkipLiteral("false");
+                case 'n':
+                    return SkipLiteral("null");
+                default:
+                    return SkipNumber();
+            }
+        }
+    };
+
+} // namespace
+
+std::optional<Grid> Read(const uint8_t* data, size_t size){
+    PROFILE_SCOPE("read json level");
+    Reader reader(data, size);
+    if (!reader.Read()){
+        std::cout << "Error loading grid from file: " << reader.error << std::endl;
+        return std::nullopt;
+    }
+    return std::move(reader.grid);
+
+}
+
+bool Write(const Grid& grid, std::ostream& output){
+    PROFILE_SCOPE("write json level");
+    output << "{\n    \"width\": " << grid.size_x << ",\n    \"height\": " << grid.size_y << ",\n    \"tiles\": [\n";
+
+    // Longest tile type plus its comma, for every tile of a row
+    std::vector<char> line(grid.size_x * 6 + 16);
+    for (uint32_t y = 0; y < grid.size_y && output.good(); y++){
+        char* end = line.data();
+        end = std::copy_n("        [", 9, end);
+        for (uint32_t x = 0; x < grid.size_x; x++){
+            if (x != 0){
+                *end++ = ',';
+            }
+            end = std::to_chars(end, line.data() + line.size(), grid.GetTileUnchecked(x, y).type).ptr;
+        }
+        *end++ = ']';
+        if (y + 1 != grid.size_y){
+            *end++ = ',';
+        }
+        *end++ = '\n';
+        output.write(line.data(), end - line.data());
+    }
+
+    output << "    ]\n}\n";
+    return output.good();
+
+}
+
+} // namespace LevelJson
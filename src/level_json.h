@@ -0,0 +1,23 @@
+#pragma once
+
+#include "grid.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+
+// JSON levels, the format levels were saved in before .cave:
+//   {"width": W, "height": H, "tiles": [[type, ...], ...]}   H rows of W tile types
+// Keys may come in any order. Both directions stream, neither builds a document in memory.
+namespace LevelJson {
+
+// Single pass over the bytes, writing rows into the grid a chunk high band at a time, so memory
+// stays close to the grid's own. Only when "tiles" comes before "height" are the rows held
+// until the grid can be made.
+std::optional<Grid> Read(const uint8_t* data, size_t size);
+
+// One row per line, written as it is formatted. Returns false when the stream failed.
+bool Write(const Grid& grid, std::ostream& output);
+
+} // namespace LevelJson
@@ -0,0 +1,385 @@
+#include "lighting.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+    // Right, left, down, up. Down is where sky light keeps its level
+    constexpr int32_t DIRECTION_X[4] = {1, -1, 0, 0};
+    constexpr int32_t DIRECTION_Y[4] = {0, 0, 1, -1};
+    constexpr int DOWN = 2;
+
+    inline uint32_t GetChunk(const LightMap& light, uint32_t x, uint32_t y){
+        return (y >> Grid::CHUNK_SHIFT) * light.chunks_x + (x >> Grid::CHUNK_SHIFT);
+    }
+
+    inline uint32_t GetLocal(uint32_t x, uint32_t y){
+        return ((y & Grid::CHUNK_MASK) << Grid::CHUNK_SHIFT) + (x & Grid::CHUNK_MASK);
+    }
+
+    inline uint8_t Attenuate(uint8_t level, int direction, LightMap::Channel channel){
+        if (channel == LightMap::SKY && direction == DOWN && level == LightMap::MAX_LIGHT){
+            return level;
+        }
+        return level - 1;
+    }
+
+} // namespace
+
+LightMap LightMap::New(uint32_t width, uint32_t height){
+    LightMap light;
+    light.size_x = width;
+    light.size_y = height;
+    light.chunks_x = (width + Grid::CHUNK_MASK) >> Grid::CHUNK_SHIFT;
+    light.chunks_y = (height + Grid::CHUNK_MASK) >> Grid::CHUNK_SHIFT;
+    light.chunk_index.assign(light.chunks_x * light.chunks_y, DARK_CHUNK);
+    light.chunk_light.assign(Grid::CHUNK_AREA, 0);
+    light.chunk_revisions.assign(light.chunks_x * light.chunks_y, 0);
+    light.lit_revisions.assign(light.chunks_x * light.chunks_y, UNLIT);
+    return light;
+
+}
+
+uint8_t LightMap::GetLight(uint32_t x, uint32_t y) const {
+    if (x >= size_x || y >= size_y){
+        return 0;
+    }
+    uint8_t value = chunk_light[(size_t)chunk_index[GetChunk(*this, x, y)] * Grid::CHUNK_AREA + GetLocal(x, y)];
+    return std::max<uint8_t>(value >> 4, value & 0xF);
+
+}
+
+uint8_t LightMap::GetChannel(uint32_t x, uint32_t y, Channel channel) const {
+    uint8_t value = chunk_light[(size_t)chunk_index[GetChunk(*this, x, y)] * Grid::CHUNK_AREA + GetLocal(x, y)];
+    return channel == SKY ? value >> 4 : value & 0xF;
+
+}
+
+void LightMap::SetChannel(uint32_t x, uint32_t y, Channel channel, uint8_t level){
+    uint32_t chunk = GetChunk(*this, x, y);
+    uint32_t& slot = chunk_index[chunk];
+    if (slot == DARK_CHUNK){
+        if (level == 0){
+            return;
+        }
+        if (!free_slots.empty()){
+            slot = free_slots.back();
+            free_slots.pop_back();
+            std::fill_n(&chunk_light[(size_t)slot * Grid::CHUNK_AREA], Grid::CHUNK_AREA, 0);
+        } else {
+            slot = chunk_light.size() / Grid::CHUNK_AREA;
+            chunk_light.resize(chunk_light.size() + Grid::CHUNK_AREA, 0);
+        }
+    }
+
+    uint8_t& value = chunk_light[(size_t)slot * Grid::CHUNK_AREA + GetLocal(x, y)];
+    value = channel == SKY ? (value & 0x0F) | (level << 4) : (value & 0xF0) | level;
+    chunk_revisions[chunk]++;
+
+}
+
+uint8_t LightMap::GetSourceLevel(const Grid& grid, uint32_t x, uint32_t y, Channel channel) const {
+    uint16_t type = grid.GetTileUnchecked(x, y).type;
+    if (channel == BLOCK){
+        return GetTileEmission(type);
+    }
+    return (y == 0 && !IsSolidType(type)) ? MAX_LIGHT : 0;
+
+}
+
+void LightMap::PropagateRemovals(const Grid& grid, Channel channel){
+    for (size_t i = 0; i < removals.size(); i++){
+        Node node = removals[i];
+        for (int direction = 0; direction < 4; direction++){
+            int64_t x = (int64_t)node.x + DIRECTION_X[direction];
+            int64_t y = (int64_t)node.y + DIRECTION_Y[direction];
+            if (!grid.InBounds(x, y)){
+                continue;
+            }
+            uint8_t level = GetChannel(x, y, channel);
+            if (level == 0){
+                continue;
+            }
+
+            bool is_dependent = level < node.level
+                || (level == node.level && Attenuate(node.level, direction, channel) == node.level);
+            if (!is_dependent){
+                // Lit from somewhere else, it refills what was cleared
+                additions.push_back({(uint32_t)x, (uint32_t)y, level});
+                continue;
+            }
+            SetChannel(x, y, channel, 0);
+            removals.push_back({(uint32_t)x, (uint32_t)y, level});
+            uint8_t source = GetSourceLevel(grid, x, y, channel);
+            if (source > 0){
+                SetChannel(x, y, channel, source);
+                additions.push_back({(uint32_t)x, (uint32_t)y, source});
+            }
+        }
+    }
+    removals.clear();
+
+}
+
+void LightMap::PropagateAdditions(const Grid& grid, Channel channel){
+    for (size_t i = 0; i < additions.size(); i++){
+        Node node = additions[i];
+        // Solid tiles take light but do not pass it on
+        if (grid.IsSolidUnchecked(node.x, node.y)){
+            continue;
+        }
+        uint8_t level = GetChannel(node.x, node.y, channel);
+        if (level <= 1){
+            continue;
+        }
+        for (int direction = 0; direction < 4; direction++){
+            int64_t x = (int64_t)node.x + DIRECTION_X[direction];
+            int64_t y = (int64_t)node.y + DIRECTION_Y[direction];
+            if (!grid.InBounds(x, y) || lit_revisions[GetChunk(*this, x, y)] == UNLIT){
+                continue;
+            }
+            uint8_t next = Attenuate(level, direction, channel);
+            if (next > GetChannel(x, y, channel)){
+                SetChannel(x, y, channel, next);
+                additions.push_back({(uint32_t)x, (uint32_t)y, next});
+            }
+        }
+    }
+    additions.clear();
+
+}
+
+void LightMap::QueueLitTile(const Grid& grid, int64_t x, int64_t y, Channel channel){
+    if (grid.InBounds(x, y) && !grid.IsSolidUnchecked(x, y)){
+        uint8_t level = GetChannel(x, y, channel);
+        if (level > 0){
+            additions.push_back({(uint32_t)x, (uint32_t)y, level});
+        }
+    }
+
+}
+
+void LightMap::QueueLitNeighbours(const Grid& grid, uint32_t x, uint32_t y, Channel channel){
+    for (int direction = 0; direction < 4; direction++){
+        QueueLitTile(grid, (int64_t)x + DIRECTION_X[direction], (int64_t)y + DIRECTION_Y[direction], channel);
+    }
+
+}
+
+void LightMap::Rebuild(const Grid& grid){
+    PROFILE_SCOPE("light rebuild");
+    Reset(grid);
+    Sync(grid);
+
+}
+
+void LightMap::Reset(const Grid& grid){
+    *this = New(grid.size_x, grid.size_y);
+    grid_id = grid.id;
+
+}
+
+void LightMap::OnTilePlaced(const Grid& grid, uint32_t x, uint32_t y){
+    if (grid.id != grid_id){
+        Reset(grid);
+        return;
+    }
+    // Sync lights the chunk whole later
+    uint32_t chunk = GetChunk(*this, x, y);
+    if (lit_revisions[chunk] == UNLIT){
+        return;
+    }
+
+    for (Channel channel : {SKY, BLOCK}){
+        uint8_t level = GetChannel(x, y, channel);
+        if (level > 0){
+            SetChannel(x, y, channel, 0);
+            removals.push_back({x, y, level});
+        }
+        PropagateRemovals(grid, channel);
+
+        uint8_t source = GetSourceLevel(grid, x, y, channel);
+        if (source > 0){
+            SetChannel(x, y, channel, source);
+            additions.push_back({x, y, source});
+        }
+        QueueLitNeighbours(grid, x, y, channel);
+        PropagateAdditions(grid, channel);
+    }
+
+    // Only mark the chunk lit if this edit was its one change, otherwise Sync still has work
+    if (lit_revisions[chunk] + 1 == grid.chunk_revisions[chunk]){
+        lit_revisions[chunk] = grid.chunk_revisions[chunk];
+    }
+
+}
+
+void LightMap::OnRegionChanged(const Grid& grid, TileRegion region){
+    PROFILE_SCOPE("light region");
+    if (grid.id != grid_id || grid.size_x != size_x || grid.size_y != size_y){
+        Reset(grid);
+        return;
+    }
+    if (region.IsEmpty()){
+        return;
+    }
+    RelightRegion(grid, region.x, region.y, region.x + region.width, region.y + region.height);
+
+    // A bulk edit bumps each chunk once, chunks with other pending edits are left to Sync
+    for (uint32_t chunk_y = region.y >> Grid::CHUNK_SHIFT; chunk_y <= (region.y + region.height - 1) >> Grid::CHUNK_SHIFT; chunk_y++){
+        for (uint32_t chunk_x = region.x >> Grid::CHUNK_SHIFT; chunk_x <= (region.x + region.width - 1) >> Grid::CHUNK_SHIFT; chunk_x++){
+            uint32_t chunk = chunk_y * chunks_x + chunk_x;
+            if (lit_revisions[chunk] != UNLIT && lit_revisions[chunk] + 1 == grid.chunk_revisions[chunk]){
+                lit_revisions[chunk] = grid.chunk_revisions[chunk];
+            }
+        }
+    }
+
+}
+
+void LightMap::RelightRegion(const Grid& grid, uint32_t start_x, uint32_t start_y, uint32_t end_x, uint32_t end_y){
+    for (Channel channel : {SKY, BLOCK}){
+        // Tiles are visited a chunk at a time so chunks with nothing to clear or emit are skipped whole
+        for (uint32_t chunk_y = start_y >> Grid::CHUNK_SHIFT; chunk_y <= (end_y - 1) >> Grid::CHUNK_SHIFT; chunk_y++){
+            for (uint32_t chunk_x = start_x >> Grid::CHUNK_SHIFT; chunk_x <= (end_x - 1) >> Grid::CHUNK_SHIFT; chunk_x++){
+                if (chunk_index[chunk_y * chunks_x + chunk_x] == DARK_CHUNK){
+                    continue;
+                }
+                uint32_t tile_end_x = std::min(end_x, (chunk_x + 1) << Grid::CHUNK_SHIFT);
+                uint32_t tile_end_y = std::min(end_y, (chunk_y + 1) << Grid::CHUNK_SHIFT);
+                for (uint32_t y = std::max(start_y, chunk_y << Grid::CHUNK_SHIFT); y < tile_end_y; y++){
+                    for (uint32_t x = std::max(start_x, chunk_x << Grid::CHUNK_SHIFT); x < tile_end_x; x++){
+                        uint8_t level = GetChannel(x, y, channel);
+                        if (level > 0){
+                            SetChannel(x, y, channel, 0);
+                            removals.push_back({x, y, level});
+                        }
+                    }
+                }
+            }
+        }
+        PropagateRemovals(grid, channel);
+
+        // Sky only enters through the top row and air chunks give off no block light
+        for (uint32_t chunk_y = start_y >> Grid::CHUNK_SHIFT; chunk_y <= (end_y - 1) >> Grid::CHUNK_SHIFT; chunk_y++){
+            for (uint32_t chunk_x = start_x >> Grid::CHUNK_SHIFT; chunk_x <= (end_x - 1) >> Grid::CHUNK_SHIFT; chunk_x++){
+                if (lit_revisions[chunk_y * chunks_x + chunk_x] == UNLIT
+                    || (channel == BLOCK && !grid.IsChunkAllocated(chunk_x, chunk_y))){
+                    continue;
+                }
+                const Tile* tiles = grid.GetChunkTiles(chunk_x, chunk_y);
+                uint32_t tile_end_x = std::min(end_x, (chunk_x + 1) << Grid::CHUNK_SHIFT);
+                uint32_t tile_end_y = std::min(channel == SKY ? 1u : end_y, (chunk_y + 1) << Grid::CHUNK_SHIFT);
+                for (uint32_t y = std::max(start_y, chunk_y << Grid::CHUNK_SHIFT); y < tile_end_y; y++){
+                    for (uint32_t x = std::max(start_x, chunk_x << Grid::CHUNK_SHIFT); x < tile_end_x; x++){
+                        uint8_t source = channel == SKY ? GetSourceLevel(grid, x, y, SKY) : GetTileEmission(tiles[GetLocal(x, y)].type);
+                        if (source > 0 && source > GetChannel(x, y, channel)){
+                            SetChannel(x, y, channel, source);
+                            additions.push_back({x, y, source});
+                        }
+                    }
+                }
+            }
+        }
+        // Light from the ring of tiles around the region flows back in
+        for (uint32_t x = start_x; x < end_x; x++){
+            QueueLitTile(grid, x, (int64_t)start_y - 1, channel);
+            QueueLitTile(grid, x, end_y, channel);
+        }
+        for (uint32_t y = start_y; y < end_y; y++){
+            QueueLitTile(grid, (int64_t)start_x - 1, y, channel);
+            QueueLitTile(grid, end_x, y, channel);
+        }
+        PropagateAdditions(grid, channel);
+    }
+
+}
+
+void LightMap::Sync(const Grid& grid, uint32_t max_new_chunks){
+    if (grid.id != grid_id || grid.size_x != size_x || grid.size_y != size_y){
+        Reset(grid);
+    }
+    uint32_t new_chunks = 0;
+    for (uint32_t chunk = 0; chunk < lit_revisions.size(); chunk++){
+        if (lit_revisions[chunk] == grid.chunk_revisions[chunk]){
+            continue;
+        }
+        if (!grid.IsChunkLoaded(chunk)){
+            if (lit_revisions[chunk] != UNLIT){
+                UnlightChunk(grid, chunk);
+            }
+            continue;
+        }
+        if (lit_revisions[chunk] == UNLIT){
+            if (new_chunks == max_new_chunks){
+                continue;
+            }
+            new_chunks++;
+        }
+        lit_revisions[chunk] = grid.chunk_revisions[chunk];
+        uint32_t start_x = (chunk % chunks_x) << Grid::CHUNK_SHIFT;
+        uint32_t start_y = (chunk / chunks_x) << Grid::CHUNK_SHIFT;
+        RelightRegion(grid, start_x, start_y, std::min(size_x, start_x + Grid::CHUNK_SIZE), std::min(size_y, start_y + Grid::CHUNK_SIZE));
+    }
+
+}
+
+void LightMap::UnlightChunk(const Grid& grid, uint32_t chunk){
+    lit_revisions[chunk] = UNLIT;
+    uint32_t start_x = (chunk % chunks_x) << Grid::CHUNK_SHIFT;
+    uint32_t start_y = (chunk / chunks_x) << Grid::CHUNK_SHIFT;
+    uint32_t end_x = std::min(size_x, start_x + Grid::CHUNK_SIZE);
+    uint32_t end_y = std::min(size_y, start_y + Grid::CHUNK_SIZE);
+    for (Channel channel : {SKY, BLOCK}){
+        for (uint32_t y = start_y; y < end_y; y++){
+            for (uint32_t x = start_x; x < end_x; x++){
+                uint8_t level = GetChannel(x, y, channel);
+                if (level > 0){
+                    SetChannel(x, y, channel, 0);
+                    removals.push_back({x, y, level});
+                }
+            }
+        }
+        PropagateRemovals(grid, channel);
+        PropagateAdditions(grid, channel);
+    }
+    ReleaseChunk(chunk);
+
+}
+
+const uint8_t* LightMap::GetChunkLight(uint32_t chunk) const {
+    return &chunk_light[(size_t)chunk_index[chunk] * Grid::CHUNK_AREA];
+
+}
+
+void LightMap::SetChunkLight(uint32_t chunk, const uint8_t* light, uint32_t revision){
+    uint32_t& slot = chunk_index[chunk];
+    if (slot == DARK_CHUNK){
+        if (!free_slots.empty()){
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            slot = chunk_light.size() / Grid::CHUNK_AREA;
+            chunk_light.resize(chunk_light.size() + Grid::CHUNK_AREA);
+        }
+    }
+    std::memcpy(&chunk_light[(size_t)slot * Grid::CHUNK_AREA], light, Grid::CHUNK_AREA);
+    chunk_revisions[chunk] = revision;
+
+}
+
+void LightMap::ReleaseChunk(uint32_t chunk){
+    uint32_t& slot = chunk_index[chunk];
+    if (slot != DARK_CHUNK){
+        free_slots.push_back(slot);
+        slot = DARK_CHUNK;
+    }
+
+}
+
+bool LightMap::IsChunkAllocated(uint32_t chunk) const {
+    return chunk_index[chunk] != DARK_CHUNK;
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "grid.h"
+
+#include <raylib.h>
+#include <cstdint>
+#include <vector>
+
+// Per-tile light levels from 0 to 15 in two channels: sky light, which enters through open tiles
+// in the top row and falls straight down undimmed, and block light from emitting tiles. Both
+// spread by breadth-first flood fill, losing one level per step. Solid tiles are lit by their
+// neighbours but do not pass light on.
+//
+// Stored like Grid: chunks in one pool with slot 0 shared and dark, one byte per tile holding
+// the sky level in the high nibble and the block level in the low one. Edits relight only the
+// region the old and new light reached.
+//
+// Only lit chunks take part. A new grid starts with every chunk unlit and Sync lights a bounded
+// number per call. Chunks missing from a streamed grid stay unlit and hold no light storage.
+// Unlit chunks are dark and light does not spread into them, so light memory follows the loaded
+// chunks rather than the world size.
+struct LightMap {
+    static constexpr uint8_t MAX_LIGHT = 15;
+    static constexpr uint32_t DARK_CHUNK = 0;
+    static constexpr uint32_t UNLIT = UINT32_MAX;
+
+    enum Channel : uint8_t {
+        SKY,
+        BLOCK
+    };
+
+    uint32_t size_x = 0;
+    uint32_t size_y = 0;
+    uint32_t chunks_x = 0;
+    uint32_t chunks_y = 0;
+    uint64_t grid_id = 0;
+    std::vector<uint32_t> chunk_index = {};
+    std::vector<uint8_t> chunk_light = {};
+    std::vector<uint32_t> free_slots = {};
+    // Bumped whenever light inside the chunk changes, caches of lit chunks compare against it
+    std::vector<uint32_t> chunk_revisions = {};
+    // Grid::chunk_revisions each chunk was last lit for, Sync relights chunks that fell behind.
+    // UNLIT for chunks not lit yet.
+    std::vector<uint32_t> lit_revisions = {};
+
+    static LightMap New(uint32_t width, uint32_t height);
+
+    // Brightest of the two channels, dark outside the map
+    uint8_t GetLight(uint32_t x, uint32_t y) const;
+
+    uint8_t GetChannel(uint32_t x, uint32_t y, Channel channel) const;
+
+    // Lights every loaded chunk of the grid from scratch at once
+    void Rebuild(const Grid& grid);
+
+    // Drops all light and follows a different grid, Sync then lights its chunks
+    void Reset(const Grid& grid);
+
+    // Call after Grid::Place changed the tile at (x, y)
+    void OnTilePlaced(const Grid& grid, uint32_t x, uint32_t y);
+
+    // Call once after a bulk edit changed tiles inside the region
+    void OnRegionChanged(const Grid& grid, TileRegion region);
+
+    // Relights chunks edited without OnTilePlaced and unlights chunks the pager evicted. Lights
+    // at most max_new_chunks unlit chunks, in row order so sky light comes down from above.
+    // Resets first when a different grid was loaded.
+    void Sync(const Grid& grid, uint32_t max_new_chunks = UINT32_MAX);
+
+    // Raw chunk data, CHUNK_AREA bytes, for copying lit chunks to the render thread
+    const uint8_t* GetChunkLight(uint32_t chunk) const;
+
+    void SetChunkLight(uint32_t chunk, const uint8_t* light, uint32_t revision);
+
+    void ReleaseChunk(uint32_t chunk);
+
+    bool IsChunkAllocated(uint32_t chunk) const;
+
+private:
+    struct Node {
+        uint32_t x;
+        uint32_t y;
+        uint8_t level;
+    };
+
+    std::vector<Node> removals = {};
+    std::vector<Node> additions = {};
+
+    void SetChannel(uint32_t x, uint32_t y, Channel channel, uint8_t level);
+
+    uint8_t GetSourceLevel(const Grid& grid, uint32_t x, uint32_t y, Channel channel) const;
+
+    // Clears light that depended on the queued removals, queueing surviving sources to refill
+    void PropagateRemovals(const Grid& grid, Channel channel);
+
+    void PropagateAdditions(const Grid& grid, Channel channel);
+
+    // Queues (x, y) if it is inside the grid, open and has light to spread
+    void QueueLitTile(const Grid& grid, int64_t x, int64_t y, Channel channel);
+
+    // Queues open neighbours of (x, y) that have light to spread into it
+    void QueueLitNeighbours(const Grid& grid, uint32_t x, uint32_t y, Channel channel);
+
+    // Clears and refills light for tiles in [start_x, end_x) x [start_y, end_y)
+    void RelightRegion(const Grid& grid, uint32_t start_x, uint32_t start_y, uint32_t end_x, uint32_t end_y);
+
+    // Clears the chunk's light and what depended on it, then frees its storage
+    void UnlightChunk(const Grid& grid, uint32_t chunk);
+};
+
+// Tile tint for a light level, never fully black so unlit caves can still be edited
+inline Color GetLightTint(uint8_t level){
+    constexpr uint8_t MIN_BRIGHTNESS = 40;
+    uint8_t brightness = MIN_BRIGHTNESS + (255 - MIN_BRIGHTNESS) * level / LightMap::MAX_LIGHT;
+    return {brightness, brightness, brightness, 255};
+}
@@ -0,0 +1,107 @@
+#include "lod_renderer.h"
+#include "lighting.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+namespace {
+
+    constexpr uint32_t TEXTURE_STEP = 64; // Texture sizes round up to this to avoid reallocating as the view pans
+
+    uint32_t RoundUp(uint32_t value){
+        return (value + TEXTURE_STEP - 1) / TEXTURE_STEP * TEXTURE_STEP;
+    }
+
+} // namespace
+
+void LodRenderer::Layer::Upload(const TileView& cells, const TileAtlas& atlas){
+    PROFILE_SCOPE("lod upload");
+    level = cells.level;
+    x = cells.x;
+    y = cells.y;
+    width = cells.width;
+    height = cells.height;
+    if (IsEmpty()){
+        return;
+    }
+
+    pixels.resize(cells.types.size());
+    for (size_t i = 0; i < cells.types.size(); i++){
+        uint8_t type = cells.types[i];
+        Color color = type < atlas.average_colors.size() ? atlas.average_colors[type] : MAGENTA;
+        if (!cells.light.empty()){
+            Color tint = GetLightTint(std::max(cells.light[i] >> 4, cells.light[i] & 0xF));
+            color.r = color.r * tint.r / 255;
+            color.g = color.g * tint.g / 255;
+            color.b = color.b * tint.b / 255;
+        }
+        pixels[i] = color;
+    }
+
+    if (texture.id == 0 || (uint32_t)texture.width < width || (uint32_t)texture.height < height){
+        Unload();
+        Image image = GenImageColor(RoundUp(width), RoundUp(height), BLANK);
+        texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+    }
+    UpdateTextureRec(texture, {0, 0, (float)width, (float)height}, pixels.data());
+
+}
+
+bool LodRenderer::Layer::IsEmpty() const {
+    return width == 0 || height == 0;
+
+}
+
+void LodRenderer::Layer::Unload(){
+    if (texture.id != 0){
+        UnloadTexture(texture);
+        texture = Texture2D{};
+    }
+
+}
+
+void LodRenderer::DrawView(uint16_t tile_resolution) const {
+    if (view.IsEmpty()){
+        return;
+    }
+    float cell = (float)((uint32_t)tile_resolution << view.level);
+    Rectangle source = {0, 0, (float)view.width, (float)view.height};
+    Rectangle destination = {view.x * cell, view.y * cell, view.width * cell, view.height * cell};
+    DrawTexturePro(view.texture, source, destination, {0, 0}, 0, WHITE);
+
+}
+
+void LodRenderer::DrawMinimap(Rectangle area, Rectangle bounds, Vector2 player_position, uint16_t tile_resolution) const {
+    if (minimap.IsEmpty()){
+        return;
+    }
+    float scale = std::min(area.width / minimap.width, area.height / minimap.height);
+    Rectangle destination = {
+        area.x + area.width - minimap.width * scale,
+        area.y + area.height - minimap.height * scale,
+        minimap.width * scale,
+        minimap.height * scale
+    };
+    DrawRectangleRec(destination, Fade(BLACK, 0.6f));
+    DrawTexturePro(minimap.texture, {0, 0, (float)minimap.width, (float)minimap.height}, destination, {0, 0}, 0, WHITE);
+
+    // World pixels to minimap pixels
+    float world_scale = scale / (float)((uint32_t)tile_resolution << minimap.level);
+    float start_x = std::clamp(destination.x + bounds.x * world_scale, destination.x, destination.x + destination.width);
+    float start_y = std::clamp(destination.y + bounds.y * world_scale, destination.y, destination.y + destination.height);
+    float end_x = std::clamp(destination.x + (bounds.x + bounds.width) * world_scale, destination.x, destination.x + destination.width);
+    float end_y = std::clamp(destination.y + (bounds.y + bounds.height) * world_scale, destination.y, destination.y + destination.height);
+    DrawRectangleLinesEx({start_x, start_y, end_x - start_x, end_y - start_y}, 1, WHITE);
+
+    Vector2 player = {destination.x + player_position.x * world_scale, destination.y + player_position.y * world_scale};
+    DrawRectangleRec({player.x - 1, player.y - 1, 3, 3}, RED);
+    DrawRectangleLinesEx(destination, 1, GRAY);
+
+}
+
+void LodRenderer::Unload(){
+    view.Unload();
+    minimap.Unload();
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "tile_atlas.h"
+#include "tile_pyramid.h"
+
+#include <raylib.h>
+#include <cstdint>
+#include <vector>
+
+// Draws TileViews with one texel per cell, coloured by the atlas' average tile colours. The
+// zoomed out world and the minimap cost a texel per screen pixel at most, whatever the number
+// of tiles they cover.
+struct LodRenderer {
+    struct Layer {
+        Texture2D texture{}; // Grown in steps and reused, only the top left width x height is used
+        uint32_t level = 0;
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<Color> pixels = {};
+
+        // Must be called outside of BeginDrawing/EndDrawing
+        void Upload(const TileView& cells, const TileAtlas& atlas);
+
+        bool IsEmpty() const;
+
+        void Unload();
+    };
+
+    Layer view = {};
+    Layer minimap = {};
+
+    // In world coordinates, inside BeginMode2D
+    void DrawView(uint16_t tile_resolution) const;
+
+    // In screen coordinates: the minimap fitted to the bottom right of area, with an outline of the
+    // camera bounds and a marker at the player
+    void DrawMinimap(Rectangle area, Rectangle bounds, Vector2 player_position, uint16_t tile_resolution) const;
+
+    void Unload();
+};
@@ -1,6 +1,53 @@
 #include "game.h"
+#include "headless.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv){
+    // caveslave --headless [<script>] [--script <path> | --replay <name>] [--record <name>] [--level <name>] [--generate <seed>] [--ticks <count>] [--entities <count>] [--threads <count>] [--trace <path>]
+    if (argc > 1 && std::string(argv[1]) == "--headless"){
+        Headless::Options options;
+        int first_flag = 2;
+        if (argc > 2 && std::string(argv[2]).rfind("--", 0) != 0){
+            options.script_path = argv[2];
+            first_flag = 3;
+        }
+        for (int i = first_flag; i + 1 < argc; i += 2){
+            std::string flag = argv[i];
+            if (flag == "--script"){
+                options.script_path = argv[i + 1];
+            } else if (flag == "--replay"){
+                options.replay_name = argv[i + 1];
+            } else if (flag == "--record"){
+                options.record_name = argv[i + 1];
+            } else if (flag == "--level"){
+                options.level_name = argv[i + 1];
+            } else if (flag == "--generate"){
+                options.generate_seed = std::strtoull(argv[i + 1], nullptr, 10);
+            } else if (flag == "--ticks"){
+                options.tick_count = std::strtoull(argv[i + 1], nullptr, 10);
+            } else if (flag == "--entities"){
+                options.entity_count = std::strtoul(argv[i + 1], nullptr, 10);
+            } else if (flag == "--threads"){
+                options.thread_count = std::strtoul(argv[i + 1], nullptr, 10);
+            } else if (flag == "--trace"){
+                options.trace_path = argv[i + 1];
+            } else {
+                std::cout << "Unknown option " << flag << std::endl;
+                return 1;
+            }
+        }
+
+        auto report = Headless::Run(options);
+        if (!report.has_value()){
+            return 1;
+        }
+        Headless::PrintReport(report.value());
+        return 0;
+    }
 
-int main(){
     Game::Run();
     return 0;
 }
@@ -0,0 +1,127 @@
+#include "mapped_file.h"
+
+#include <utility>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other){
+        Close();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+#ifdef _WIN32
+        file_handle = std::exchange(other.file_handle, nullptr);
+        mapping_handle = std::exchange(other.mapping_handle, nullptr);
+#else
+        file_descriptor = std::exchange(other.file_descriptor, -1);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile(){
+    Close();
+}
+
+#ifdef _WIN32
+
+std::optional<MappedFile> MappedFile::Open(const std::string& path){
+    MappedFile file;
+    file.file_handle = CreateFileA(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+    );
+    if (file.file_handle == INVALID_HANDLE_VALUE){
+        file.file_handle = nullptr;
+        return std::nullopt;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file.file_handle, &file_size)){
+        return std::nullopt;
+    }
+    file.size = file_size.QuadPart;
+    if (file.size == 0){
+        return file;
+    }
+
+    file.mapping_handle = CreateFileMappingA(file.file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file.mapping_handle == nullptr){
+        return std::nullopt;
+    }
+    file.data = static_cast<const uint8_t*>(MapViewOfFile(file.mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (file.data == nullptr){
+        return std::nullopt;
+    }
+    return file;
+}
+
+void MappedFile::Close(){
+    if (data != nullptr){
+        UnmapViewOfFile(data);
+    }
+    if (mapping_handle != nullptr){
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle != nullptr){
+        CloseHandle(file_handle);
+    }
+    data = nullptr;
+    size = 0;
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+}
+
+#else
+
+std::optional<MappedFile> MappedFile::Open(const std::string& path){
+    MappedFile file;
+    file.file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file.file_descriptor < 0){
+        return std::nullopt;
+    }
+
+    struct stat file_stat;
+    if (fstat(file.file_descriptor, &file_stat) != 0){
+        return std::nullopt;
+    }
+    file.size = file_stat.st_size;
+    if (file.size == 0){
+        return file;
+    }
+
+    void* mapping = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.file_descriptor, 0);
+    if (mapping == MAP_FAILED){
+        return std::nullopt;
+    }
+    // The whole file is decoded front to back right after mapping
+    madvise(mapping, file.size, MADV_SEQUENTIAL);
+    file.data = static_cast<const uint8_t*>(mapping);
+    return file;
+}
+
+void MappedFile::Close(){
+    if (data != nullptr){
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+    if (file_descriptor >= 0){
+        close(file_descriptor);
+    }
+    data = nullptr;
+    size = 0;
+    file_descriptor = -1;
+}
+
+#endif
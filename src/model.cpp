@@ -30,13 +30,39 @@ Input Input::Capture()
             .escape = IsKeyPressed(KEY_ESCAPE),
             .y = IsKeyPressed(KEY_Y),
             .n = IsKeyPressed(KEY_N),
+            .z = IsKeyPressed(KEY_Z),
             .f4 = IsKeyPressed(KEY_F4),
             .f5 = IsKeyPressed(KEY_F5),
-            .f6 = IsKeyPressed(KEY_F6)
+            .f6 = IsKeyPressed(KEY_F6),
+            .f7 = IsKeyPressed(KEY_F7),
+            .f8 = IsKeyPressed(KEY_F8)
         }
     };
 }
 
+Input Input::Merge(const Input& pending, const Input& latest)
+{
+    Input merged = latest;
+    merged.mouse_wheel += pending.mouse_wheel;
+    merged.pressed.space |= pending.pressed.space;
+    merged.pressed.escape |= pending.pressed.escape;
+    merged.pressed.y |= pending.pressed.y;
+    merged.pressed.n |= pending.pressed.n;
+    merged.pressed.z |= pending.pressed.z;
+    merged.pressed.f4 |= pending.pressed.f4;
+    merged.pressed.f5 |= pending.pressed.f5;
+    merged.pressed.f6 |= pending.pressed.f6;
+    merged.pressed.f7 |= pending.pressed.f7;
+    merged.pressed.f8 |= pending.pressed.f8;
+    return merged;
+}
+
+void Input::ClearEvents()
+{
+    mouse_wheel = 0;
+    pressed = Pressed{};
+}
+
 void Sprite::Draw() const{
     DrawTexturePro(texture, {0, 0, 8 * (float)direction, 8}, dest_rect, {0, 0}, 0, WHITE);
 };
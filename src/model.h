@@ -1,5 +1,9 @@
 #pragma once
 
+#include "lod_renderer.h"
+#include "render_cache.h"
+#include "tile_atlas.h"
+
 #include <raylib.h>
 #include <stdint.h>
 #include <vector>
@@ -20,9 +24,12 @@ struct Input {
         bool escape;
         bool y;
         bool n;
+        bool z;
         bool f4;
         bool f5;
         bool f6;
+        bool f7;
+        bool f8;
     };
 
     struct Held{
@@ -38,6 +45,12 @@ struct Input {
 
     static Input Capture();
 
+    // Folds a newer frame's input into input that no tick has consumed yet, keeping every press
+    static Input Merge(const Input& pending, const Input& latest);
+
+    // Drops one-shot events (presses, wheel) once a tick has seen them
+    void ClearEvents();
+
 };
 
 enum GameMode{
@@ -47,7 +60,9 @@ enum GameMode{
 
 struct Assets{
     Image tile_spritesheet;
-    std::vector<Texture2D> tile_textures;
+    TileAtlas tile_atlas = {};
+    ChunkRenderCache chunk_cache = {};
+    LodRenderer lod_renderer = {};
 
     Texture2D player_texture;
 
@@ -59,8 +74,8 @@ typedef enum Direction{
 } Direction;
 
 typedef struct Sprite {
-    Texture2D texture;
-    Rectangle dest_rect;
+    Texture2D texture = {};
+    Rectangle dest_rect = {0, 0, 0, 0};
     Direction direction = RIGHT;
 
     void Draw() const;
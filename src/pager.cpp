@@ -0,0 +1,338 @@
+#include "pager.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+    struct ChunkRect {
+        int64_t start_x, start_y, end_x, end_y; // end exclusive
+
+        bool Contains(int64_t x, int64_t y) const {
+            return start_x <= x && x < end_x && start_y <= y && y < end_y;
+        }
+    };
+
+    ChunkRect GetChunkRect(Rectangle bounds, uint16_t tile_resolution, uint32_t margin){
+        float chunk_pixels = (float)Grid::CHUNK_SIZE * tile_resolution;
+        return {
+            (int64_t)std::floor(bounds.x / chunk_pixels) - margin,
+            (int64_t)std::floor(bounds.y / chunk_pixels) - margin,
+            (int64_t)std::floor((bounds.x + bounds.width) / chunk_pixels) + 1 + margin,
+            (int64_t)std::floor((bounds.y + bounds.height) / chunk_pixels) + 1 + margin
+        };
+    }
+
+    ChunkRect Union(ChunkRect a, ChunkRect b){
+        return {
+            std::min(a.start_x, b.start_x),
+            std::min(a.start_y, b.start_y),
+            std::max(a.end_x, b.end_x),
+            std::max(a.end_y, b.end_y)
+        };
+    }
+
+    ChunkRect Clip(ChunkRect rect, uint32_t chunks_x, uint32_t chunks_y){
+        return {
+            std::max<int64_t>(rect.start_x, 0),
+            std::max<int64_t>(rect.start_y, 0),
+            std::min<int64_t>(rect.end_x, chunks_x),
+            std::min<int64_t>(rect.end_y, chunks_y)
+        };
+    }
+
+} // namespace
+
+std::unique_ptr<WorldPager> WorldPager::Open(std::string filename, PagerConfig config){
+    auto pager = std::make_unique<WorldPager>();
+    pager->config = config;
+    pager->filename = filename;
+
+    std::string path = "levels/" + filename + LevelFormat::EXTENSION;
+    LevelFormat::ReplayJournal(path);
+    auto chunk_file = LevelFormat::ChunkFile::Open(path);
+    if (!chunk_file.has_value()){
+        std::cout << "Error streaming level: could not open " << path << std::endl;
+        return nullptr;
+    }
+    pager->chunk_file = std::move(chunk_file.value());
+
+    const LevelFormat::Header& header = pager->chunk_file.header;
+    pager->size_x = header.width;
+    pager->size_y = header.height;
+    pager->chunks_x = header.chunks_x;
+    pager->chunks_y = header.chunks_y;
+    pager->chunk_states.assign(pager->chunk_file.directory.size(), UNLOADED);
+    pager->loaded_revisions.assign(pager->chunk_file.directory.size(), 0);
+
+    pager->worker = std::thread(&WorldPager::WorkerLoop, pager.get());
+    return pager;
+
+}
+
+WorldPager::~WorldPager(){
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    job_available.notify_all();
+    if (worker.joinable()){
+        worker.join();
+    }
+
+}
+
+bool WorldPager::ShouldStream(std::string filename, size_t memory_budget){
+    std::ifstream file("levels/" + filename + LevelFormat::EXTENSION, std::ios::binary);
+    LevelFormat::Header header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || !LevelFormat::IsHeaderValid(header)){
+        return false;
+    }
+    size_t world_bytes = (size_t)header.chunks_x * header.chunks_y * Grid::CHUNK_AREA * sizeof(Tile);
+    return world_bytes > memory_budget;
+
+}
+
+Grid WorldPager::NewGrid() const {
+    Grid grid(size_x, size_y);
+    grid.MarkAllChunksMissing();
+    return grid;
+
+}
+
+bool WorldPager::IsResident(uint32_t tile_x, uint32_t tile_y) const {
+    if (tile_x >= size_x || tile_y >= size_y){
+        return false;
+    }
+    return chunk_states[(tile_y >> Grid::CHUNK_SHIFT) * chunks_x + (tile_x >> Grid::CHUNK_SHIFT)] == RESIDENT;
+
+}
+
+//MAIN THREAD
+void WorldPager::Update(
+    Grid& grid,
+    Rectangle view_bounds,
+    Vector2 player_center,
+    Vector2 player_velocity,
+    uint16_t tile_resolution
+){
+    ApplyLoaded(grid);
+
+    // Keep the view loaded and extend it towards where the player will be
+    Vector2 lookahead = {
+        player_velocity.x * config.prefetch_time,
+        player_velocity.y * config.prefetch_time
+    };
+    Rectangle ahead_bounds = view_bounds;
+    ahead_bounds.x += lookahead.x;
+    ahead_bounds.y += lookahead.y;
+    ChunkRect needed = Clip(
+        Union(
+            GetChunkRect(view_bounds, tile_resolution, config.view_margin),
+            GetChunkRect(ahead_bounds, tile_resolution, config.view_margin)
+        ),
+        chunks_x,
+        chunks_y
+    );
+
+    float chunk_pixels = (float)Grid::CHUNK_SIZE * tile_resolution;
+    Vector2 focus = {
+        (player_center.x + lookahead.x) / chunk_pixels,
+        (player_center.y + lookahead.y) / chunk_pixels
+    };
+    auto distance_to_focus = [&](uint32_t chunk) -> float {
+        float dx = (float)(chunk % chunks_x) + 0.5f - focus.x;
+        float dy = (float)(chunk / chunks_x) + 0.5f - focus.y;
+        return dx * dx + dy * dy;
+    };
+
+    // Request missing chunks, closest to the focus first
+    if (in_flight < config.max_in_flight){
+        std::vector<uint32_t> missing;
+        for (int64_t y = needed.start_y; y < needed.end_y; y++){
+            for (int64_t x = needed.start_x; x < needed.end_x; x++){
+                uint32_t chunk = y * chunks_x + x;
+                if (chunk_states[chunk] == UNLOADED){
+                    missing.push_back(chunk);
+                }
+            }
+        }
+        size_t request_count = std::min<size_t>(missing.size(), config.max_in_flight - in_flight);
+        std::partial_sort(missing.begin(), missing.begin() + request_count, missing.end(), [&](uint32_t a, uint32_t b){
+            return distance_to_focus(a) < distance_to_focus(b);
+        });
+        for (size_t i = 0; i < request_count; i++){
+            chunk_states[missing[i]] = QUEUED;
+            in_flight++;
+            Submit({LOAD, missing[i], {}});
+        }
+    }
+
+    // Evict the farthest chunks outside the needed region until under budget. Resident air chunks
+    // cost no tile memory but are capped too so the resident list stays small.
+    size_t budget_chunks = std::max<size_t>(1, config.memory_budget / (Grid::CHUNK_AREA * sizeof(Tile)));
+    if (grid.GetAllocatedChunkCount() <= budget_chunks && resident_chunks.size() <= budget_chunks * 4){
+        return;
+    }
+    std::sort(resident_chunks.begin(), resident_chunks.end(), [&](uint32_t a, uint32_t b){
+        return distance_to_focus(a) > distance_to_focus(b);
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < resident_chunks.size(); i++){
+        uint32_t chunk = resident_chunks[i];
+        bool over_budget = grid.GetAllocatedChunkCount() > budget_chunks
+            || resident_chunks.size() - i + kept > budget_chunks * 4;
+        if (!over_budget || needed.Contains(chunk % chunks_x, chunk / chunks_x)){
+            resident_chunks[kept++] = chunk;
+            continue;
+        }
+        Evict(grid, chunk);
+    }
+    resident_chunks.resize(kept);
+
+}
+
+void WorldPager::Flush(Grid& grid){
+    for (uint32_t chunk : resident_chunks){
+        if (grid.chunk_revisions[chunk] != loaded_revisions[chunk]){
+            WriteBack(grid, chunk);
+        }
+    }
+
+    std::unique_lock lock(mutex);
+    jobs_finished.wait(lock, [&]{ return pending_jobs == 0; });
+
+}
+
+void WorldPager::ApplyLoaded(Grid& grid){
+    std::vector<LoadedChunk> completed;
+    {
+        std::lock_guard lock(mutex);
+        completed.swap(loaded);
+    }
+
+    for (LoadedChunk& result : completed){
+        uint32_t chunk_x = result.chunk % chunks_x;
+        uint32_t chunk_y = result.chunk / chunks_x;
+        // Anything written into the chunk before it arrived is replaced by the stored data
+        if (result.is_air){
+            grid.ReleaseChunk(chunk_x, chunk_y);
+        } else {
+            std::copy(result.tiles.begin(), result.tiles.end(), grid.GetChunkTilesMutable(chunk_x, chunk_y));
+        }
+        grid.SetChunkLoaded(result.chunk, true);
+        grid.TouchChunk(chunk_x, chunk_y);
+        loaded_revisions[result.chunk] = grid.chunk_revisions[result.chunk];
+        chunk_states[result.chunk] = RESIDENT;
+        resident_chunks.push_back(result.chunk);
+        in_flight--;
+    }
+
+}
+
+void WorldPager::WriteBack(Grid& grid, uint32_t chunk){
+    const Tile* tiles = grid.GetChunkTiles(chunk % chunks_x, chunk / chunks_x);
+    std::vector<uint8_t> payload;
+    if (!LevelFormat::IsChunkAir(tiles)){
+        LevelFormat::EncodeChunk(tiles, payload);
+    }
+    loaded_revisions[chunk] = grid.chunk_revisions[chunk];
+    Submit({WRITE, chunk, std::move(payload)});
+
+}
+
+void WorldPager::Evict(Grid& grid, uint32_t chunk){
+    if (grid.chunk_revisions[chunk] != loaded_revisions[chunk]){
+        WriteBack(grid, chunk);
+    }
+    grid.ReleaseChunk(chunk % chunks_x, chunk / chunks_x);
+    grid.SetChunkLoaded(chunk, false);
+    grid.TouchChunk(chunk % chunks_x, chunk / chunks_x);
+    chunk_states[chunk] = UNLOADED;
+
+}
+
+void WorldPager::Submit(Job job){
+    {
+        std::lock_guard lock(mutex);
+        jobs.push_back(std::move(job));
+        pending_jobs++;
+    }
+    job_available.notify_one();
+
+}
+
+//WORKER THREAD
+void WorldPager::WorkerLoop(){
+    PROFILE_THREAD("pager");
+    while (true){
+        Job job;
+        {
+            std::unique_lock lock(mutex);
+            // Write-backs wait for the queue to drain or a load to come up, then go in as one batch
+            if (!pending_writes.empty() && (jobs.empty() || jobs.front().kind == LOAD)){
+                size_t write_count = pending_writes.size();
+                lock.unlock();
+                PatchPendingWrites();
+                lock.lock();
+                pending_jobs -= write_count;
+            }
+            if (jobs.empty()){
+                jobs_finished.notify_all();
+            }
+            job_available.wait(lock, [&]{ return stopping || !jobs.empty(); });
+            if (jobs.empty()){
+                break;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        if (job.kind == WRITE){
+            pending_writes.push_back({job.chunk, std::move(job.payload)});
+            continue;
+        }
+
+        LoadedChunk result{job.chunk, true, {}};
+        ProcessLoad(job.chunk, result);
+        {
+            std::lock_guard lock(mutex);
+            loaded.push_back(std::move(result));
+            pending_jobs--;
+        }
+    }
+
+}
+
+void WorldPager::ProcessLoad(uint32_t chunk, LoadedChunk& result){
+    PROFILE_SCOPE("pager load");
+    std::vector<uint8_t> payload;
+    bool read = chunk_file.Read(chunk, payload);
+    if (read && payload.empty()){
+        return;
+    }
+
+    result.tiles.resize(Grid::CHUNK_AREA);
+    if (!read || !LevelFormat::DecodeChunk(payload.data(), payload.size(), result.tiles.data())){
+        std::cout << "Error streaming level: chunk " << chunk << " is corrupt, loading it as air" << std::endl;
+        result.tiles.clear();
+        return;
+    }
+    result.is_air = false;
+
+}
+
+void WorldPager::PatchPendingWrites(){
+    PROFILE_SCOPE("pager write");
+    // On failure the chunks are lost unless a journal was left for the next Open to replay
+    if (!chunk_file.Patch(pending_writes)){
+        std::cout << "Error streaming level: could not write back " << pending_writes.size() << " chunks" << std::endl;
+    }
+    pending_writes.clear();
+
+}
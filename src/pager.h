@@ -0,0 +1,125 @@
+#pragma once
+
+#include "grid.h"
+#include "level_format.h"
+
+#include <raylib.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PagerConfig {
+    size_t memory_budget = 64 * 1024 * 1024; // Bytes of resident tile data before far chunks are evicted
+    uint32_t view_margin = 1;                // Chunks kept loaded around the camera bounds
+    float prefetch_time = 0.75f;             // Seconds of player travel to load ahead of
+    uint32_t max_in_flight = 32;             // Loads queued on the worker at once
+};
+
+// Streams a .cave level into a Grid around the camera. Chunk loads and write-backs run on a
+// background thread in submission order, so a write-back is always on disk before the same chunk
+// is loaded again. Consecutive write-backs are patched in as one journaled batch through
+// LevelFormat::ChunkFile, like autosaves. They append to the file, a full SaveToFile compacts it.
+//
+// memory_budget counts resident tiles, 8 KB a chunk. Everything else that grows with the tiles
+// follows the resident chunks too, so streamed memory stays within about 1.8 times the budget
+// whatever the world size:
+// - solidity masks in Grid, 1 KB a chunk
+// - LightMap light, 4 KB a chunk. Chunks that are not loaded are never lit.
+// - TilePyramid cells below the chunk level, 1364 bytes a chunk. Evicted chunks give them up.
+// Bookkeeping is kept for every chunk of the world, resident or not, about 52 bytes a chunk:
+// - chunk_states, loaded_revisions and the ChunkFile directory here
+// - chunk_index, chunk_revisions, chunk_dirty and chunk_missing in Grid
+// - the index and revisions of LightMap and TilePyramid, and the pyramid's dense levels
+// That is 55 MB for a 65536 x 65536 world, the part that grows with the file. The bench's
+// "streamed" result checks the light and pyramid pools against the resident chunk count.
+struct WorldPager {
+    enum ChunkState : uint8_t {
+        UNLOADED,
+        QUEUED,
+        RESIDENT
+    };
+
+    PagerConfig config = {};
+    std::string filename = {};
+    uint32_t size_x = 0;
+    uint32_t size_y = 0;
+    uint32_t chunks_x = 0;
+    uint32_t chunks_y = 0;
+    std::vector<uint8_t> chunk_states = {};
+    std::vector<uint32_t> loaded_revisions = {};
+    std::vector<uint32_t> resident_chunks = {};
+    uint32_t in_flight = 0;
+
+    static std::unique_ptr<WorldPager> Open(std::string filename, PagerConfig config = {});
+
+    ~WorldPager();
+
+    // An empty grid with the world's size, chunks are filled in by Update
+    Grid NewGrid() const;
+
+    void Update(
+        Grid& grid,
+        Rectangle view_bounds,
+        Vector2 player_center,
+        Vector2 player_velocity,
+        uint16_t tile_resolution
+    );
+
+    // Writes every modified resident chunk back to disk and waits for the worker
+    void Flush(Grid& grid);
+
+    bool IsResident(uint32_t tile_x, uint32_t tile_y) const;
+
+    // True if the level is too big for the budget and should be streamed rather than loaded whole
+    static bool ShouldStream(std::string filename, size_t memory_budget);
+
+private:
+    enum JobKind : uint8_t {
+        LOAD,
+        WRITE
+    };
+
+    struct Job {
+        JobKind kind = LOAD;
+        uint32_t chunk = 0;
+        std::vector<uint8_t> payload = {};
+    };
+
+    struct LoadedChunk {
+        uint32_t chunk;
+        bool is_air;
+        std::vector<Tile> tiles;
+    };
+
+    // Worker-owned once the thread is running
+    LevelFormat::ChunkFile chunk_file = {};
+    std::vector<LevelFormat::ChunkPayload> pending_writes = {}; // Taken off the queue, not yet patched in
+
+    std::mutex mutex = {};
+    std::condition_variable job_available = {};
+    std::condition_variable jobs_finished = {};
+    std::deque<Job> jobs = {};
+    std::vector<LoadedChunk> loaded = {};
+    size_t pending_jobs = 0;
+    bool stopping = false;
+    std::thread worker = {};
+
+    void Submit(Job job);
+
+    void WorkerLoop();
+
+    void ProcessLoad(uint32_t chunk, LoadedChunk& result);
+
+    void PatchPendingWrites();
+
+    void ApplyLoaded(Grid& grid);
+
+    void WriteBack(Grid& grid, uint32_t chunk);
+
+    void Evict(Grid& grid, uint32_t chunk);
+};
@@ -1,6 +1,9 @@
 #include "player.h"
+#include "collision.h"
+#include "profiler.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <raylib.h>
 #include <raymath.h>
@@ -28,8 +31,8 @@ Vector2 Player::GetCenterPosition() const {
 
 Vector2u Player::GetGridPosition(uint16_t tile_resolution) const {
 	return {
-        static_cast<uint16_t>(GetCenterPosition().x / tile_resolution),
-        static_cast<uint16_t>(GetCenterPosition().y / tile_resolution)
+        static_cast<uint32_t>(GetCenterPosition().x / tile_resolution),
+        static_cast<uint32_t>(GetCenterPosition().y / tile_resolution)
     };
 
 }
@@ -57,30 +60,25 @@ void Player::ResolveCollision(Rectangle tile_rect){
 }
 
 void Player::CheckCollision(const Grid& grid, uint16_t tile_resolution){ // Check collision with grid
-    Vector2u player_grid_position = {
-        static_cast<uint16_t>(GetCenterPosition().x / tile_resolution),
-        static_cast<uint16_t>(GetCenterPosition().y / tile_resolution)
-    };
-    for (int dy = -1; dy <= 1; dy++) {
-        for (int dx = -1; dx <= 1; dx++) {
-        	//Check for every tile around the player
-            Vector2 tile_position = Vector2Add(
-                player_grid_position.ToVector2(),
-                {static_cast<float>(dx), static_cast<float>(dy)}
-            );
-
+    PROFILE_SCOPE("player collision");
+    // Every tile the body overlaps, so bodies bigger than a tile are covered too
+    int64_t start_x = std::floor(sprite.dest_rect.x / tile_resolution);
+    int64_t start_y = std::floor(sprite.dest_rect.y / tile_resolution);
+    int64_t end_x = std::floor((sprite.dest_rect.x + sprite.dest_rect.width) / tile_resolution);
+    int64_t end_y = std::floor((sprite.dest_rect.y + sprite.dest_rect.height) / tile_resolution);
+    for (int64_t y = start_y; y <= end_y; y++) {
+        for (int64_t x = start_x; x <= end_x; x++) {
             // Bounds check
-            if (tile_position.x < 0 || tile_position.x >= grid.size_x ||
-                tile_position.y < 0 || tile_position.y >= grid.size_y)
+            if (!grid.InBounds(x, y))
                 continue;
 
             // Skip empty tiles
-            if (grid.GetTile(tile_position.x, tile_position.y).type == 0) continue;
+            if (!grid.IsSolidUnchecked(x, y)) continue;
 
             // Create tile rectangle
             Rectangle tile_rect = {
-                tile_position.x * tile_resolution,
-                tile_position.y * tile_resolution,
+                (float)x * tile_resolution,
+                (float)y * tile_resolution,
                 1.f * (tile_resolution),
                 1.f * (tile_resolution)
             };
@@ -93,6 +91,25 @@ void Player::CheckCollision(const Grid& grid, uint16_t tile_resolution){ // Chec
     }
 }
 
+void Player::MoveAndCollide(const Grid& grid, Vector2 motion, uint16_t tile_resolution){
+    SweepHit hit = SweepBox(grid, sprite.dest_rect, motion, tile_resolution);
+    sprite.dest_rect = hit.box;
+    if (!hit.hit){
+        return;
+    }
+
+    if (hit.normal.x != 0){
+        velocity.x = 0;
+    }
+    if (hit.normal.y < 0){ //Hits ground
+        is_grounded = true;
+        if (velocity.y > 0) velocity.y = 0;
+    }
+    if (hit.normal.y > 0){ //Hits ceiling
+        if (velocity.y < 0) velocity.y = 0;
+    }
+}
+
 void Player::SetVelocity(float horizontal_input, bool jump_key_held){
     if (horizontal_input == 0) {
         velocity.x *= 0.1;
@@ -147,14 +164,13 @@ void Player::Update(
             ApplyGravity(gravity, delta_time);
             is_grounded = false;
 
-            // CRITICAL: Apply axis separation - move X first, check collision
+            // Push out of tiles that were placed on top of the player
             CheckCollision(grid, 8);
             velocity.x = std::clamp(velocity.x, -1 * max_horizontal_speed, max_horizontal_speed);
-            sprite.dest_rect.x += velocity.x * delta_time;
 
-            // Then move Y, check collision
-            CheckCollision(grid, 8);
-            sprite.dest_rect.y += velocity.y * delta_time;
+            // CRITICAL: Apply axis separation - sweep X first, then Y
+            MoveAndCollide(grid, {velocity.x * delta_time, 0}, 8);
+            MoveAndCollide(grid, {0, velocity.y * delta_time}, 8);
 
         break;
 
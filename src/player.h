@@ -19,6 +19,9 @@ struct Player{
 
     void CheckCollision(const Grid& grid, uint16_t tile_resolution);
 
+    // Sweeps the body along motion and stops it at the first solid tile
+    void MoveAndCollide(const Grid& grid, Vector2 motion, uint16_t tile_resolution);
+
     void ApplyVelocityFree(float horizontal, float vertical);
 
     void ApplyVelocity(float delta_time);
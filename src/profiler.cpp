@@ -0,0 +1,204 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+namespace Profiler {
+
+namespace {
+
+    constexpr uint32_t RING_SIZE = 1 << 14; // Events per thread between two Collect calls
+    constexpr size_t MAX_CAPTURE_EVENTS = 1 << 22;
+    constexpr double SMOOTHING = 0.05; // Weight of the newest frame in the overlay averages
+
+    // Written only by its thread. The collector reads behind `written` and afterwards drops
+    // whatever the writer may have lapped while it was copying.
+    struct ThreadBuffer {
+        std::array<Event, RING_SIZE> events = {};
+        std::atomic<uint64_t> written = 0;
+        std::atomic<const char*> name = nullptr;
+        uint64_t read = 0; // Collector-owned
+        uint32_t thread_id = 0;
+    };
+
+    struct CapturedEvent {
+        Event event;
+        uint32_t thread_id;
+    };
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers; // Never freed, threads may outlive a drain
+    thread_local ThreadBuffer* local_buffer = nullptr;
+
+    // Main thread state
+    std::vector<Event> drained;
+    std::vector<Stat> stats;
+    uint64_t dropped_events = 0;
+    bool capturing = false;
+    std::vector<CapturedEvent> capture;
+
+    ThreadBuffer& GetLocalBuffer(){
+        if (local_buffer == nullptr){
+            std::lock_guard lock(registry_mutex);
+            auto buffer = std::make_unique<ThreadBuffer>();
+            buffer->thread_id = buffers.size();
+            local_buffer = buffer.get();
+            buffers.push_back(std::move(buffer));
+        }
+        return *local_buffer;
+    }
+
+    // Stats in the order names were first seen, with the current frame's totals
+    struct Entry {
+        Stat stat;
+        double frame_milliseconds = 0;
+        uint32_t frame_calls = 0;
+    };
+    std::vector<Entry> entries;
+
+    Entry& GetEntry(const Event& event){
+        for (Entry& entry : entries){
+            if (entry.stat.name == event.name){
+                return entry;
+            }
+        }
+        return entries.emplace_back(Entry{Stat{event.name, event.kind}});
+    }
+
+    void WriteMicroseconds(std::ofstream& file, uint64_t nanoseconds){
+        file << nanoseconds / 1000 << '.' << (char)('0' + nanoseconds / 100 % 10) << (char)('0' + nanoseconds / 10 % 10) << (char)('0' + nanoseconds % 10);
+    }
+
+} // namespace
+
+uint64_t Now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+void Record(const Event& event){
+    ThreadBuffer& buffer = GetLocalBuffer();
+    uint64_t index = buffer.written.load(std::memory_order_relaxed);
+    buffer.events[index & (RING_SIZE - 1)] = event;
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void Count(const char* name, uint64_t value){
+    Record({name, Now(), value, COUNTER});
+}
+
+void SetThreadName(const char* name){
+    GetLocalBuffer().name.store(name, std::memory_order_relaxed);
+}
+
+void Collect(){
+    std::lock_guard lock(registry_mutex);
+    for (const std::unique_ptr<ThreadBuffer>& buffer : buffers){
+        uint64_t end = buffer->written.load(std::memory_order_acquire);
+        uint64_t begin = std::max(buffer->read, end > RING_SIZE ? end - RING_SIZE : 0);
+        drained.clear();
+        for (uint64_t i = begin; i < end; i++){
+            drained.push_back(buffer->events[i & (RING_SIZE - 1)]);
+        }
+        // Slots the writer reached again during the copy may hold newer events
+        uint64_t written_after = buffer->written.load(std::memory_order_acquire);
+        uint64_t valid_begin = written_after >= RING_SIZE ? written_after - RING_SIZE + 1 : 0;
+        uint64_t skipped = valid_begin > begin ? std::min(valid_begin, end) - begin : 0;
+        dropped_events += begin - buffer->read + skipped;
+        buffer->read = end;
+
+        for (size_t i = skipped; i < drained.size(); i++){
+            const Event& event = drained[i];
+            Entry& entry = GetEntry(event);
+            if (event.kind == SCOPE){
+                entry.frame_milliseconds += event.value / 1e6;
+                entry.frame_calls++;
+            } else {
+                entry.stat.value = event.value;
+            }
+            if (capturing && capture.size() < MAX_CAPTURE_EVENTS){
+                capture.push_back({event, buffer->thread_id});
+            }
+        }
+    }
+
+    stats.clear();
+    for (Entry& entry : entries){
+        entry.stat.milliseconds += (entry.frame_milliseconds - entry.stat.milliseconds) * SMOOTHING;
+        entry.stat.calls += (entry.frame_calls - entry.stat.calls) * SMOOTHING;
+        entry.frame_milliseconds = 0;
+        entry.frame_calls = 0;
+        stats.push_back(entry.stat);
+    }
+    std::sort(stats.begin(), stats.end(), [](const Stat& a, const Stat& b){ return std::string_view(a.name) < std::string_view(b.name); });
+}
+
+const std::vector<Stat>& GetStats(){
+    return stats;
+}
+
+uint64_t GetDroppedEvents(){
+    return dropped_events;
+}
+
+void StartCapture(){
+    capture.clear();
+    capturing = true;
+}
+
+bool IsCapturing(){
+    return capturing;
+}
+
+bool StopCapture(const std::string& path){
+    capturing = false;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()){
+        std::filesystem::create_directories(parent);
+    }
+    std::ofstream file(path);
+    if (!file.is_open()){
+        std::cout << "Error writing trace: could not open " << path << std::endl;
+        return false;
+    }
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    {
+        std::lock_guard lock(registry_mutex);
+        for (const std::unique_ptr<ThreadBuffer>& buffer : buffers){
+            const char* name = buffer->name.load(std::memory_order_relaxed);
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id
+                << ",\"args\":{\"name\":\"" << (name != nullptr ? name : "thread") << "\"}}";
+            first = false;
+        }
+    }
+    for (const CapturedEvent& captured : capture){
+        const Event& event = captured.event;
+        file << ",\n{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << captured.thread_id << ",\"ts\":";
+        WriteMicroseconds(file, event.start);
+        if (event.kind == SCOPE){
+            file << ",\"ph\":\"X\",\"dur\":";
+            WriteMicroseconds(file, event.value);
+            file << "}";
+        } else {
+            file << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+        }
+    }
+    file << "\n]}\n";
+    std::cout << "Wrote " << capture.size() << " trace events to " << path << std::endl;
+    capture.clear();
+    capture.shrink_to_fit();
+    return file.good();
+}
+
+} // namespace Profiler
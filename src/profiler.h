@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scoped timers and counters for hot paths. Each thread records into its own ring buffer without
+// locking, the main thread drains them once a frame into per-name averages for the overlay and,
+// while a capture runs, into a list exported as Chrome trace JSON (chrome://tracing, Perfetto).
+// The PROFILE_ macros compile to nothing unless CAVE_PROFILE is defined.
+namespace Profiler {
+
+enum EventKind : uint8_t {
+    SCOPE,
+    COUNTER
+};
+
+struct Event {
+    const char* name; // String literal, names are told apart by address
+    uint64_t start;   // Nanoseconds since the profiler started
+    uint64_t value;   // Duration in nanoseconds for a scope
+    EventKind kind;
+};
+
+// Averages over recent frames for one name
+struct Stat {
+    const char* name;
+    EventKind kind;
+    double milliseconds = 0; // Per frame
+    double calls = 0;        // Per frame
+    uint64_t value = 0;      // Latest value of a counter
+};
+
+uint64_t Now();
+
+void Record(const Event& event);
+
+void Count(const char* name, uint64_t value);
+
+// Shown as the thread's name in traces, a string literal
+void SetThreadName(const char* name);
+
+struct Scope {
+    const char* name;
+    uint64_t start;
+
+    explicit Scope(const char* name) : name(name), start(Now()) {}
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope(){
+        Record({name, start, Now() - start, SCOPE});
+    }
+};
+
+// Main thread, once a frame. Drains every thread's buffer, events a thread wrote faster than
+// they were drained are lost and counted.
+void Collect();
+
+// Sorted by name
+const std::vector<Stat>& GetStats();
+
+uint64_t GetDroppedEvents();
+
+void StartCapture();
+
+bool IsCapturing();
+
+// Ends the capture and writes it to path as Chrome trace JSON
+bool StopCapture(const std::string& path);
+
+} // namespace Profiler
+
+#ifdef CAVE_PROFILE
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::Count(name, value)
+#define PROFILE_THREAD(name) Profiler::SetThreadName(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
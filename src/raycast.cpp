@@ -0,0 +1,156 @@
+#include "raycast.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+    constexpr uint32_t RAY_BATCH_SIZE = 64; // Rays per job
+    constexpr double NEVER = std::numeric_limits<double>::infinity();
+
+    // Narrows [t_enter, t_exit] to where the ray is inside [0, size) on one axis
+    bool ClipAxis(double origin, double direction, uint32_t size, double& t_enter, double& t_exit, RayHit::Face& face, RayHit::Face low_face, RayHit::Face high_face){
+        if (direction == 0){
+            return 0 <= origin && origin < size;
+        }
+        double t_low = (0 - origin) / direction;
+        double t_high = (size - origin) / direction;
+        if (t_low > t_high){
+            std::swap(t_low, t_high);
+        }
+        if (t_low > t_enter){
+            t_enter = t_low;
+            face = direction > 0 ? low_face : high_face;
+        }
+        t_exit = std::min(t_exit, t_high);
+        return t_enter <= t_exit;
+    }
+
+} // namespace
+
+RayHit CastRay(const Grid& grid, const GridRay& ray){
+    RayHit result;
+    result.distance = ray.max_distance;
+    double length = std::hypot((double)ray.direction.x, (double)ray.direction.y);
+    if (length == 0 || !(ray.max_distance >= 0)){
+        return result;
+    }
+    double origin_x = ray.origin.x;
+    double origin_y = ray.origin.y;
+    double direction_x = ray.direction.x / length;
+    double direction_y = ray.direction.y / length;
+
+    // Start where the ray enters the grid, there is nothing solid before that
+    double t = 0;
+    double t_exit = ray.max_distance;
+    RayHit::Face face = RayHit::NONE;
+    if (!ClipAxis(origin_x, direction_x, grid.size_x, t, t_exit, face, RayHit::LEFT, RayHit::RIGHT)
+        || !ClipAxis(origin_y, direction_y, grid.size_y, t, t_exit, face, RayHit::TOP, RayHit::BOTTOM)){
+        return result;
+    }
+    int64_t tile_x = std::clamp<int64_t>(std::floor(origin_x + direction_x * t), 0, grid.size_x - 1);
+    int64_t tile_y = std::clamp<int64_t>(std::floor(origin_y + direction_y * t), 0, grid.size_y - 1);
+
+    int64_t step_x = direction_x > 0 ? 1 : -1;
+    int64_t step_y = direction_y > 0 ? 1 : -1;
+    // Distance along the ray to the next vertical and horizontal tile edge, and between edges
+    double next_x = direction_x == 0 ? NEVER : ((direction_x > 0 ? tile_x + 1 : tile_x) - origin_x) / direction_x;
+    double next_y = direction_y == 0 ? NEVER : ((direction_y > 0 ? tile_y + 1 : tile_y) - origin_y) / direction_y;
+    double delta_x = direction_x == 0 ? NEVER : 1 / std::abs(direction_x);
+    double delta_y = direction_y == 0 ? NEVER : 1 / std::abs(direction_y);
+
+    // Consecutive tiles mostly share a chunk, its slot is only looked up again after leaving it.
+    // All-air chunks are crossed in one step.
+    uint32_t chunk = UINT32_MAX;
+    uint32_t slot = Grid::AIR_CHUNK;
+    while (true){
+        uint32_t tile_chunk = (tile_y >> Grid::CHUNK_SHIFT) * grid.chunks_x + (tile_x >> Grid::CHUNK_SHIFT);
+        if (tile_chunk != chunk){
+            chunk = tile_chunk;
+            slot = grid.chunk_index[chunk];
+        }
+        if (slot == Grid::AIR_CHUNK){
+            // Nothing to hit before the ray leaves the chunk, jump to the first tile past it.
+            // Ties go to y like the steps below.
+            int64_t chunk_x = tile_x & ~(int64_t)Grid::CHUNK_MASK;
+            int64_t chunk_y = tile_y & ~(int64_t)Grid::CHUNK_MASK;
+            double exit_x = direction_x == 0 ? NEVER : ((direction_x > 0 ? chunk_x + Grid::CHUNK_SIZE : chunk_x) - origin_x) / direction_x;
+            double exit_y = direction_y == 0 ? NEVER : ((direction_y > 0 ? chunk_y + Grid::CHUNK_SIZE : chunk_y) - origin_y) / direction_y;
+            if (exit_x < exit_y){
+                t = exit_x;
+                tile_x = direction_x > 0 ? chunk_x + Grid::CHUNK_SIZE : chunk_x - 1;
+                tile_y = std::clamp<int64_t>(std::floor(origin_y + direction_y * t), chunk_y, chunk_y + Grid::CHUNK_MASK);
+                face = step_x > 0 ? RayHit::LEFT : RayHit::RIGHT;
+            } else {
+                t = exit_y;
+                tile_y = direction_y > 0 ? chunk_y + Grid::CHUNK_SIZE : chunk_y - 1;
+                tile_x = std::clamp<int64_t>(std::floor(origin_x + direction_x * t), chunk_x, chunk_x + Grid::CHUNK_MASK);
+                face = step_y > 0 ? RayHit::TOP : RayHit::BOTTOM;
+            }
+            next_x = direction_x == 0 ? NEVER : ((direction_x > 0 ? tile_x + 1 : tile_x) - origin_x) / direction_x;
+            next_y = direction_y == 0 ? NEVER : ((direction_y > 0 ? tile_y + 1 : tile_y) - origin_y) / direction_y;
+            if (t > t_exit || !grid.InBounds(tile_x, tile_y)){
+                return result;
+            }
+            continue;
+        }
+        if ((grid.chunk_solid_rows[(size_t)slot * Grid::CHUNK_SIZE + (tile_y & Grid::CHUNK_MASK)] >> (tile_x & Grid::CHUNK_MASK)) & 1){
+            result.hit = true;
+            result.x = tile_x;
+            result.y = tile_y;
+            result.face = face;
+            result.distance = t;
+            return result;
+        }
+
+        if (next_x < next_y){
+            t = next_x;
+            next_x += delta_x;
+            tile_x += step_x;
+            face = step_x > 0 ? RayHit::LEFT : RayHit::RIGHT;
+        } else {
+            t = next_y;
+            next_y += delta_y;
+            tile_y += step_y;
+            face = step_y > 0 ? RayHit::TOP : RayHit::BOTTOM;
+        }
+        if (t > t_exit || !grid.InBounds(tile_x, tile_y)){
+            return result;
+        }
+    }
+
+}
+
+void CastRays(const Grid& grid, const std::vector<GridRay>& rays, std::vector<RayHit>& hits, JobSystem* jobs){
+    PROFILE_SCOPE("cast rays");
+    hits.resize(rays.size());
+    auto cast = [&](uint32_t start, uint32_t end){
+        for (uint32_t i = start; i < end; i++){
+            hits[i] = CastRay(grid, rays[i]);
+        }
+    };
+    if (jobs == nullptr || rays.size() <= RAY_BATCH_SIZE){
+        cast(0, rays.size());
+        return;
+    }
+    jobs->ParallelFor(rays.size(), RAY_BATCH_SIZE, cast);
+
+}
+
+bool HasLineOfSight(const Grid& grid, Vector2 from, Vector2 to){
+    Vector2 direction = {to.x - from.x, to.y - from.y};
+    RayHit hit = CastRay(grid, {from, direction, std::hypot(direction.x, direction.y)});
+    return !hit.hit || (hit.x == std::floor(to.x) && hit.y == std::floor(to.y));
+
+}
+
+void AppendConeRays(Vector2 origin, Vector2 direction, float half_angle, uint32_t count, float max_distance, std::vector<GridRay>& rays){
+    float angle = std::atan2(direction.y, direction.x);
+    for (uint32_t i = 0; i < count; i++){
+        float offset = count == 1 ? 0 : -half_angle + 2 * half_angle * i / (count - 1);
+        rays.push_back({origin, {std::cos(angle + offset), std::sin(angle + offset)}, max_distance});
+    }
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "grid.h"
+#include "jobs.h"
+
+#include <raylib.h>
+#include <cstdint>
+#include <vector>
+
+// Rays are in tiles: world positions divided by the tile resolution
+struct GridRay {
+    Vector2 origin;
+    Vector2 direction;  // Need not be normalized
+    float max_distance; // In tiles along direction
+};
+
+struct RayHit {
+    enum Face : uint8_t {
+        NONE, // The ray started inside the tile
+        LEFT,
+        RIGHT,
+        TOP,
+        BOTTOM
+    };
+
+    bool hit = false;
+    uint32_t x = 0;
+    uint32_t y = 0;
+    Face face = NONE;   // Side of the tile the ray entered through
+    float distance = 0; // Along the ray to where it entered the tile, max_distance on a miss
+};
+
+// Walks the tiles the ray passes through in order (Amanatides and Woo's DDA) and stops at the first
+// solid one. Reads the solidity bitmask, so torches are seen through like the player walks through
+// them, and tiles outside the grid are air. Unallocated air chunks are skipped whole.
+RayHit CastRay(const Grid& grid, const GridRay& ray);
+
+// hits[i] is the result for rays[i]. With a JobSystem large batches are split across its workers,
+// for visibility, fog of war and sight checks of many agents at once.
+void CastRays(const Grid& grid, const std::vector<GridRay>& rays, std::vector<RayHit>& hits, JobSystem* jobs = nullptr);
+
+// No solid tile between the two points, the tile holding `to` itself does not block
+bool HasLineOfSight(const Grid& grid, Vector2 from, Vector2 to);
+
+// count rays spread evenly over direction +- half_angle (radians), for vision cones
+void AppendConeRays(Vector2 origin, Vector2 direction, float half_angle, uint32_t count, float max_distance, std::vector<GridRay>& rays);
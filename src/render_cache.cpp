@@ -0,0 +1,161 @@
+#include "render_cache.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+ChunkRange GetVisibleChunks(const Grid& grid, Rectangle bounds, uint16_t tile_resolution){
+    float chunk_pixels = (float)Grid::CHUNK_SIZE * tile_resolution;
+    return {
+        (uint32_t)std::clamp<float>(std::floor(bounds.x / chunk_pixels), 0, grid.chunks_x),
+        (uint32_t)std::clamp<float>(std::floor(bounds.y / chunk_pixels), 0, grid.chunks_y),
+        (uint32_t)std::clamp<float>(std::floor((bounds.x + bounds.width) / chunk_pixels) + 1, 0, grid.chunks_x),
+        (uint32_t)std::clamp<float>(std::floor((bounds.y + bounds.height) / chunk_pixels) + 1, 0, grid.chunks_y)
+    };
+
+}
+
+void DrawChunkTiles(
+    const Grid& grid,
+    const LightMap& light,
+    const TileAtlas& atlas,
+    uint32_t chunk_x,
+    uint32_t chunk_y,
+    uint16_t tile_resolution,
+    Vector2 origin
+){
+    ForEachChunkTile(grid, light, chunk_x, chunk_y, [&](uint32_t x, uint32_t y, Tile tile, uint8_t level){
+        atlas.DrawTile(
+            tile.type,
+            {origin.x + x * tile_resolution, origin.y + y * tile_resolution},
+            GetLightTint(std::max(level >> 4, level & 0xF))
+        );
+    });
+
+}
+
+ChunkRenderCache ChunkRenderCache::New(size_t capacity, uint32_t max_redraws_per_frame){
+    ChunkRenderCache cache;
+    cache.capacity = capacity;
+    cache.max_redraws_per_frame = max_redraws_per_frame;
+    return cache;
+
+}
+
+ChunkRenderCache::Key ChunkRenderCache::GetKey(const Grid& grid, const LightMap& light, uint32_t chunk_x, uint32_t chunk_y) const {
+    bool is_interior = (chunk_x + 1) * Grid::CHUNK_SIZE <= grid.size_x && (chunk_y + 1) * Grid::CHUNK_SIZE <= grid.size_y;
+    if (is_interior && !grid.IsChunkAllocated(chunk_x, chunk_y)){
+        return {SHARED_AIR, 0};
+    }
+    uint32_t chunk = chunk_y * grid.chunks_x + chunk_x;
+    return {chunk, grid.chunk_revisions[chunk] + light.chunk_revisions[chunk]};
+
+}
+
+ChunkRenderCache::Entry* ChunkRenderCache::Acquire(uint32_t chunk, uint16_t tile_resolution){
+    Entry* entry = nullptr;
+    if (entries.size() < capacity){
+        int chunk_pixels = Grid::CHUNK_SIZE * tile_resolution;
+        entries.push_back({SHARED_AIR, 0, 0, LoadRenderTexture(chunk_pixels, chunk_pixels)});
+        entry = &entries.back();
+    } else {
+        // Reuse the least recently drawn entry, as long as it is not needed this frame
+        auto oldest = std::min_element(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){
+            return a.last_used < b.last_used;
+        });
+        if (oldest == entries.end() || oldest->last_used == frame){
+            return nullptr;
+        }
+        auto previous = lookup.find(oldest->chunk);
+        if (previous != lookup.end() && previous->second == (size_t)(oldest - entries.begin())){
+            lookup.erase(previous);
+        }
+        entry = &*oldest;
+    }
+
+    entry->chunk = chunk;
+    entry->last_used = frame;
+    lookup[chunk] = entry - entries.data();
+    return entry;
+
+}
+
+void ChunkRenderCache::Update(const Grid& grid, const LightMap& light, const TileAtlas& atlas, Rectangle bounds, uint16_t tile_resolution){
+    PROFILE_SCOPE("chunk cache update");
+    frame++;
+    if (grid.id != grid_id){
+        // A different grid was loaded, every cached revision is meaningless now
+        lookup.clear();
+        for (Entry& entry : entries){
+            entry.chunk = SHARED_AIR;
+            entry.last_used = 0;
+        }
+        grid_id = grid.id;
+    }
+
+    ChunkRange visible = GetVisibleChunks(grid, bounds, tile_resolution);
+    uint32_t redraws = 0;
+    for (uint32_t chunk_y = visible.start_y; chunk_y < visible.end_y; chunk_y++){
+        for (uint32_t chunk_x = visible.start_x; chunk_x < visible.end_x; chunk_x++){
+            Key key = GetKey(grid, light, chunk_x, chunk_y);
+
+            Entry* entry = nullptr;
+            auto found = lookup.find(key.chunk);
+            if (found != lookup.end()){
+                entry = &entries[found->second];
+                entry->last_used = frame;
+                if (entry->revision == key.revision){
+                    continue;
+                }
+            }
+            if (redraws >= max_redraws_per_frame){
+                continue;
+            }
+            if (entry == nullptr){
+                entry = Acquire(key.chunk, tile_resolution);
+                if (entry == nullptr){
+                    continue;
+                }
+            }
+
+            entry->revision = key.revision;
+            BeginTextureMode(entry->texture);
+            ClearBackground(BLANK);
+            DrawChunkTiles(grid, light, atlas, chunk_x, chunk_y, tile_resolution, {0, 0});
+            EndTextureMode();
+            redraws++;
+        }
+    }
+
+}
+
+void ChunkRenderCache::Draw(const Grid& grid, const LightMap& light, const TileAtlas& atlas, Rectangle bounds, uint16_t tile_resolution) const {
+    ChunkRange visible = GetVisibleChunks(grid, bounds, tile_resolution);
+    float chunk_pixels = (float)Grid::CHUNK_SIZE * tile_resolution;
+    // Render textures are stored upside down
+    Rectangle source = {0, 0, chunk_pixels, -chunk_pixels};
+
+    for (uint32_t chunk_y = visible.start_y; chunk_y < visible.end_y; chunk_y++){
+        for (uint32_t chunk_x = visible.start_x; chunk_x < visible.end_x; chunk_x++){
+            Vector2 origin = {chunk_x * chunk_pixels, chunk_y * chunk_pixels};
+            Key key = GetKey(grid, light, chunk_x, chunk_y);
+
+            auto found = lookup.find(key.chunk);
+            if (grid.id == grid_id && found != lookup.end() && entries[found->second].revision == key.revision){
+                DrawTextureRec(entries[found->second].texture.texture, source, origin, WHITE);
+            } else {
+                DrawChunkTiles(grid, light, atlas, chunk_x, chunk_y, tile_resolution, origin);
+            }
+        }
+    }
+
+}
+
+void ChunkRenderCache::Unload(){
+    for (Entry& entry : entries){
+        UnloadRenderTexture(entry.texture);
+    }
+    entries.clear();
+    lookup.clear();
+
+}
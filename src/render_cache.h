@@ -0,0 +1,88 @@
+#pragma once
+
+#include "grid.h"
+#include "lighting.h"
+#include "tile_atlas.h"
+
+#include <raylib.h>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct ChunkRange {
+    uint32_t start_x, start_y, end_x, end_y; // end exclusive
+};
+
+// Chunks overlapping bounds, clamped to the grid
+ChunkRange GetVisibleChunks(const Grid& grid, Rectangle bounds, uint16_t tile_resolution);
+
+// Calls visit(x, y, tile, light level) for every tile of a chunk inside the grid, with x and y
+// local to the chunk. Drawing goes through this, so it can also be timed without a GPU.
+template <typename Visit>
+void ForEachChunkTile(const Grid& grid, const LightMap& light, uint32_t chunk_x, uint32_t chunk_y, Visit&& visit){
+    const Tile* tiles = grid.GetChunkTiles(chunk_x, chunk_y);
+    const uint8_t* levels = light.GetChunkLight(chunk_y * grid.chunks_x + chunk_x);
+    uint32_t end_x = std::min(Grid::CHUNK_SIZE, grid.size_x - chunk_x * Grid::CHUNK_SIZE);
+    uint32_t end_y = std::min(Grid::CHUNK_SIZE, grid.size_y - chunk_y * Grid::CHUNK_SIZE);
+
+    for (uint32_t y = 0; y < end_y; y++){
+        for (uint32_t x = 0; x < end_x; x++){
+            uint32_t i = (y << Grid::CHUNK_SHIFT) + x;
+            visit(x, y, tiles[i], levels[i]);
+        }
+    }
+}
+
+// Draws every tile of a chunk from the atlas tinted by its light, skipping tiles outside the grid
+void DrawChunkTiles(
+    const Grid& grid,
+    const LightMap& light,
+    const TileAtlas& atlas,
+    uint32_t chunk_x,
+    uint32_t chunk_y,
+    uint16_t tile_resolution,
+    Vector2 origin
+);
+
+// Chunks pre-rendered into render textures, so a visible chunk costs one draw per frame.
+// Entries are keyed by chunk and compared against the sum of the grid's and the light map's
+// chunk revisions, both only grow, so only chunks that were edited or relit since they were
+// cached get redrawn. Full interior air chunks share one texture.
+struct ChunkRenderCache {
+    static constexpr uint32_t SHARED_AIR = UINT32_MAX;
+
+    struct Entry {
+        uint32_t chunk;
+        uint32_t revision;
+        uint64_t last_used;
+        RenderTexture2D texture;
+    };
+
+    size_t capacity = 0;
+    uint32_t max_redraws_per_frame = 0;
+    uint64_t grid_id = 0;
+    uint64_t frame = 0;
+    std::vector<Entry> entries = {};
+    std::unordered_map<uint32_t, size_t> lookup = {};
+
+    static ChunkRenderCache New(size_t capacity, uint32_t max_redraws_per_frame);
+
+    // Redraws stale visible chunks. Must be called outside of BeginDrawing/EndDrawing
+    void Update(const Grid& grid, const LightMap& light, const TileAtlas& atlas, Rectangle bounds, uint16_t tile_resolution);
+
+    // Chunks that missed the redraw limit this frame are drawn tile by tile instead
+    void Draw(const Grid& grid, const LightMap& light, const TileAtlas& atlas, Rectangle bounds, uint16_t tile_resolution) const;
+
+    void Unload();
+
+private:
+    struct Key {
+        uint32_t chunk;
+        uint32_t revision;
+    };
+
+    Key GetKey(const Grid& grid, const LightMap& light, uint32_t chunk_x, uint32_t chunk_y) const;
+
+    Entry* Acquire(uint32_t chunk, uint16_t tile_resolution);
+};
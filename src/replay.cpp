@@ -0,0 +1,201 @@
+#include "replay.h"
+#include "level_format.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace {
+
+    template <typename T>
+    void Put(std::vector<uint8_t>& output, const T& value){
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        output.insert(output.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    bool Get(const uint8_t*& data, const uint8_t* end, T& value){
+        if ((size_t)(end - data) < sizeof(T)){
+            return false;
+        }
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        return true;
+    }
+
+    // Held keys in the low byte, presses above them. F8 starts playback and is never recorded
+    uint32_t PackButtons(const Input& input){
+        const bool buttons[] = {
+            input.held.ctrl, input.held.right, input.held.left, input.held.up,
+            input.held.down, input.held.space, input.held.lmb, input.held.rmb,
+            input.pressed.space, input.pressed.escape, input.pressed.y, input.pressed.n,
+            input.pressed.f4, input.pressed.f5, input.pressed.f6, input.pressed.f7,
+            input.pressed.z
+        };
+        uint32_t bits = 0;
+        for (size_t i = 0; i < std::size(buttons); i++){
+            bits |= (uint32_t)buttons[i] << i;
+        }
+        return bits;
+    }
+
+    void UnpackButtons(uint32_t bits, Input& input){
+        bool* buttons[] = {
+            &input.held.ctrl, &input.held.right, &input.held.left, &input.held.up,
+            &input.held.down, &input.held.space, &input.held.lmb, &input.held.rmb,
+            &input.pressed.space, &input.pressed.escape, &input.pressed.y, &input.pressed.n,
+            &input.pressed.f4, &input.pressed.f5, &input.pressed.f6, &input.pressed.f7,
+            &input.pressed.z
+        };
+        for (size_t i = 0; i < std::size(buttons); i++){
+            *buttons[i] = (bits >> i) & 1;
+        }
+    }
+
+    bool IsSameInput(const Input& a, const Input& b){
+        return PackButtons(a) == PackButtons(b)
+            && a.mouse_position.x == b.mouse_position.x
+            && a.mouse_position.y == b.mouse_position.y
+            && a.mouse_wheel == b.mouse_wheel;
+    }
+
+    std::string GetPath(const std::string& filename){
+        return "replays/" + filename + Replay::EXTENSION;
+    }
+
+} // namespace
+
+bool Replay::SaveToFile(std::string filename) const {
+    std::vector<uint8_t> output;
+    output.insert(output.end(), MAGIC, MAGIC + sizeof(MAGIC));
+    Put(output, VERSION);
+    Put(output, tick_rate);
+    Put(output, seed);
+    Put(output, (uint8_t)game_mode);
+    Put(output, player_rect);
+    Put(output, player_velocity);
+    Put(output, camera_center);
+    Put(output, camera_zoom);
+    Put(output, (uint64_t)level.size());
+    output.insert(output.end(), level.begin(), level.end());
+    Put(output, (uint64_t)entities.size());
+    output.insert(output.end(), entities.begin(), entities.end());
+
+    // Most ticks repeat the previous input, so store (run length, input) pairs
+    std::vector<uint8_t> runs;
+    uint32_t run_count = 0;
+    for (size_t i = 0; i < inputs.size();){
+        size_t run = 1;
+        while (i + run < inputs.size() && IsSameInput(inputs[i], inputs[i + run])){
+            run++;
+        }
+        LevelFormat::WriteVarint(runs, run);
+        Put(runs, PackButtons(inputs[i]));
+        Put(runs, inputs[i].mouse_position);
+        Put(runs, inputs[i].mouse_wheel);
+        run_count++;
+        i += run;
+    }
+    Put(output, (uint64_t)inputs.size());
+    Put(output, run_count);
+    output.insert(output.end(), runs.begin(), runs.end());
+    Put(output, LevelFormat::Crc32(output.data(), output.size()));
+
+    std::filesystem::create_directories("replays");
+    std::ofstream file(GetPath(filename), std::ios::binary);
+    if (!file.is_open()){
+        std::cout << "Error saving replay: could not open " << GetPath(filename) << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(output.data()), output.size());
+    return true;
+
+}
+
+std::optional<Replay> Replay::LoadFromFile(std::string filename){
+    std::ifstream file(GetPath(filename), std::ios::binary);
+    if (!file.is_open()){
+        std::cout << "Error loading replay: could not open " << GetPath(filename) << std::endl;
+        return std::nullopt;
+    }
+    std::vector<uint8_t> input_data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint32_t checksum;
+    if (input_data.size() < sizeof(MAGIC) + sizeof(checksum)){
+        std::cout << "Error loading replay: file is truncated" << std::endl;
+        return std::nullopt;
+    }
+    std::memcpy(&checksum, input_data.data() + input_data.size() - sizeof(checksum), sizeof(checksum));
+    if (LevelFormat::Crc32(input_data.data(), input_data.size() - sizeof(checksum)) != checksum){
+        std::cout << "Error loading replay: checksum mismatch" << std::endl;
+        return std::nullopt;
+    }
+
+    const uint8_t* data = input_data.data();
+    const uint8_t* end = data + input_data.size() - sizeof(checksum);
+    Replay replay;
+    uint16_t version;
+    uint8_t game_mode;
+    uint64_t level_size, entities_size, tick_count;
+    uint32_t run_count;
+    if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0){
+        std::cout << "Error loading replay: not a replay file" << std::endl;
+        return std::nullopt;
+    }
+    data += sizeof(MAGIC);
+    bool header_read = Get(data, end, version) && version == VERSION
+        && Get(data, end, replay.tick_rate)
+        && Get(data, end, replay.seed)
+        && Get(data, end, game_mode)
+        && Get(data, end, replay.player_rect)
+        && Get(data, end, replay.player_velocity)
+        && Get(data, end, replay.camera_center)
+        && Get(data, end, replay.camera_zoom)
+        && Get(data, end, level_size)
+        && level_size <= (uint64_t)(end - data);
+    if (!header_read){
+        std::cout << "Error loading replay: unsupported version or truncated header" << std::endl;
+        return std::nullopt;
+    }
+    replay.game_mode = (GameMode)game_mode;
+    replay.level.assign(data, data + level_size);
+    data += level_size;
+
+    if (!Get(data, end, entities_size) || entities_size > (uint64_t)(end - data)){
+        std::cout << "Error loading replay: truncated entities" << std::endl;
+        return std::nullopt;
+    }
+    replay.entities.assign(data, data + entities_size);
+    data += entities_size;
+
+    if (!Get(data, end, tick_count) || !Get(data, end, run_count)){
+        std::cout << "Error loading replay: truncated input header" << std::endl;
+        return std::nullopt;
+    }
+    replay.inputs.reserve(tick_count);
+    for (uint32_t i = 0; i < run_count; i++){
+        uint32_t run;
+        uint32_t buttons;
+        Input input{};
+        if (!LevelFormat::ReadVarint(data, end, run)
+            || !Get(data, end, buttons)
+            || !Get(data, end, input.mouse_position)
+            || !Get(data, end, input.mouse_wheel)
+            || run > tick_count - replay.inputs.size())
+        {
+            std::cout << "Error loading replay: corrupt input run " << i << std::endl;
+            return std::nullopt;
+        }
+        UnpackButtons(buttons, input);
+        replay.inputs.insert(replay.inputs.end(), run, input);
+    }
+    if (replay.inputs.size() != tick_count){
+        std::cout << "Error loading replay: expected " << tick_count << " ticks" << std::endl;
+        return std::nullopt;
+    }
+
+    return replay;
+
+}
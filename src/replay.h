@@ -0,0 +1,33 @@
+#pragma once
+
+#include "model.h"
+
+#include <raylib.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// A recorded session: everything the simulation starts from plus the Input of every tick.
+// Stored in replays/<name>.rpl as a fixed header, the initial grid in .cave encoding, the
+// initial entities and run-length encoded inputs, followed by a CRC32 of everything before it.
+struct Replay {
+    static constexpr char MAGIC[4] = {'C', 'R', 'P', 'L'};
+    static constexpr uint16_t VERSION = 3;
+    static constexpr const char* EXTENSION = ".rpl";
+
+    uint16_t tick_rate = 0;
+    uint64_t seed = 0;
+    GameMode game_mode = GameMode::EDITOR;
+    Rectangle player_rect = {0, 0, 0, 0};
+    Vector2 player_velocity = {0, 0};
+    Vector2 camera_center = {0, 0};
+    float camera_zoom = 1;
+    std::vector<uint8_t> level = {};
+    std::vector<uint8_t> entities = {}; // EntityStore::ToBinary
+    std::vector<Input> inputs = {};
+
+    bool SaveToFile(std::string filename) const;
+
+    static std::optional<Replay> LoadFromFile(std::string filename);
+};
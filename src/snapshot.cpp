@@ -0,0 +1,164 @@
+#include "snapshot.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+void SnapshotWriter::CopyChunks(
+    const Grid& grid,
+    const LightMap& light,
+    Rectangle bounds,
+    uint16_t tile_resolution,
+    RenderSnapshot& snapshot
+){
+    PROFILE_SCOPE("copy chunks");
+    if (grid.id != grid_id){
+        grid_id = grid.id;
+        sent_revisions.assign(grid.chunks_x * grid.chunks_y, NOT_SENT);
+        sent_light_revisions.assign(grid.chunks_x * grid.chunks_y, NOT_SENT);
+        sent_chunks.clear();
+    }
+    snapshot.grid_id = grid.id;
+    snapshot.grid_width = grid.size_x;
+    snapshot.grid_height = grid.size_y;
+
+    float chunk_pixels = (float)Grid::CHUNK_SIZE * tile_resolution;
+    int64_t start_x = std::clamp<int64_t>(std::floor(bounds.x / chunk_pixels) - margin, 0, grid.chunks_x);
+    int64_t start_y = std::clamp<int64_t>(std::floor(bounds.y / chunk_pixels) - margin, 0, grid.chunks_y);
+    int64_t end_x = std::clamp<int64_t>(std::floor((bounds.x + bounds.width) / chunk_pixels) + 1 + margin, 0, grid.chunks_x);
+    int64_t end_y = std::clamp<int64_t>(std::floor((bounds.y + bounds.height) / chunk_pixels) + 1 + margin, 0, grid.chunks_y);
+
+    std::erase_if(sent_chunks, [&](uint32_t chunk){
+        int64_t chunk_x = chunk % grid.chunks_x;
+        int64_t chunk_y = chunk / grid.chunks_x;
+        if (start_x <= chunk_x && chunk_x < end_x && start_y <= chunk_y && chunk_y < end_y){
+            return false;
+        }
+        snapshot.dropped_chunks.push_back(chunk);
+        sent_revisions[chunk] = NOT_SENT;
+        sent_light_revisions[chunk] = NOT_SENT;
+        return true;
+    });
+
+    for (int64_t chunk_y = start_y; chunk_y < end_y; chunk_y++){
+        for (int64_t chunk_x = start_x; chunk_x < end_x; chunk_x++){
+            uint32_t chunk = chunk_y * grid.chunks_x + chunk_x;
+            uint32_t revision = grid.chunk_revisions[chunk];
+            // The light map lags behind on a freshly loaded grid until its first Sync
+            uint32_t light_revision = light.grid_id == grid.id ? light.chunk_revisions[chunk] : 0;
+            if (sent_revisions[chunk] == revision && sent_light_revisions[chunk] == light_revision){
+                continue;
+            }
+            if (sent_revisions[chunk] == NOT_SENT){
+                sent_chunks.push_back(chunk);
+            }
+            sent_revisions[chunk] = revision;
+            sent_light_revisions[chunk] = light_revision;
+
+            RenderSnapshot::ChunkCopy& copy = snapshot.chunks.emplace_back();
+            copy.chunk = chunk;
+            copy.revision = revision;
+            copy.light_revision = light_revision;
+            if (grid.IsChunkAllocated(chunk_x, chunk_y)){
+                const Tile* tiles = grid.GetChunkTiles(chunk_x, chunk_y);
+                copy.tiles.assign(tiles, tiles + Grid::CHUNK_AREA);
+            }
+            if (light.grid_id == grid.id && light.IsChunkAllocated(chunk)){
+                const uint8_t* levels = light.GetChunkLight(chunk);
+                copy.light.assign(levels, levels + Grid::CHUNK_AREA);
+            }
+        }
+    }
+
+}
+
+bool SnapshotWriter::IsLodZoom(float zoom, uint16_t tile_resolution, float max_tile_pixels){
+    return tile_resolution * zoom <= max_tile_pixels;
+
+}
+
+void SnapshotWriter::CopyLodView(
+    const Grid& grid,
+    const LightMap& light,
+    const TilePyramid& pyramid,
+    Rectangle bounds,
+    float zoom,
+    uint16_t tile_resolution,
+    RenderSnapshot& snapshot
+){
+    PROFILE_SCOPE("copy lod view");
+    snapshot.grid_id = grid.id;
+    snapshot.grid_width = grid.size_x;
+    snapshot.grid_height = grid.size_y;
+
+    uint32_t level = 0;
+    // A pyramid that has not caught up with a new grid yet only offers the grid itself
+    while (pyramid.grid_id == grid.id && tile_resolution * zoom * (1u << level) < 1 && level + 1 < pyramid.GetLevelCount()){
+        level++;
+    }
+    float cell_pixels = (float)((uint32_t)tile_resolution << level);
+    int64_t start_x = std::floor(bounds.x / cell_pixels);
+    int64_t start_y = std::floor(bounds.y / cell_pixels);
+    int64_t end_x = std::floor((bounds.x + bounds.width) / cell_pixels) + 1;
+    int64_t end_y = std::floor((bounds.y + bounds.height) / cell_pixels) + 1;
+    snapshot.lod_view = pyramid.CopyView(grid, &light, level, start_x, start_y, end_x - start_x, end_y - start_y);
+
+}
+
+void SnapshotWriter::CopyMinimap(const Grid& grid, const TilePyramid& pyramid, uint32_t max_size, RenderSnapshot& snapshot){
+    if (pyramid.grid_id != grid.id){
+        return;
+    }
+    uint32_t level = 0;
+    while (std::max(pyramid.GetLevelWidth(grid, level), pyramid.GetLevelHeight(grid, level)) > max_size && level + 1 < pyramid.GetLevelCount()){
+        level++;
+    }
+    if (grid.id == minimap_grid_id && level == minimap_level && pyramid.level_revisions[level] == minimap_revision){
+        return;
+    }
+    PROFILE_SCOPE("copy minimap");
+    minimap_grid_id = grid.id;
+    minimap_level = level;
+    minimap_revision = pyramid.level_revisions[level];
+    // Unlit, the minimap shows the layout rather than what the player can see
+    snapshot.minimap = pyramid.CopyView(grid, nullptr, level, 0, 0, pyramid.GetLevelWidth(grid, level), pyramid.GetLevelHeight(grid, level));
+
+}
+
+void SnapshotWriter::ResetMinimap(){
+    minimap_grid_id = 0;
+
+}
+
+void GridMirror::Apply(const RenderSnapshot& snapshot){
+    PROFILE_SCOPE("apply snapshot");
+    if (grid.id != snapshot.grid_id){
+        grid = Grid(snapshot.grid_width, snapshot.grid_height);
+        grid.id = snapshot.grid_id;
+        light = LightMap::New(snapshot.grid_width, snapshot.grid_height);
+    }
+
+    for (uint32_t chunk : snapshot.dropped_chunks){
+        grid.ReleaseChunk(chunk % grid.chunks_x, chunk / grid.chunks_x);
+        light.ReleaseChunk(chunk);
+    }
+    for (const RenderSnapshot::ChunkCopy& copy : snapshot.chunks){
+        uint32_t chunk_x = copy.chunk % grid.chunks_x;
+        uint32_t chunk_y = copy.chunk / grid.chunks_x;
+        if (copy.tiles.empty()){
+            grid.ReleaseChunk(chunk_x, chunk_y);
+        } else {
+            std::memcpy(grid.GetChunkTilesMutable(chunk_x, chunk_y), copy.tiles.data(), Grid::CHUNK_AREA * sizeof(Tile));
+        }
+        // Nothing collides against the mirror, so its solidity mask is left alone
+        grid.chunk_revisions[copy.chunk] = copy.revision;
+        if (copy.light.empty()){
+            light.ReleaseChunk(copy.chunk);
+            light.chunk_revisions[copy.chunk] = copy.light_revision;
+        } else {
+            light.SetChunkLight(copy.chunk, copy.light.data(), copy.light_revision);
+        }
+    }
+
+}
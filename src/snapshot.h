@@ -0,0 +1,106 @@
+#pragma once
+
+#include "camera.h"
+#include "grid.h"
+#include "lighting.h"
+#include "model.h"
+#include "tile_pyramid.h"
+
+#include <raylib.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// What Render needs from the end of a batch of ticks, copied out so the next batch can be
+// simulated on another thread while this one is drawn. Tiles travel as deltas: only chunks
+// near the camera whose revision changed since the previous snapshot are included.
+struct RenderSnapshot {
+    struct ChunkCopy {
+        uint32_t chunk = 0;
+        uint32_t revision = 0;
+        uint32_t light_revision = 0;
+        std::vector<Tile> tiles = {};    // Empty for an air chunk
+        std::vector<uint8_t> light = {}; // Empty for a dark chunk
+    };
+
+    struct EntitySprite {
+        Rectangle rect;
+        uint16_t sprite;
+    };
+
+    uint64_t tick = 0;
+    GameMode game_mode = EDITOR;
+    uint16_t tile_place_type = 1;
+    bool exit_requested = false;
+    bool profiler_overlay = false;
+    bool minimap_visible = false;
+    std::string level_prompt = {}; // Empty unless a level name is being typed
+    std::string level_status = {}; // Save or load progress, or its result
+    CenteredCamera camera = {};    // Interpolated
+    Sprite player_sprite = {};     // Interpolated
+    uint64_t grid_id = 0;
+    uint32_t grid_width = 0;
+    uint32_t grid_height = 0;
+    std::vector<ChunkCopy> chunks = {};
+    std::vector<uint32_t> dropped_chunks = {}; // Left the camera's range, the mirror can free them
+    std::optional<TileView> lod_view = {};     // Sent instead of chunks when zoomed out, see CopyLodView
+    std::optional<TileView> minimap = {};      // Only when it changed since the previous snapshot
+    std::vector<EntitySprite> entities = {};   // Only those inside the camera bounds
+    std::optional<Vector2u> reached_tile = {}; // PLAY only, the tile breaking would take
+};
+
+// Simulation side: remembers which chunk revisions the render side already holds
+struct SnapshotWriter {
+    static constexpr uint32_t NOT_SENT = UINT32_MAX;
+
+    uint32_t margin = 1; // Chunks copied around the camera bounds
+    uint64_t grid_id = 0;
+    std::vector<uint32_t> sent_revisions = {};
+    std::vector<uint32_t> sent_light_revisions = {};
+    std::vector<uint32_t> sent_chunks = {};
+
+    void CopyChunks(
+        const Grid& grid,
+        const LightMap& light,
+        Rectangle bounds,
+        uint16_t tile_resolution,
+        RenderSnapshot& snapshot
+    );
+
+    // Whether tiles are small enough on screen to draw the pyramid instead of chunks
+    static bool IsLodZoom(float zoom, uint16_t tile_resolution, float max_tile_pixels);
+
+    // The visible cells of the finest pyramid level with at least one screen pixel per cell, so
+    // the copy is never larger than the window. Chunks are not sent meanwhile, the mirror catches
+    // up by revision once CopyChunks runs again.
+    void CopyLodView(
+        const Grid& grid,
+        const LightMap& light,
+        const TilePyramid& pyramid,
+        Rectangle bounds,
+        float zoom,
+        uint16_t tile_resolution,
+        RenderSnapshot& snapshot
+    );
+
+    // The whole grid from the finest level at most max_size cells across, when the pyramid
+    // changed there since it was last sent. Call ResetMinimap while skipping it, so it is sent again.
+    void CopyMinimap(const Grid& grid, const TilePyramid& pyramid, uint32_t max_size, RenderSnapshot& snapshot);
+
+    void ResetMinimap();
+
+private:
+    uint64_t minimap_grid_id = 0;
+    uint32_t minimap_level = 0;
+    uint32_t minimap_revision = 0;
+};
+
+// Render side copy of the grid and its light, holding only the chunks snapshots carried.
+// Revisions and id follow the simulation, so ChunkRenderCache works on it unchanged.
+struct GridMirror {
+    Grid grid = Grid(0, 0);
+    LightMap light = {};
+
+    void Apply(const RenderSnapshot& snapshot);
+};
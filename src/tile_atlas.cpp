@@ -0,0 +1,63 @@
+#include "tile_atlas.h"
+
+#include <cmath>
+
+TileAtlas TileAtlas::Load(const Image& spritesheet, uint16_t tile_resolution, uint16_t tile_type_count){
+    TileAtlas atlas{
+        LoadTextureFromImage(spritesheet),
+        std::vector<Rectangle>(tile_type_count),
+        tile_resolution,
+        std::vector<Color>(tile_type_count, BLANK)
+    };
+
+    uint32_t tiles_per_row = spritesheet.width / tile_resolution;
+    for (uint32_t index = 0; index < tile_type_count; index++){
+        atlas.source_rects[index] = {
+            (float)(index % tiles_per_row * tile_resolution),
+            (float)(index / tiles_per_row * tile_resolution),
+            (float)tile_resolution,
+            (float)tile_resolution
+        };
+    }
+
+    // Alpha weighted so transparent pixels do not darken the colour
+    Color* pixels = LoadImageColors(spritesheet);
+    for (uint32_t index = 1; index < tile_type_count; index++){
+        const Rectangle& rect = atlas.source_rects[index];
+        uint64_t r = 0, g = 0, b = 0, a = 0;
+        for (uint32_t y = rect.y; y < rect.y + rect.height && y < (uint32_t)spritesheet.height; y++){
+            for (uint32_t x = rect.x; x < rect.x + rect.width && x < (uint32_t)spritesheet.width; x++){
+                Color pixel = pixels[y * spritesheet.width + x];
+                r += pixel.r * pixel.a;
+                g += pixel.g * pixel.a;
+                b += pixel.b * pixel.a;
+                a += pixel.a;
+            }
+        }
+        if (a != 0){
+            atlas.average_colors[index] = {(uint8_t)(r / a), (uint8_t)(g / a), (uint8_t)(b / a), 255};
+        }
+    }
+    UnloadImageColors(pixels);
+
+    return atlas;
+
+}
+
+void TileAtlas::DrawTile(uint16_t tile_type, Vector2 position, Color tint) const {
+    DrawTextureRec(texture, source_rects.at(tile_type), position, tint);
+
+}
+
+void TileAtlas::DrawTileScaled(uint16_t tile_type, Vector2 position, float scale, Color tint) const {
+    Rectangle destination = {position.x, position.y, tile_resolution * scale, tile_resolution * scale};
+    DrawTexturePro(texture, source_rects.at(tile_type), destination, {0, 0}, 0, tint);
+
+}
+
+void TileAtlas::Unload(){
+    UnloadTexture(texture);
+    source_rects.clear();
+    average_colors.clear();
+
+}
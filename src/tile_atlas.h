@@ -0,0 +1,23 @@
+#pragma once
+
+#include <raylib.h>
+#include <cstdint>
+#include <vector>
+
+// The whole tile spritesheet as one texture plus a source rectangle per tile type, so
+// consecutive tile draws share a texture and raylib can batch them
+struct TileAtlas {
+    Texture2D texture = {};
+    std::vector<Rectangle> source_rects = {};
+    uint16_t tile_resolution = 0;
+    // One colour per tile type for drawing a tile smaller than a pixel, air is blank
+    std::vector<Color> average_colors = {};
+
+    static TileAtlas Load(const Image& spritesheet, uint16_t tile_resolution, uint16_t tile_type_count);
+
+    void DrawTile(uint16_t tile_type, Vector2 position, Color tint) const;
+
+    void DrawTileScaled(uint16_t tile_type, Vector2 position, float scale, Color tint) const;
+
+    void Unload();
+};
@@ -0,0 +1,347 @@
+#include "tile_pyramid.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+namespace {
+
+    // Most common of four cells, ties go to solid tiles over air
+    inline uint8_t Dominant(uint8_t a, uint8_t b, uint8_t c, uint8_t d){
+        uint8_t cells[4] = {a, b, c, d};
+        uint8_t best = a;
+        int best_count = 0;
+        for (uint8_t cell : cells){
+            int count = (cell == a) + (cell == b) + (cell == c) + (cell == d);
+            if (count > best_count || (count == best_count && best == 0 && cell != 0)){
+                best = cell;
+                best_count = count;
+            }
+        }
+        return best;
+    }
+
+    inline uint8_t ToCell(Tile tile){
+        return (uint8_t)std::min<uint16_t>(tile.type, UINT8_MAX);
+    }
+
+    // Where a per chunk level starts in a chunk's cells
+    constexpr uint32_t LevelOffset(uint32_t level){
+        uint32_t offset = 0;
+        for (uint32_t below = 1; below < level; below++){
+            offset += (Grid::CHUNK_SIZE >> below) * (Grid::CHUNK_SIZE >> below);
+        }
+        return offset;
+    }
+
+} // namespace
+
+bool TilePyramid::IsInSync(const Grid& grid) const {
+    return grid.id == grid_id && synced_revisions.size() == grid.chunk_revisions.size();
+
+}
+
+void TilePyramid::Rebuild(const Grid& grid){
+    PROFILE_SCOPE("pyramid rebuild");
+    Reset(grid);
+    Sync(grid);
+
+}
+
+void TilePyramid::Reset(const Grid& grid){
+    grid_id = grid.id;
+    chunks_x = grid.chunks_x;
+    chunk_index.assign(grid.chunks_x * grid.chunks_y, UNIFORM_CHUNK);
+    chunk_cells.assign(CHUNK_CELLS, 0);
+    free_slots.clear();
+    synced_revisions.assign(grid.chunks_x * grid.chunks_y, UNSYNCED);
+
+    level_count = 1;
+    uint32_t width = grid.size_x;
+    uint32_t height = grid.size_y;
+    while (width > 1 || height > 1){
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        level_count++;
+    }
+    // The first dense level always exists, even above the top of a grid smaller than a chunk
+    levels.clear();
+    width = grid.chunks_x;
+    height = grid.chunks_y;
+    for (uint32_t level = Grid::CHUNK_SHIFT; level == Grid::CHUNK_SHIFT || level < level_count; level++){
+        levels.push_back({width, height, std::vector<uint8_t>((size_t)width * height, 0)});
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    level_revisions.assign(Grid::CHUNK_SHIFT + levels.size(), 0);
+
+}
+
+void TilePyramid::DownsampleChunk(const Grid& grid, uint32_t chunk){
+    const Tile* tiles = grid.GetChunkTiles(chunk % grid.chunks_x, chunk / grid.chunks_x);
+    uint8_t cells[CHUNK_CELLS];
+    for (uint32_t y = 0; y < Grid::CHUNK_SIZE / 2; y++){
+        const Tile* row = tiles + (y * 2 << Grid::CHUNK_SHIFT);
+        for (uint32_t x = 0; x < Grid::CHUNK_SIZE / 2; x++){
+            cells[y * (Grid::CHUNK_SIZE / 2) + x] = Dominant(
+                ToCell(row[x * 2]),
+                ToCell(row[x * 2 + 1]),
+                ToCell(row[Grid::CHUNK_SIZE + x * 2]),
+                ToCell(row[Grid::CHUNK_SIZE + x * 2 + 1])
+            );
+        }
+    }
+    for (uint32_t level = 2; level <= CHUNK_LEVELS; level++){
+        uint32_t side = Grid::CHUNK_SIZE >> level;
+        const uint8_t* below = cells + LevelOffset(level - 1);
+        uint8_t* target = cells + LevelOffset(level);
+        for (uint32_t y = 0; y < side; y++){
+            for (uint32_t x = 0; x < side; x++){
+                target[y * side + x] = Dominant(
+                    below[y * 2 * side * 2 + x * 2],
+                    below[y * 2 * side * 2 + x * 2 + 1],
+                    below[(y * 2 + 1) * side * 2 + x * 2],
+                    below[(y * 2 + 1) * side * 2 + x * 2 + 1]
+                );
+            }
+        }
+    }
+    const uint8_t* last = cells + LevelOffset(CHUNK_LEVELS);
+    uint8_t top = Dominant(last[0], last[1], last[2], last[3]);
+
+    // What the chunk read as before, to tell which levels changed
+    uint32_t& slot = chunk_index[chunk];
+    uint8_t previous[CHUNK_CELLS];
+    if (slot == UNIFORM_CHUNK){
+        std::fill_n(previous, CHUNK_CELLS, levels[0].cells[chunk]);
+    } else {
+        std::copy_n(&chunk_cells[(size_t)slot * CHUNK_CELLS], CHUNK_CELLS, previous);
+    }
+    level_revisions[0]++;
+    for (uint32_t level = 1; level <= CHUNK_LEVELS; level++){
+        uint32_t side = Grid::CHUNK_SIZE >> level;
+        if (!std::equal(cells + LevelOffset(level), cells + LevelOffset(level) + side * side, previous + LevelOffset(level))){
+            level_revisions[level]++;
+        }
+    }
+
+    if (std::all_of(cells, cells + CHUNK_CELLS, [top](uint8_t cell){ return cell == top; })){
+        ReleaseChunk(chunk);
+    } else {
+        if (slot == UNIFORM_CHUNK){
+            if (!free_slots.empty()){
+                slot = free_slots.back();
+                free_slots.pop_back();
+            } else {
+                slot = chunk_cells.size() / CHUNK_CELLS;
+                chunk_cells.resize(chunk_cells.size() + CHUNK_CELLS);
+            }
+        }
+        std::copy_n(cells, CHUNK_CELLS, &chunk_cells[(size_t)slot * CHUNK_CELLS]);
+    }
+    SetChunkCell(chunk, top);
+
+}
+
+void TilePyramid::SetChunkCell(uint32_t chunk, uint8_t cell){
+    uint32_t x = chunk % chunks_x;
+    uint32_t y = chunk / chunks_x;
+    for (uint32_t k = 0; k < levels.size(); k++){
+        Level& target = levels[k];
+        if (k > 0){
+            const Level& below = levels[k - 1];
+            auto get = [&below](uint32_t below_x, uint32_t below_y) -> uint8_t {
+                return below_x < below.width && below_y < below.height ? below.cells[(size_t)below_y * below.width + below_x] : 0;
+            };
+            x /= 2;
+            y /= 2;
+            cell = Dominant(get(x * 2, y * 2), get(x * 2 + 1, y * 2), get(x * 2, y * 2 + 1), get(x * 2 + 1, y * 2 + 1));
+        }
+        uint8_t& stored = target.cells[(size_t)y * target.width + x];
+        if (stored == cell){
+            return;
+        }
+        stored = cell;
+        level_revisions[Grid::CHUNK_SHIFT + k]++;
+    }
+
+}
+
+void TilePyramid::ReleaseChunk(uint32_t chunk){
+    uint32_t& slot = chunk_index[chunk];
+    if (slot != UNIFORM_CHUNK){
+        free_slots.push_back(slot);
+        slot = UNIFORM_CHUNK;
+    }
+
+}
+
+void TilePyramid::OnTilePlaced(const Grid& grid, uint32_t x, uint32_t y){
+    OnRegionChanged(grid, TileRegion{x, y, 1, 1});
+
+}
+
+void TilePyramid::OnRegionChanged(const Grid& grid, TileRegion region){
+    if (!IsInSync(grid)){
+        Reset(grid);
+        return;
+    }
+    if (region.IsEmpty()){
+        return;
+    }
+    // Chunks not downsampled yet are left to Sync
+    for (uint32_t chunk_y = region.y >> Grid::CHUNK_SHIFT; chunk_y <= (region.y + region.height - 1) >> Grid::CHUNK_SHIFT; chunk_y++){
+        for (uint32_t chunk_x = region.x >> Grid::CHUNK_SHIFT; chunk_x <= (region.x + region.width - 1) >> Grid::CHUNK_SHIFT; chunk_x++){
+            uint32_t chunk = chunk_y * grid.chunks_x + chunk_x;
+            if (synced_revisions[chunk] != UNSYNCED && grid.IsChunkLoaded(chunk)){
+                DownsampleChunk(grid, chunk);
+                synced_revisions[chunk] = grid.chunk_revisions[chunk];
+            }
+        }
+    }
+
+}
+
+void TilePyramid::Sync(const Grid& grid, uint32_t max_new_chunks){
+    if (!IsInSync(grid)){
+        Reset(grid);
+    }
+    uint32_t new_chunks = 0;
+    for (uint32_t chunk = 0; chunk < synced_revisions.size(); chunk++){
+        if (synced_revisions[chunk] == grid.chunk_revisions[chunk]){
+            continue;
+        }
+        // A missing chunk reads as air, what was seen of it stays as its dense cell
+        if (!grid.IsChunkLoaded(chunk)){
+            if (chunk_index[chunk] != UNIFORM_CHUNK){
+                ReleaseChunk(chunk);
+                for (uint32_t level = 1; level <= CHUNK_LEVELS; level++){
+                    level_revisions[level]++;
+                }
+            }
+            synced_revisions[chunk] = grid.chunk_revisions[chunk];
+            continue;
+        }
+        if (synced_revisions[chunk] == UNSYNCED){
+            if (new_chunks == max_new_chunks){
+                continue;
+            }
+            new_chunks++;
+        }
+        DownsampleChunk(grid, chunk);
+        synced_revisions[chunk] = grid.chunk_revisions[chunk];
+    }
+
+}
+
+uint32_t TilePyramid::GetLevelCount() const {
+    return level_count;
+
+}
+
+uint32_t TilePyramid::GetLevelWidth(const Grid& grid, uint32_t level) const {
+    if (level >= Grid::CHUNK_SHIFT){
+        return levels[level - Grid::CHUNK_SHIFT].width;
+    }
+    return (grid.size_x + (1u << level) - 1) >> level;
+
+}
+
+uint32_t TilePyramid::GetLevelHeight(const Grid& grid, uint32_t level) const {
+    if (level >= Grid::CHUNK_SHIFT){
+        return levels[level - Grid::CHUNK_SHIFT].height;
+    }
+    return (grid.size_y + (1u << level) - 1) >> level;
+
+}
+
+uint8_t TilePyramid::GetCell(const Grid& grid, uint32_t level, uint32_t x, uint32_t y) const {
+    if (level == 0){
+        return grid.InBounds(x, y) ? ToCell(grid.GetTileUnchecked(x, y)) : 0;
+    }
+    if (x >= GetLevelWidth(grid, level) || y >= GetLevelHeight(grid, level)){
+        return 0;
+    }
+    if (level >= Grid::CHUNK_SHIFT){
+        const Level& source = levels[level - Grid::CHUNK_SHIFT];
+        return source.cells[(size_t)y * source.width + x];
+    }
+    uint32_t shift = Grid::CHUNK_SHIFT - level;
+    uint32_t chunk = (y >> shift) * chunks_x + (x >> shift);
+    uint32_t slot = chunk_index[chunk];
+    if (slot == UNIFORM_CHUNK){
+        return levels[0].cells[chunk];
+    }
+    uint32_t mask = (1u << shift) - 1;
+    return chunk_cells[(size_t)slot * CHUNK_CELLS + LevelOffset(level) + ((y & mask) << shift) + (x & mask)];
+
+}
+
+TileView TilePyramid::CopyView(const Grid& grid, const LightMap* light, uint32_t level, int64_t x, int64_t y, uint32_t width, uint32_t height) const {
+    int64_t level_width = GetLevelWidth(grid, level);
+    int64_t level_height = GetLevelHeight(grid, level);
+    int64_t start_x = std::clamp<int64_t>(x, 0, level_width);
+    int64_t start_y = std::clamp<int64_t>(y, 0, level_height);
+    int64_t end_x = std::clamp<int64_t>(x + width, 0, level_width);
+    int64_t end_y = std::clamp<int64_t>(y + height, 0, level_height);
+
+    TileView view;
+    view.level = level;
+    view.x = start_x;
+    view.y = start_y;
+    view.width = end_x - start_x;
+    view.height = end_y - start_y;
+    view.types.resize((size_t)view.width * view.height);
+    bool lit = level == 0 && light != nullptr && light->grid_id == grid.id;
+    if (lit){
+        view.light.resize(view.types.size());
+    }
+
+    size_t i = 0;
+    for (int64_t cell_y = start_y; cell_y < end_y; cell_y++){
+        if (level == 0){
+            // A chunk's stretch of the row at a time, straight from the chunk and light pools
+            uint32_t local_y = (cell_y & Grid::CHUNK_MASK) << Grid::CHUNK_SHIFT;
+            for (int64_t cell_x = start_x; cell_x < end_x;){
+                uint32_t chunk_x = cell_x >> Grid::CHUNK_SHIFT;
+                uint32_t chunk = (cell_y >> Grid::CHUNK_SHIFT) * grid.chunks_x + chunk_x;
+                int64_t span_end = std::min<int64_t>(end_x, (int64_t)(chunk_x + 1) << Grid::CHUNK_SHIFT);
+                uint32_t local = local_y + (cell_x & Grid::CHUNK_MASK);
+                const Tile* tiles = grid.GetChunkTiles(chunk_x, cell_y >> Grid::CHUNK_SHIFT) + local;
+                for (int64_t j = 0; j < span_end - cell_x; j++){
+                    view.types[i + j] = ToCell(tiles[j]);
+                }
+                if (lit){
+                    const uint8_t* levels = light->GetChunkLight(chunk) + local;
+                    std::copy(levels, levels + (span_end - cell_x), view.light.begin() + i);
+                }
+                i += span_end - cell_x;
+                cell_x = span_end;
+            }
+        } else if (level < Grid::CHUNK_SHIFT){
+            // Same for the per chunk levels, uniform chunks fill their stretch with one cell
+            uint32_t shift = Grid::CHUNK_SHIFT - level;
+            uint32_t mask = (1u << shift) - 1;
+            uint32_t local_y = (cell_y & mask) << shift;
+            for (int64_t cell_x = start_x; cell_x < end_x;){
+                uint32_t chunk = (cell_y >> shift) * chunks_x + (cell_x >> shift);
+                int64_t span_end = std::min<int64_t>(end_x, ((cell_x >> shift) + 1) << shift);
+                uint32_t slot = chunk_index[chunk];
+                if (slot == UNIFORM_CHUNK){
+                    std::fill_n(view.types.begin() + i, span_end - cell_x, levels[0].cells[chunk]);
+                } else {
+                    const uint8_t* cells = &chunk_cells[(size_t)slot * CHUNK_CELLS + LevelOffset(level) + local_y + (cell_x & mask)];
+                    std::copy(cells, cells + (span_end - cell_x), view.types.begin() + i);
+                }
+                i += span_end - cell_x;
+                cell_x = span_end;
+            }
+        } else {
+            const Level& source = levels[level - Grid::CHUNK_SHIFT];
+            const uint8_t* row = &source.cells[(size_t)cell_y * source.width];
+            std::copy(row + start_x, row + end_x, view.types.begin() + i);
+            i += view.width;
+        }
+    }
+    return view;
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "grid.h"
+#include "lighting.h"
+
+#include <cstdint>
+#include <vector>
+
+// A rectangle of cells from one pyramid level, copied out for the render thread
+struct TileView {
+    uint32_t level = 0; // Each cell covers 2^level x 2^level tiles
+    uint32_t x = 0;     // First cell
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> types = {};
+    std::vector<uint8_t> light = {}; // Level 0 only, packed like LightMap. Empty when unlit.
+};
+
+// Downsampled copies of the grid for drawing it zoomed out and on the minimap. Level k holds one
+// tile type per 2^k x 2^k block, the most common of the four cells below it with ties going to
+// solid tiles so thin walls stay visible. Level 0 is the grid itself.
+//
+// Levels below CHUNK_SHIFT are kept per grid chunk in a pool, CHUNK_CELLS bytes a chunk. A chunk
+// whose cells are all the same, such as open sky or solid rock, takes no slot and reads as its
+// one cell in the first dense level, where each cell covers a whole chunk. Dense levels are
+// small, about a byte per chunk in all. Follows the grid like LightMap: Sync downsamples a
+// bounded number of new chunks per call, and chunks the pager evicted give up their slot but
+// keep their dense cell, so what the player has seen stays on the minimap.
+struct TilePyramid {
+    // Per chunk levels 1 to CHUNK_SHIFT - 1, side CHUNK_SIZE >> level each
+    static constexpr uint32_t CHUNK_LEVELS = Grid::CHUNK_SHIFT - 1;
+    static constexpr uint32_t CHUNK_CELLS = (Grid::CHUNK_AREA - 4) / 3; // 1364
+    static constexpr uint32_t UNIFORM_CHUNK = 0;
+    static constexpr uint32_t UNSYNCED = UINT32_MAX;
+
+    struct Level {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> cells = {};
+    };
+
+    uint64_t grid_id = 0;
+    uint32_t level_count = 0;
+    uint32_t chunks_x = 0;
+    // Pool slot of each grid chunk's cells, slot 0 is never used
+    std::vector<uint32_t> chunk_index = {};
+    std::vector<uint8_t> chunk_cells = {};
+    std::vector<uint32_t> free_slots = {};
+    std::vector<Level> levels = {}; // levels[k] is level CHUNK_SHIFT + k
+    // Bumped whenever a cell of the level changes, index 0 follows the grid
+    std::vector<uint32_t> level_revisions = {};
+    // Grid::chunk_revisions each chunk was last downsampled for, UNSYNCED for chunks not yet
+    std::vector<uint32_t> synced_revisions = {};
+
+    // Downsamples every loaded chunk of the grid from scratch at once
+    void Rebuild(const Grid& grid);
+
+    // Drops all cells and follows a different grid, Sync then downsamples its chunks
+    void Reset(const Grid& grid);
+
+    // Call after Grid::Place changed the tile at (x, y)
+    void OnTilePlaced(const Grid& grid, uint32_t x, uint32_t y);
+
+    // Call once after a bulk edit changed tiles inside the region
+    void OnRegionChanged(const Grid& grid, TileRegion region);
+
+    // Catches up on chunks edited without the calls above and frees the cells of evicted chunks.
+    // Downsamples at most max_new_chunks chunks not seen before. Resets for a different grid.
+    void Sync(const Grid& grid, uint32_t max_new_chunks = UINT32_MAX);
+
+    // Levels including the grid, the last one is a single cell
+    uint32_t GetLevelCount() const;
+
+    uint32_t GetLevelWidth(const Grid& grid, uint32_t level) const;
+
+    uint32_t GetLevelHeight(const Grid& grid, uint32_t level) const;
+
+    // Air outside the level
+    uint8_t GetCell(const Grid& grid, uint32_t level, uint32_t x, uint32_t y) const;
+
+    // Cells [x, x + width) x [y, y + height) of a level clipped to it. Level 0 is lit when light is set.
+    TileView CopyView(const Grid& grid, const LightMap* light, uint32_t level, int64_t x, int64_t y, uint32_t width, uint32_t height) const;
+
+private:
+    bool IsInSync(const Grid& grid) const;
+
+    // Recomputes the chunk's cells from its tiles and the dense cells above it
+    void DownsampleChunk(const Grid& grid, uint32_t chunk);
+
+    // Sets the chunk's dense cell and recomputes the dense levels above it, stopping at the first
+    // level where nothing changed
+    void SetChunkCell(uint32_t chunk, uint8_t cell);
+
+    // Returns the chunk's slot to the pool, its cells read as its dense cell afterwards
+    void ReleaseChunk(uint32_t chunk);
+};